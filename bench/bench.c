@@ -0,0 +1,800 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "preprocess.h"
+#include "vectorization.h"
+#include "calculate.h"
+#include "corpus.h"
+#include "threadpool.h"
+#include "pipeline.h"
+#include "allpairs.h"
+#include "sink.h"
+
+// 端到端检测基准 (benchmark)
+// README 里 "改名、换序、改注释都能查出来" 的说法只靠 test/ 下的六个文件支撑。
+// 这里拿一批种子源文件，按固定的随机种子批量生成抄袭变体 (改名、函数换序、注释和空白、
+// for 改写成 while，以及全部叠加)，走完整的 "读文件 -> 预处理 -> 向量化 -> 建库 -> 两两比较"
+// 流程，报告吞吐量 (文件/s、对/s)、峰值内存，以及在 evaluate_similarity 的三个阈值
+// (calculate.h 的 SIMILARITY_THRESHOLD_*) 下的精确率和召回率。同一个种子文件派生出的文件两两算作正例，不同种子之间算作负例。
+//
+// 用法: bash compile.sh bench
+//       ./code_similarity_bench <种子文件...|-> [--mutants N] [--seed S] [--threads N] [--workdir 目录]
+
+#define BENCH_DEFAULT_MUTANTS 5
+#define BENCH_THRESHOLD_COUNT 3
+
+static const double THRESHOLDS[BENCH_THRESHOLD_COUNT] = {
+    SIMILARITY_THRESHOLD_VERY_HIGH, SIMILARITY_THRESHOLD_HIGH, SIMILARITY_THRESHOLD_MEDIUM
+};
+
+// 变体的种类，第 j 个变体 (从 0 算) 用第 j % MUT_KIND_COUNT 种
+typedef enum {
+    MUT_RENAME,      // 标识符一致改名
+    MUT_REORDER,     // 顶层函数/声明打乱顺序
+    MUT_COMMENTS,    // 去掉原注释、随机加注释、改缩进和空行
+    MUT_LOOPS,       // for (A; B; C) { ... } 改写成 { A; while (B) { ... C; } }
+    MUT_ALL,         // 以上全部叠加
+    MUT_KIND_COUNT
+} MutationKind;
+
+static const char *const MUT_NAMES[MUT_KIND_COUNT] = {
+    "改名", "函数换序", "注释/空白", "for 改 while", "全部叠加"
+};
+
+// ---------------- 随机数 (xorshift64*)，结果只取决于种子 ----------------
+
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ull;
+}
+
+static size_t rng_below(uint64_t *state, size_t n) {
+    return (size_t)(rng_next(state) % n);
+}
+
+static uint64_t rng_seed(uint64_t seed, uint64_t a, uint64_t b) {
+    uint64_t s = seed * 0x9E3779B97F4A7C15ull ^ (a + 1) * 0xBF58476D1CE4E5B9ull ^ (b + 1) * 0x94D049BB133111EBull;
+    return s ? s : 1;
+}
+
+// ---------------- 可增长的文本缓冲区 ----------------
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+static void text_append(Text *t, const char *s, size_t n) {
+    if (t->length + n + 1 > t->capacity) {
+        size_t capacity = t->capacity ? t->capacity : 4096;
+        while (t->length + n + 1 > capacity) capacity *= 2;
+        char *data = (char*)realloc(t->data, capacity);
+        if (!data) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            exit(1);
+        }
+        t->data = data;
+        t->capacity = capacity;
+    }
+    memcpy(t->data + t->length, s, n);
+    t->length += n;
+    t->data[t->length] = '\0';
+}
+
+static void text_puts(Text *t, const char *s) {
+    text_append(t, s, strlen(s));
+}
+
+// ---------------- 源代码的粗粒度切分 ----------------
+// 变体生成只需要区分这几类，不需要完整的 C 语法
+
+typedef enum {
+    TK_SPACE,       // 连续的空白
+    TK_COMMENT,     // /* */ 或 //
+    TK_DIRECTIVE,   // 行首 # 开始到行尾 (含续行)
+    TK_LITERAL,     // 字符串或字符常量
+    TK_IDENT,
+    TK_NUMBER,
+    TK_PUNCT        // 其他单个字符
+} TokenKind;
+
+typedef struct {
+    TokenKind kind;
+    const char *text;
+    size_t length;
+} SrcToken;
+
+typedef struct {
+    SrcToken *items;
+    size_t count;
+} SrcTokens;
+
+static void src_push(SrcTokens *tokens, size_t *capacity, TokenKind kind, const char *text, size_t length) {
+    if (tokens->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        SrcToken *items = (SrcToken*)realloc(tokens->items, *capacity * sizeof(SrcToken));
+        if (!items) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            exit(1);
+        }
+        tokens->items = items;
+    }
+    SrcToken token = { kind, text, length };
+    tokens->items[tokens->count++] = token;
+}
+
+static void src_tokenize(const char *s, size_t n, SrcTokens *tokens) {
+    size_t capacity = 0;
+    int line_start = 1;
+    tokens->items = NULL;
+    tokens->count = 0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        TokenKind kind;
+        unsigned char c = (unsigned char)s[i];
+        if (isspace(c)) {
+            while (j < n && isspace((unsigned char)s[j])) j++;
+            kind = TK_SPACE;
+        } else if (c == '/' && i + 1 < n && s[i + 1] == '*') {
+            const char *end = strstr(s + i + 2, "*/");
+            j = end ? (size_t)(end - s) + 2 : n;
+            kind = TK_COMMENT;
+        } else if (c == '/' && i + 1 < n && s[i + 1] == '/') {
+            while (j < n && s[j] != '\n') j++;
+            kind = TK_COMMENT;
+        } else if (c == '#' && line_start) {
+            while (j < n && !(s[j] == '\n' && s[j - 1] != '\\')) j++;
+            kind = TK_DIRECTIVE;
+        } else if (c == '"' || c == '\'') {
+            while (j < n && s[j] != (char)c && s[j] != '\n') j += s[j] == '\\' ? 2 : 1;
+            if (j < n && s[j] == (char)c) j++;
+            if (j > n) j = n;
+            kind = TK_LITERAL;
+        } else if (isalpha(c) || c == '_') {
+            while (j < n && (isalnum((unsigned char)s[j]) || s[j] == '_')) j++;
+            kind = TK_IDENT;
+        } else if (isdigit(c)) {
+            while (j < n && (isalnum((unsigned char)s[j]) || s[j] == '.')) j++;
+            kind = TK_NUMBER;
+        } else {
+            kind = TK_PUNCT;
+        }
+        if (kind == TK_SPACE) {
+            for (size_t k = i; k < j; k++) {
+                if (s[k] == '\n') line_start = 1;
+            }
+        } else if (kind != TK_COMMENT) {
+            line_start = 0;
+        }
+        src_push(tokens, &capacity, kind, s + i, j - i);
+        i = j;
+    }
+}
+
+static int token_is(const SrcToken *t, TokenKind kind, const char *text) {
+    return t->kind == kind && t->length == strlen(text) && memcmp(t->text, text, t->length) == 0;
+}
+
+static int token_punct(const SrcToken *t, char c) {
+    return t->kind == TK_PUNCT && t->text[0] == c;
+}
+
+static int token_insignificant(const SrcToken *t) {
+    return t->kind == TK_SPACE || t->kind == TK_COMMENT || t->kind == TK_DIRECTIVE;
+}
+
+// i 之后 (含 i) 第一个有意义的 token，没有返回 end
+static size_t next_significant(const SrcTokens *tokens, size_t i, size_t end) {
+    while (i < end && token_insignificant(&tokens->items[i])) i++;
+    return i;
+}
+
+// 与 tokens[i] (open) 配对的 close 的下标，找不到返回 end
+static size_t match_bracket(const SrcTokens *tokens, size_t i, size_t end, char open, char close) {
+    int depth = 0;
+    for (; i < end; i++) {
+        if (token_punct(&tokens->items[i], open)) depth++;
+        else if (token_punct(&tokens->items[i], close) && --depth == 0) return i;
+    }
+    return end;
+}
+
+static void emit_tokens(Text *out, const SrcTokens *tokens, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) text_append(out, tokens->items[i].text, tokens->items[i].length);
+}
+
+// ---------------- 各种变体 ----------------
+
+static const char *const C_KEYWORDS[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+    "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+    "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+    "volatile", "while", "_Bool", "_Complex", "_Imaginary", "_Thread_local", "_Atomic", "_Alignas",
+    "_Alignof", "_Noreturn", "_Static_assert", "_Generic"
+};
+
+static int is_c_keyword(const SrcToken *t) {
+    for (size_t k = 0; k < sizeof(C_KEYWORDS) / sizeof(C_KEYWORDS[0]); k++) {
+        if (token_is(t, TK_IDENT, C_KEYWORDS[k])) return 1;
+    }
+    return 0;
+}
+
+// 标识符一致改名：新名字只由原名字和变体的随机种子决定，同一个名字处处改成同一个
+static void mutate_rename(const SrcTokens *tokens, uint64_t salt, Text *out) {
+    static const char *const prefixes[] = { "tmp", "val", "x", "data", "item", "p", "n", "buf" };
+    for (size_t i = 0; i < tokens->count; i++) {
+        const SrcToken *t = &tokens->items[i];
+        if (t->kind != TK_IDENT || is_c_keyword(t)) {
+            text_append(out, t->text, t->length);
+            continue;
+        }
+        uint64_t h = salt;
+        for (size_t k = 0; k < t->length; k++) h = (h ^ (unsigned char)t->text[k]) * 1099511628211ull;
+        char name[48];
+        snprintf(name, sizeof(name), "%s_%llx", prefixes[h % 8], (unsigned long long)(h >> 44));
+        text_puts(out, name);
+    }
+}
+
+// 顶层单元：到深度 0 的 ';' 为止，或者到深度 0 的 '}' 且后面不是 ';'、',' 或名字 (struct 定义的变量) 为止。
+// 单元前面的空白、注释和预处理指令跟着单元一起移动
+static void mutate_reorder(const SrcTokens *tokens, uint64_t *rng, Text *out) {
+    size_t unit_capacity = 16, unit_count = 0;
+    size_t *bounds = (size_t*)malloc((unit_capacity + 1) * sizeof(size_t));
+    if (!bounds) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        exit(1);
+    }
+    bounds[0] = 0;
+    int depth = 0;
+    for (size_t i = 0; i < tokens->count; i++) {
+        const SrcToken *t = &tokens->items[i];
+        int ends = 0;
+        if (token_punct(t, '{') || token_punct(t, '(')) depth++;
+        else if (token_punct(t, ')')) depth--;
+        else if (token_punct(t, '}')) {
+            if (--depth == 0) {
+                size_t k = next_significant(tokens, i + 1, tokens->count);
+                ends = k == tokens->count || !(token_punct(&tokens->items[k], ';') ||
+                                               token_punct(&tokens->items[k], ',') ||
+                                               tokens->items[k].kind == TK_IDENT);
+            }
+        } else if (depth == 0 && token_punct(t, ';')) {
+            ends = 1;
+        }
+        if (!ends) continue;
+        if (unit_count + 1 == unit_capacity) {
+            unit_capacity *= 2;
+            size_t *grown = (size_t*)realloc(bounds, (unit_capacity + 1) * sizeof(size_t));
+            if (!grown) {
+                fprintf(stderr, "错误：内存分配失败\n");
+                exit(1);
+            }
+            bounds = grown;
+        }
+        bounds[++unit_count] = i + 1;
+    }
+
+    size_t *order = (size_t*)malloc((unit_count ? unit_count : 1) * sizeof(size_t));
+    if (!order) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        exit(1);
+    }
+    for (size_t u = 0; u < unit_count; u++) order[u] = u;
+    for (size_t u = unit_count; u > 1; u--) {
+        size_t v = rng_below(rng, u);
+        size_t tmp = order[u - 1];
+        order[u - 1] = order[v];
+        order[v] = tmp;
+    }
+    for (size_t u = 0; u < unit_count; u++) {
+        emit_tokens(out, tokens, bounds[order[u]], bounds[order[u] + 1]);
+        text_puts(out, "\n");
+    }
+    emit_tokens(out, tokens, unit_count ? bounds[unit_count] : 0, tokens->count);
+    free(order);
+    free(bounds);
+}
+
+// 去掉原有注释，换行处随机加注释和空行，缩进统一换成另一种风格
+static void mutate_comments(const SrcTokens *tokens, uint64_t *rng, Text *out) {
+    static const char *const notes[] = { "/* check */", "/* helper */", "// update", "/* TODO */",
+                                         "// loop", "/* result */" };
+    static const char *const indents[] = { "\t", "  ", "    ", "        " };
+    const char *indent = indents[rng_below(rng, 4)];
+    int depth = 0;
+    for (size_t i = 0; i < tokens->count; i++) {
+        const SrcToken *t = &tokens->items[i];
+        if (token_punct(t, '{')) depth++;
+        else if (token_punct(t, '}') && depth > 0) depth--;
+
+        if (t->kind == TK_COMMENT) {
+            text_puts(out, " ");
+            continue;
+        }
+        if (t->kind != TK_SPACE) {
+            text_append(out, t->text, t->length);
+            continue;
+        }
+        if (!memchr(t->text, '\n', t->length)) {
+            text_puts(out, rng_below(rng, 4) == 0 ? "  " : " ");
+            continue;
+        }
+        // 预处理指令后面不加注释，免得续行出问题
+        int after_directive = i > 0 && tokens->items[i - 1].kind == TK_DIRECTIVE;
+        if (i > 0 && !after_directive && rng_below(rng, 4) == 0) {
+            text_puts(out, " ");
+            text_puts(out, notes[rng_below(rng, 6)]);
+        }
+        text_puts(out, "\n");
+        if (rng_below(rng, 6) == 0) text_puts(out, "\n");
+        size_t k = next_significant(tokens, i + 1, tokens->count);
+        int level = depth - (k < tokens->count && token_punct(&tokens->items[k], '}') ? 1 : 0);
+        for (int d = 0; d < level; d++) text_puts(out, indent);
+    }
+}
+
+// [begin, end) 里有没有 continue (有的话 for 改 while 会改变语义，不改这个循环)
+static int has_continue(const SrcTokens *tokens, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (token_is(&tokens->items[i], TK_IDENT, "continue")) return 1;
+    }
+    return 0;
+}
+
+static int range_is_empty(const SrcTokens *tokens, size_t begin, size_t end) {
+    return next_significant(tokens, begin, end) == end;
+}
+
+static void emit_loops(const SrcTokens *tokens, size_t begin, size_t end, Text *out) {
+    for (size_t i = begin; i < end; i++) {
+        const SrcToken *t = &tokens->items[i];
+        if (!token_is(t, TK_IDENT, "for")) {
+            text_append(out, t->text, t->length);
+            continue;
+        }
+        size_t open = next_significant(tokens, i + 1, end);
+        size_t close = open < end && token_punct(&tokens->items[open], '(')
+            ? match_bracket(tokens, open, end, '(', ')') : end;
+        // 括号里深度为 0 的两个分号
+        size_t semi[2], found = 0;
+        int depth = 0;
+        for (size_t k = open + 1; close < end && k < close; k++) {
+            if (token_punct(&tokens->items[k], '(')) depth++;
+            else if (token_punct(&tokens->items[k], ')')) depth--;
+            else if (depth == 0 && token_punct(&tokens->items[k], ';') && found < 2) semi[found++] = k;
+        }
+        size_t body = close < end ? next_significant(tokens, close + 1, end) : end;
+        size_t body_end = body < end && token_punct(&tokens->items[body], '{')
+            ? match_bracket(tokens, body, end, '{', '}') : end;
+        if (found != 2 || body_end == end || has_continue(tokens, body, body_end)) {
+            text_append(out, t->text, t->length);
+            continue;
+        }
+
+        text_puts(out, "{ ");
+        if (!range_is_empty(tokens, open + 1, semi[0])) {
+            emit_loops(tokens, open + 1, semi[0], out);
+            text_puts(out, "; ");
+        }
+        text_puts(out, "while (");
+        if (range_is_empty(tokens, semi[0] + 1, semi[1])) text_puts(out, "1");
+        else emit_loops(tokens, semi[0] + 1, semi[1], out);
+        text_puts(out, ") {");
+        emit_loops(tokens, body + 1, body_end, out);
+        if (!range_is_empty(tokens, semi[1] + 1, close)) {
+            text_puts(out, " ");
+            emit_loops(tokens, semi[1] + 1, close, out);
+            text_puts(out, ";");
+        }
+        text_puts(out, " } }");
+        i = body_end;
+    }
+}
+
+static void mutate_loops(const SrcTokens *tokens, Text *out) {
+    emit_loops(tokens, 0, tokens->count, out);
+}
+
+// 对 source 做一种变体，结果写进 out
+static void apply_mutation(const char *source, size_t length, MutationKind kind, uint64_t rng, Text *out) {
+    static const MutationKind steps[] = { MUT_RENAME, MUT_LOOPS, MUT_REORDER, MUT_COMMENTS };
+    Text current = { 0 };
+    text_append(&current, source, length);
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+        if (kind != MUT_ALL && kind != steps[s]) continue;
+        SrcTokens tokens;
+        Text next = { 0 };
+        src_tokenize(current.data, current.length, &tokens);
+        switch (steps[s]) {
+            case MUT_RENAME:  mutate_rename(&tokens, rng, &next); break;
+            case MUT_LOOPS:   mutate_loops(&tokens, &next); break;
+            case MUT_REORDER: mutate_reorder(&tokens, &rng, &next); break;
+            default:          mutate_comments(&tokens, &rng, &next); break;
+        }
+        text_append(&next, "", 0);
+        free(tokens.items);
+        free(current.data);
+        current = next;
+    }
+    *out = current;
+}
+
+// ---------------- 计时与统计 ----------------
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// 每个文件属于哪个种子 (family)，以及它是原文件 (-1) 还是哪种变体
+typedef struct {
+    const Corpus *corpus;
+    const uint32_t *family;
+    uint64_t (*hits)[BENCH_THRESHOLD_COUNT][2];   // 每个线程一行：[阈值][0 = 负例, 1 = 正例] 得分达标的对数
+    int workers;
+} QualityJob;
+
+static void quality_tile(size_t row_begin, size_t row_end, size_t col_begin, size_t col_end, void *ctx) {
+    QualityJob *job = (QualityJob*)ctx;
+    int worker = threadpool_worker_id();
+    uint64_t (*hits)[2] = job->hits[worker >= 0 && worker < job->workers ? worker : job->workers];
+    const Corpus *corpus = job->corpus;
+    for (size_t a = row_begin; a < row_end; a++) {
+        for (size_t b = a + 1 > col_begin ? a + 1 : col_begin; b < col_end; b++) {
+            double score = calculate_cosine_similarity_normed(corpus_vector(corpus, a), corpus->norms[a],
+                                                              corpus_vector(corpus, b), corpus->norms[b],
+                                                              VECTOR_DIMENSION);
+            int positive = job->family[a] == job->family[b];
+            for (int t = 0; t < BENCH_THRESHOLD_COUNT; t++) {
+                if (score >= THRESHOLDS[t]) hits[t][positive]++;
+            }
+        }
+    }
+}
+
+// 按显示宽度补空格：UTF-8 的多字节字符 (这里都是汉字) 占两列
+static void print_padded(const char *s, int width) {
+    int columns = 0;
+    for (const unsigned char *p = (const unsigned char*)s; *p; p++) {
+        if (*p < 0x80) columns++;
+        else if ((*p & 0xC0) == 0xC0) columns += 2;
+    }
+    printf("%s%*s", s, width > columns ? width - columns : 0, "");
+}
+
+static void print_ratio(uint64_t num, uint64_t den) {
+    if (den == 0) printf("     -  ");
+    else printf("  %.4f", (double)num / (double)den);
+}
+
+// ---------------- 主流程 ----------------
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} NameList;
+
+static void name_push(NameList *list, const char *name) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        char **items = (char**)realloc(list->items, list->capacity * sizeof(char*));
+        if (!items) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            exit(1);
+        }
+        list->items = items;
+    }
+    char *copy = strdup(name);
+    if (!copy) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        exit(1);
+    }
+    list->items[list->count++] = copy;
+}
+
+static void name_list_free(NameList *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->items[i]);
+    free(list->items);
+}
+
+// 没有指定 --workdir 时生成的文件放在 mkdtemp 建的临时目录里
+static char temp_dir[] = "/tmp/codesim-bench-XXXXXX";
+static int temp_dir_created;
+
+// 删除临时目录和里面的所有文件。main 的清理代码调用一次；辅助函数内存不足时直接 exit，靠 atexit 兜底
+static void remove_temp_dir(void) {
+    if (!temp_dir_created) return;
+    temp_dir_created = 0;
+    DIR *d = opendir(temp_dir);
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", temp_dir, entry->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(temp_dir);
+}
+
+static void usage(void) {
+    fprintf(stderr, "用法: code_similarity_bench <种子文件...|-> [--mutants N] [--seed S] [--threads N] [--workdir 目录]\n");
+    fprintf(stderr, "  每个种子文件生成 N 个变体 (默认 %d)，依次为：", BENCH_DEFAULT_MUTANTS);
+    for (int k = 0; k < MUT_KIND_COUNT; k++) fprintf(stderr, "%s%s", k ? "、" : "", MUT_NAMES[k]);
+    fprintf(stderr, "\n  --workdir 指定时生成的文件保留在该目录，否则放在临时目录里用完删除\n");
+}
+
+int main(int argc, char *argv[]) {
+    size_t mutants = BENCH_DEFAULT_MUTANTS;
+    uint64_t seed = 1;
+    int threads = 0;
+    const char *workdir = NULL;
+    NameList seeds = { 0 };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mutants") == 0 && i + 1 < argc) {
+            mutants = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workdir") == 0 && i + 1 < argc) {
+            workdir = argv[++i];
+        } else if (strcmp(argv[i], "-") == 0) {
+            char line[4096];
+            while (fgets(line, sizeof(line), stdin)) {
+                size_t len = strlen(line);
+                while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+                if (len > 0) name_push(&seeds, line);
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            usage();
+            name_list_free(&seeds);
+            return 1;
+        } else {
+            name_push(&seeds, argv[i]);
+        }
+    }
+    if (seeds.count == 0 || mutants == 0) {
+        usage();
+        name_list_free(&seeds);
+        return 1;
+    }
+
+    // 1. 生成变体。文件按 种子 0、种子 0 的各个变体、种子 1…… 的顺序排列。
+    //    从这里开始出错都跳到最后的清理代码，临时目录不会留在 /tmp 里
+    const char *dir = workdir;
+    if (workdir) {
+        mkdir(workdir, 0755);
+    } else if (!(dir = mkdtemp(temp_dir))) {
+        fprintf(stderr, "错误：无法创建临时目录\n");
+        name_list_free(&seeds);
+        return 1;
+    } else {
+        temp_dir_created = 1;
+        atexit(remove_temp_dir);
+    }
+
+    int status = 1;
+    NameList files = { 0 };
+    uint32_t *family = NULL;
+    int *kind = NULL;
+    ThreadPool *pool = NULL;
+    int *vectors = NULL, *ok = NULL;
+    const char **kept_paths = NULL;
+    Corpus corpus;
+    int corpus_opened = 0;
+    QualityJob job = { &corpus, NULL, NULL, 0 };
+    size_t family_count = 0, slots = 0;
+    double t0 = now_seconds();
+    for (size_t s = 0; s < seeds.count; s++) {
+        size_t length;
+        char *source = read_source_file(seeds.items[s], &length);
+        if (!source) {
+            fprintf(stderr, "警告：跳过种子文件 '%s'\n", seeds.items[s]);
+            continue;
+        }
+        if (files.count + mutants + 1 > slots) {
+            slots = (files.count + mutants + 1) * 2;
+            uint32_t *grown_family = (uint32_t*)realloc(family, slots * sizeof(uint32_t));
+            if (grown_family) family = grown_family;
+            int *grown_kind = (int*)realloc(kind, slots * sizeof(int));
+            if (grown_kind) kind = grown_kind;
+            if (!grown_family || !grown_kind) {
+                fprintf(stderr, "错误：内存分配失败\n");
+                free(source);
+                goto cleanup;
+            }
+        }
+        family[files.count] = (uint32_t)family_count;
+        kind[files.count] = -1;
+        name_push(&files, seeds.items[s]);
+        for (size_t m = 0; m < mutants; m++) {
+            Text mutated;
+            MutationKind k = (MutationKind)(m % MUT_KIND_COUNT);
+            apply_mutation(source, length, k, rng_seed(seed, s, m), &mutated);
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/s%zu_m%zu.c", dir, s, m);
+            FILE *file = fopen(path, "w");
+            int written = file && fwrite(mutated.data, 1, mutated.length, file) == mutated.length;
+            if (file && fclose(file) != 0) written = 0;
+            free(mutated.data);
+            if (!written) {
+                fprintf(stderr, "错误：无法写入 %s\n", path);
+                free(source);
+                goto cleanup;
+            }
+            family[files.count] = (uint32_t)family_count;
+            kind[files.count] = (int)k;
+            name_push(&files, path);
+        }
+        free(source);
+        family_count++;
+    }
+    double t_mutate = now_seconds() - t0;
+    printf("基准：%zu 个种子文件，每个生成 %zu 个变体 (随机种子 %llu)，共 %zu 个文件，生成用时 %.2f s\n",
+           family_count, mutants, (unsigned long long)seed, files.count, t_mutate);
+
+    pool = threadpool_create(threads);
+    if (!pool) {
+        fprintf(stderr, "错误：无法创建线程池\n");
+        goto cleanup;
+    }
+
+    // 2. 完整的向量化流水线
+    size_t n = files.count;
+    vectors = (int*)malloc((n ? n : 1) * VECTOR_DIMENSION * sizeof(int));
+    ok = (int*)malloc((n ? n : 1) * sizeof(int));
+    if (!vectors || !ok) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto cleanup;
+    }
+    unsigned long long bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(files.items[i], &st) == 0) bytes += (unsigned long long)st.st_size;
+    }
+    PipelineOutput out = { vectors, ok, NULL, NULL, NULL };
+    t0 = now_seconds();
+    pipeline_vectorize_files(pool, (const char *const *)files.items, n, 0, &out);
+    double t_vectorize = now_seconds() - t0;
+    printf("向量化：%zu 个文件，%.1f MB，%.3f s (%.0f 文件/s，%.1f MB/s)，%d 个线程\n", n, bytes / 1048576.0,
+           t_vectorize, n / t_vectorize, bytes / 1048576.0 / t_vectorize, threadpool_size(pool));
+
+    // 处理失败的文件 (例如变体是空文件) 去掉，family 跟着压紧
+    kept_paths = (const char**)malloc((n ? n : 1) * sizeof(char*));
+    if (!kept_paths) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto cleanup;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!ok[i]) {
+            fprintf(stderr, "警告：跳过文件 '%s'\n", files.items[i]);
+            continue;
+        }
+        memmove(vectors + kept * VECTOR_DIMENSION, vectors + i * VECTOR_DIMENSION, VECTOR_DIMENSION * sizeof(int));
+        family[kept] = family[i];
+        kind[kept] = kind[i];
+        kept_paths[kept++] = files.items[i];
+    }
+
+    // 3. 建库并映射回来，两两比较走 --all-pairs --stream 的同一条路径 (结果丢进 /dev/null)
+    char corpus_path_buf[4096];
+    snprintf(corpus_path_buf, sizeof(corpus_path_buf), "%s/bench.bin", dir);
+    CorpusInput input = { kept_paths, vectors, kept, VECTOR_DIMENSION,
+                          NULL, NULL, NULL, NULL, NULL, NULL };
+    if (corpus_write(corpus_path_buf, &input) != 0 || corpus_open(corpus_path_buf, &corpus) != 0) goto cleanup;
+    corpus_opened = 1;
+
+    ResultSink *sink = result_sink_open("/dev/null", SINK_FORMAT_BINARY, &corpus,
+                                        THRESHOLDS[BENCH_THRESHOLD_COUNT - 1], threadpool_size(pool));
+    if (!sink) goto cleanup;
+    t0 = now_seconds();
+    int rc = allpairs_stream(pool, &corpus, NULL, 0, corpus.count, 0, corpus.count,
+                             THRESHOLDS[BENCH_THRESHOLD_COUNT - 1], sink);
+    double t_pairs = now_seconds() - t0;
+    if (result_sink_close(sink) != 0 || rc != 0) goto cleanup;
+    double pair_count = (double)corpus.count * (double)(corpus.count - 1) / 2.0;
+    printf("两两比较：%.0f 对，%.3f s (%.3g 对/s)\n", pair_count, t_pairs, t_pairs > 0 ? pair_count / t_pairs : 0.0);
+
+    // 4. 精确率 / 召回率：每个线程各记一份计数，最后相加
+    int workers = threadpool_size(pool);
+    job.family = family;
+    job.workers = workers;
+    job.hits = (uint64_t (*)[BENCH_THRESHOLD_COUNT][2])calloc((size_t)workers + 1, sizeof(*job.hits));
+    if (!job.hits) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto cleanup;
+    }
+    threadpool_parallel_tiles(pool, 0, corpus.count, 0, corpus.count, 256, quality_tile, &job);
+    uint64_t hits[BENCH_THRESHOLD_COUNT][2] = { { 0 } };
+    for (int w = 0; w <= workers; w++) {
+        for (int t = 0; t < BENCH_THRESHOLD_COUNT; t++) {
+            hits[t][0] += job.hits[w][t][0];
+            hits[t][1] += job.hits[w][t][1];
+        }
+    }
+
+    uint64_t positives = 0;
+    for (size_t i = 0, j; i < kept; i = j) {
+        for (j = i; j < kept && family[j] == family[i]; j++) {
+        }
+        positives += (uint64_t)(j - i) * (j - i - 1) / 2;
+    }
+    uint64_t negatives = (uint64_t)pair_count - positives;
+    printf("\n阈值    精确率    召回率    误报率   (正例 %llu 对，负例 %llu 对)\n",
+           (unsigned long long)positives, (unsigned long long)negatives);
+    for (int t = 0; t < BENCH_THRESHOLD_COUNT; t++) {
+        printf("%.2f  ", THRESHOLDS[t]);
+        print_ratio(hits[t][1], hits[t][1] + hits[t][0]);
+        print_ratio(hits[t][1], positives);
+        print_ratio(hits[t][0], negatives);
+        printf("\n");
+    }
+
+    // 5. 按变体种类：原文件与自己的变体之间的得分
+    double sum[MUT_KIND_COUNT] = { 0 };
+    uint64_t count[MUT_KIND_COUNT] = { 0 }, above[MUT_KIND_COUNT][BENCH_THRESHOLD_COUNT] = { { 0 } };
+    for (size_t i = 0, origin = 0; i < kept; i++) {
+        if (kind[i] < 0) {
+            origin = i;
+            continue;
+        }
+        if (family[origin] != family[i] || kind[origin] >= 0) continue;   // 原文件本身处理失败
+        double score = calculate_cosine_similarity_normed(corpus_vector(&corpus, origin), corpus.norms[origin],
+                                                          corpus_vector(&corpus, i), corpus.norms[i],
+                                                          VECTOR_DIMENSION);
+        sum[kind[i]] += score;
+        count[kind[i]]++;
+        for (int t = 0; t < BENCH_THRESHOLD_COUNT; t++) above[kind[i]][t] += score >= THRESHOLDS[t];
+    }
+    printf("\n变体种类        平均得分 ");
+    for (int t = 0; t < BENCH_THRESHOLD_COUNT; t++) printf("  >=%.2f  ", THRESHOLDS[t]);
+    printf(" (原文件 vs 变体)\n");
+    for (int k = 0; k < MUT_KIND_COUNT; k++) {
+        if (count[k] == 0) continue;
+        print_padded(MUT_NAMES[k], 14);
+        printf("  %.4f ", sum[k] / count[k]);
+        for (int t = 0; t < BENCH_THRESHOLD_COUNT; t++) print_ratio(above[k][t], count[k]);
+        printf("\n");
+    }
+
+    struct rusage usage_info;
+    getrusage(RUSAGE_SELF, &usage_info);
+    printf("\n峰值常驻内存：%.1f MB\n", usage_info.ru_maxrss / 1024.0);
+    status = 0;
+
+    // 6. 清理 (出错时也从这里走)：--workdir 里生成的文件保留，临时目录整个删掉
+cleanup:
+    free(job.hits);
+    if (corpus_opened) corpus_close(&corpus);
+    if (pool) threadpool_destroy(pool);
+    free(kept_paths);
+    free(vectors);
+    free(ok);
+    free(family);
+    free(kind);
+    name_list_free(&files);
+    name_list_free(&seeds);
+    remove_temp_dir();
+    return status;
+}
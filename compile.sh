@@ -7,15 +7,18 @@ CC="gcc"
 # -Wall -Wextra: 开启所有常用警告，帮助发现潜在问题
 # -Iinclude: 告诉编译器在 'include' 目录中查找头文件
 # -std=c11: 使用 C11 标准进行编译
-CFLAGS="-Wall -Wextra -Iinclude -std=c11"
+# -pthread: 线程池 (threadpool.c) 依赖 POSIX 线程
+# -O2: 开启优化，GCC 12 起 -O2 会自动向量化 minhash.c 里的排列循环
+# 预处理的向量扫描默认用 SSE2 (16 字节)，追加 -march=native 或 -mavx2 可换成 AVX2 (32 字节)
+CFLAGS="-Wall -Wextra -O2 -Iinclude -std=c11 -pthread"
 
 # 定义链接选项
 # -lm: 链接数学库，因为您的 calculate.c 中使用了 sqrt 函数
-LDFLAGS="-lm"
+LDFLAGS="-lm -pthread"
 
 # 定义源文件列表
 # 注意: 这里列出了您项目中的所有 .c 源文件
-SRCS="src/main.c src/preprocess.c src/tokenization.c src/vectorization.c src/calculate.c"
+SRCS="src/main.c src/preprocess.c src/tokenization.c src/vectorization.c src/calculate.c src/corpus.c src/commands.c src/threadpool.c src/pipeline.c src/prefetch.c src/allpairs.c src/minhash.c src/sink.c src/tokenstream.c src/tfidf.c src/gst.c src/locate.c src/dedup.c src/archive.c src/trace.c src/window.c src/json.c"
 
 # 定义可执行文件的名称
 EXECUTABLE="code_similarity_checker"
@@ -40,11 +43,106 @@ else
     exit 1
 fi
 
+# --- 编译嵌入式库 libcodesim ---
+# 只包含预处理/分词/向量化/打分这几个核心模块和 codesim.c，不带命令行。
+# 预处理和向量化的大文件分块并行入口用到线程池，所以 threadpool.c 也要编进来 (不对外导出)。
+# -fPIC: 共享库需要位置无关代码
+# -fvisibility=hidden: 只导出 codesim.h 里标了 CODESIM_API 的函数
+# -Wl,--no-undefined: 库里漏了哪个源文件时直接链接失败，而不是等到使用者加载时才报未定义符号
+LIB_SRCS="src/codesim.c src/preprocess.c src/tokenization.c src/vectorization.c src/calculate.c src/threadpool.c"
+LIB_DIR="build/lib"
+
+echo "正在编译 libcodesim..."
+mkdir -p $LIB_DIR
+LIB_OBJS=""
+for src in $LIB_SRCS; do
+    obj="$LIB_DIR/$(basename ${src%.c}).o"
+    $CC $CFLAGS -fPIC -fvisibility=hidden -c $src -o $obj || { echo "libcodesim 编译失败。"; exit 1; }
+    LIB_OBJS="$LIB_OBJS $obj"
+done
+ar rcs libcodesim.a $LIB_OBJS && $CC -shared -Wl,--no-undefined $LIB_OBJS -o libcodesim.so $LDFLAGS
+if [ $? -eq 0 ]; then
+    echo "已生成 libcodesim.a 和 libcodesim.so (头文件 include/codesim.h)"
+else
+    echo "libcodesim 链接失败。"
+    exit 1
+fi
+
+# --- 编译基准程序 (可选) ---
+# 运行 'bash compile.sh bench' 额外生成 code_similarity_bench：用种子源文件批量生成抄袭变体，
+# 报告吞吐量、峰值内存和各阈值下的精确率/召回率。除了 main.c 之外与主程序用同一批源文件
+BENCH_EXECUTABLE="code_similarity_bench"
+if [ "$1" == "bench" ]; then
+    echo "正在编译基准程序..."
+    $CC $CFLAGS bench/bench.c ${SRCS/src\/main.c /} -o $BENCH_EXECUTABLE $LDFLAGS
+    if [ $? -eq 0 ]; then
+        echo "已生成 ./$BENCH_EXECUTABLE，例如: ./$BENCH_EXECUTABLE test/*.c --mutants 10"
+    else
+        echo "基准程序编译失败。"
+        exit 1
+    fi
+fi
+
+# --- 回归测试 (可选) ---
+# 运行 'bash compile.sh test' 编译并运行 tests/regression_test.c：分块并行预处理与串行结果的逐字节比对等，
+# 再用编好的主程序做端到端检查 (并行分片归并、--dedup 与 --all-pairs 的输出比对)，
+# 最后用 tests/codesim_test.c 检查 libcodesim 的错误码和得分。
+# 预处理的扫描宽度由编译选项决定，所以默认 (SSE2) 编一次，CPU 支持 AVX2 时再用 -mavx2 编一次
+if [ "$1" == "test" ]; then
+    echo "正在编译并运行回归测试..."
+    mkdir -p build
+    TEST_SRCS="tests/regression_test.c src/calculate.c src/threadpool.c src/tokenization.c src/vectorization.c src/pipeline.c src/prefetch.c src/tokenstream.c src/minhash.c src/trace.c src/json.c"
+    $CC $CFLAGS $TEST_SRCS -o build/regression_test $LDFLAGS && ./build/regression_test || { echo "回归测试失败。"; exit 1; }
+    if grep -qw avx2 /proc/cpuinfo 2>/dev/null; then
+        $CC $CFLAGS -mavx2 $TEST_SRCS -o build/regression_test_avx2 $LDFLAGS && ./build/regression_test_avx2 \
+            || { echo "回归测试 (AVX2) 失败。"; exit 1; }
+    fi
+
+    # 端到端检查：用本仓库的源文件建一个小语料库，比较几种算法的输出
+    E2E_DIR=$(mktemp -d)
+    e2e_fail() { echo "$1"; rm -rf "$E2E_DIR"; exit 1; }
+    E2E_CORPUS="$E2E_DIR/corpus.bin"
+    cp test/test1.c $E2E_DIR/copy.c     # 保证 --dedup 至少有一组完全相同的文件可以折叠
+    ./$EXECUTABLE --build-corpus $E2E_CORPUS test/*.c src/*.c tests/*.c bench/*.c $E2E_DIR/copy.c > /dev/null 2>&1 \
+        && ./$EXECUTABLE --all-pairs $E2E_CORPUS 0.5 --output $E2E_DIR/all.txt 2> /dev/null \
+        || e2e_fail "端到端检查：建库或 --all-pairs 失败。"
+
+    # 分片：每个分片一个进程同时运行，归并结果必须与单进程 --all-pairs 逐字节相同
+    SHARD_PIDS=""
+    for shard in $(./$EXECUTABLE --shard-plan $E2E_CORPUS 8); do
+        ./$EXECUTABLE --run-shard $E2E_CORPUS $shard "$E2E_DIR/part-${shard//:/-}.bin" 0.5 2> /dev/null &
+        SHARD_PIDS="$SHARD_PIDS $!"
+    done
+    for pid in $SHARD_PIDS; do
+        wait $pid || e2e_fail "端到端检查：--run-shard 失败。"
+    done
+    ./$EXECUTABLE --merge-shards $E2E_CORPUS $E2E_DIR/part-*.bin --output $E2E_DIR/merged.txt 2> /dev/null \
+        && cmp -s $E2E_DIR/all.txt $E2E_DIR/merged.txt \
+        || e2e_fail "端到端检查：并行分片归并的结果与 --all-pairs 不同。"
+    echo "分片：$(echo $SHARD_PIDS | wc -w) 个进程并行计算后归并，结果与 --all-pairs 相同"
+
+    # 重复文件折叠：只比较代表再展开，输出必须与不加 --dedup 逐字节相同
+    ./$EXECUTABLE --all-pairs $E2E_CORPUS 0.5 --dedup --output $E2E_DIR/dedup.txt 2> /dev/null \
+        && cmp -s $E2E_DIR/all.txt $E2E_DIR/dedup.txt \
+        || e2e_fail "端到端检查：--dedup 的结果与不加时不同。"
+    echo "重复文件折叠：--dedup 的结果与逐对比较相同"
+
+    # libcodesim：链接上面生成的共享库，检查错误码，得分与命令行工具对照
+    CLI_SCORE=$(printf 'test/test1.c test/test3.c\n' | ./$EXECUTABLE --pairs - 2> /dev/null | cut -f1)
+    $CC $CFLAGS tests/codesim_test.c -o build/codesim_test -L. -lcodesim $LDFLAGS \
+        && LD_LIBRARY_PATH=. ./build/codesim_test test/test1.c test/test3.c "$CLI_SCORE" \
+        || e2e_fail "libcodesim 接口测试失败。"
+
+    rm -rf "$E2E_DIR"
+    echo "回归测试全部通过。"
+fi
+
 # --- 清理功能 (可选) ---
 # 该功能用于删除编译过程中生成的所有 .o 文件和最终的可执行文件
 # 您可以通过运行 'bash compile.sh clean' 来使用它
 if [ "$1" == "clean" ]; then
     echo "正在清理生成的文件..."
-    rm -f $EXECUTABLE
+    rm -f $EXECUTABLE $BENCH_EXECUTABLE libcodesim.a libcodesim.so
+    rm -rf build
     echo "清理完成。"
 fi
@@ -0,0 +1,75 @@
+#ifndef ALLPAIRS_H
+#define ALLPAIRS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "corpus.h"
+#include "threadpool.h"
+#include "sink.h"
+#include "tfidf.h"
+
+// 语料库内部的两两比较 (all-pairs)
+// 相似度矩阵是对称的，只算上三角 (a < b)。整个矩阵可以按 block_size 切成
+// "行块 x 列块" 的分片 (shard)，分给不同进程甚至不同机器去算，
+// 每个分片把排好序的结果写成一个部分结果文件，最后再合并成完整报告。
+
+// 一条结果：语料库里的两个下标和得分
+typedef struct {
+    uint32_t a, b;
+    double score;
+} PairResult;
+
+typedef struct {
+    PairResult *items;
+    size_t count;
+} PairList;
+
+// 分片描述：第 row_block 个行块 x 第 col_block 个列块，每块 block_size 个文件
+typedef struct {
+    uint64_t row_block;
+    uint64_t col_block;
+    uint64_t block_size;
+} ShardSpec;
+
+// 计算 [row_begin, row_end) x [col_begin, col_end) 里所有 a < b 且得分 >= threshold 的文件对，
+// 结果按 (a, b) 升序排列，与线程数无关。tfidf 不为 NULL 时按 TF-IDF 加权打分。成功返回 0，失败返回 -1
+int allpairs_score(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                   size_t row_begin, size_t row_end, size_t col_begin, size_t col_end,
+                   double threshold, PairList *out);
+void pair_list_free(PairList *list);
+
+// 与 allpairs_score 相同的计算，但每个工作线程算出一条就直接交给 sink，不在内存里攒结果也不排序，
+// 输出顺序取决于线程调度。适合结果很多、只需要落盘再处理的场景。成功返回 0，失败返回 -1
+int allpairs_stream(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                    size_t row_begin, size_t row_end, size_t col_begin, size_t col_end,
+                    double threshold, ResultSink *sink);
+
+// 内存预算模式：语料库和结果都放不进内存时使用。行块常驻、列块依次流过 (每读一遍列块和尽量多的行配对)，
+// 算完的块把映射的页还给系统；每个线程的结果缓冲区容量固定，写满就排序后溢写成临时文件里的有序 run，
+// 最后 k 路归并，按 (a, b) 升序交给 sink，输出与 allpairs_score 完全相同。
+// 常驻内存不超过 memory_budget 字节，与语料库大小无关 (没有 mmap 的平台上整个语料库已在内存里，做不到)
+#define ALLPAIRS_MIN_BUDGET ((size_t)16 * 1024 * 1024)
+
+int allpairs_bounded(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                     double threshold, size_t memory_budget, ResultSink *sink);
+
+// 解析 "行块:列块:块大小" 形式的分片描述，要求行块 <= 列块
+int shard_parse(const char *text, ShardSpec *spec);
+
+// 分片对应的行、列区间 (会按语料库大小截断)
+void shard_bounds(const ShardSpec *spec, uint64_t count,
+                  size_t *row_begin, size_t *row_end, size_t *col_begin, size_t *col_end);
+
+// 计算一个分片并把结果写成部分结果文件 (文件里记录是否加权，合并时不允许混用)
+int shard_run(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf, const ShardSpec *spec,
+              double threshold, const char *out_path);
+
+// 合并部分结果的回调，按 (a, b) 升序逐条调用
+typedef void (*PairSink)(const PairResult *pair, void *ctx);
+
+// 校验所有部分结果来自同一个语料库、阈值和加权方式一致、分片不重叠且正好覆盖整个上三角，
+// 然后做 k 路归并。成功返回 0，失败返回 -1
+int shard_merge(const Corpus *corpus, const char *const *part_paths, size_t part_count,
+                PairSink sink, void *ctx);
+
+#endif
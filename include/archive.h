@@ -0,0 +1,143 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "corpus.h"
+#include "minhash.h"
+#include "threadpool.h"
+#include "tfidf.h"
+
+// 分段归档 (LSM 风格)
+// 历年作业越攒越多，每学期重建一个大语料库太浪费。归档是一个目录：每批新文件写成一个
+// 只读的段 (就是普通的语料库文件)，MANIFEST 记录当前有哪些段和哪些删除标记 (tombstone)。
+//   - 追加：只处理新的一批文件，写一个新段、改一下 MANIFEST；已有同名文件时给旧的那一份记删除标记
+//   - 删除：只在 MANIFEST 里记一条删除标记，不改动任何段
+//   - 查询：各段已经映射进内存，所有段的文件拉平成一个下标区间并行打分
+//   - 压缩：把相邻的小段合并成大段，顺带真正丢掉被删除的文件。合并时不持有 MANIFEST 锁，
+//     可以在后台跑，期间照常追加、删除和查询；只有最后替换 MANIFEST 的一瞬间需要加锁。
+//     追加提交之后，新段让策略能一次合并够 ARCHIVE_COMPACT_TRIGGER 段时自动压缩一次
+//
+// TF-IDF 的文档频率也随之增量维护：每段在 MANIFEST 里记一张自己还活着的文件的文档频率，
+// 追加时加上新段的表，删除时从所在段的表里减掉被删的文件，合并时把几段的表相加。
+// 打分用的权重由一张冻结的文档频率算出，每段写出时按冻结的权重存好加权模长；
+// 只有增删让 idf 偏离冻结值超过 ARCHIVE_REWEIGHT_TOLERANCE 时才重新冻结，
+// 之后查询时旧段的模长在内存里现算，下次压缩重写这些段时再存盘。
+//
+// MANIFEST 是文本文件，每次整个写到临时文件再 rename，读者总能看到完整的一版：
+//   CSIMARCH 2
+//   next <下一个编号>
+//   weights <文件数> <df 1> ... <df 35>    (冻结的文档频率)
+//   segment <序号> <文件数> <段文件名>      (按序号升序，越往后越新)
+//   df <文件数> <df 1> ... <df 35>         (紧跟在 segment 行后：这一段里没被删除的文件的文档频率)
+//   tombstone <序号> <路径>                 (序号不超过 <序号> 的段里这个路径作废；路径里的 \ 换行 回车转义)
+
+#define ARCHIVE_MAGIC           "CSIMARCH"
+#define ARCHIVE_FORMAT_VERSION  2
+#define ARCHIVE_MANIFEST        "MANIFEST"
+
+// 压缩策略：从最新的段往前合并，前一个段不超过已合并部分的 ARCHIVE_SIZE_RATIO 倍就并进来，
+// 段的大小因此大致按倍数递增，段数是文件数的对数级
+#define ARCHIVE_SIZE_RATIO      4
+
+// 追加之后按同样的策略检查，最新的段里凑够这么多段可以合并时自动压缩一次
+#define ARCHIVE_COMPACT_TRIGGER 4
+
+// idf 相对冻结值的变化超过这个比例才重新冻结权重
+#define ARCHIVE_REWEIGHT_TOLERANCE  0.05
+
+typedef struct {
+    uint32_t seq;               // 序号：新段比旧段大，合并出的段沿用被合并各段里最大的序号
+    uint64_t count;             // 段里的文件数 (含已被删除标记作废的)
+    char *file;                 // 段文件名 (相对归档目录)
+    DfTable df;                 // 段里没被删除的文件的文档频率
+} ArchiveSegmentInfo;
+
+typedef struct {
+    uint32_t seq;
+    char *path;
+} ArchiveTombstone;
+
+typedef struct {
+    uint32_t next;              // 下一个新段的编号
+    DfTable frozen;             // 冻结的文档频率，TF-IDF 权重由它算出
+    ArchiveSegmentInfo *segments;
+    size_t segment_count;
+    ArchiveTombstone *tombstones;
+    size_t tombstone_count;
+} ArchiveManifest;
+
+// 打开后的归档。所有段的文件按段的先后拉平编号：第 s 段的第 i 个文件是全局第 first[s] + i 个
+typedef struct {
+    ArchiveManifest manifest;
+    Corpus *segments;
+    unsigned char **dead;       // 每段一项，dead[s][i] = 1 表示被删除；没有被删的文件时为 NULL
+    uint64_t *first;            // segment_count + 1 项，first[segment_count] 是总文件数
+    uint64_t live;              // 没被删除的文件数
+
+    // archive_load_tfidf 之后有效
+    TfIdfWeights weights;       // 由 manifest.frozen 算出
+    const double **tfidf_norms; // 每段一项：段里存的加权模长，或者 owned_norms 里现算的
+    double **owned_norms;
+    size_t stale_segments;      // 模长不是按当前冻结权重存的段数
+} Archive;
+
+// 把一批文件写成新段追加到归档 (目录不存在时创建)。归档里已有同名的文件时，旧的那一份记删除标记，
+// 新段里的这一份生效。*seq 返回新段的序号，失败返回 -1
+int archive_add(ThreadPool *pool, const char *dir, const CorpusInput *input, uint32_t *seq);
+
+// 给 count 个路径记删除标记，对当前所有段生效，同时从各段的文档频率里减掉这些文件。失败返回 -1
+int archive_delete(ThreadPool *pool, const char *dir, const char *const *paths, size_t count);
+
+// 读 MANIFEST、映射所有段、标出被删除的文件。失败返回 -1 (错误信息已打印)
+int archive_open(ThreadPool *pool, const char *dir, Archive *archive);
+void archive_close(Archive *archive);
+
+// 所有段的文档频率之和，即当前没被删除的文件的文档频率
+void archive_document_frequency(const ArchiveManifest *manifest, DfTable *df);
+
+// 准备 TF-IDF 打分：权重取自冻结的文档频率，各段存的模长与之对应就直接用，否则并行现算。内存不足返回 -1
+int archive_load_tfidf(ThreadPool *pool, Archive *archive);
+
+// 全局下标所在的段 (二分查找)
+size_t archive_segment_of(const Archive *archive, uint64_t index);
+
+static inline int archive_is_dead(const Archive *archive, size_t segment, uint64_t local) {
+    return archive->dead[segment] && archive->dead[segment][local];
+}
+
+// 查询结果：全局下标 + 得分，得分相同按下标排
+typedef struct {
+    uint64_t index;
+    double score;
+} ArchiveMatch;
+
+// 余弦打分，各线程各留前 top_k 名最后合并。best 至少 top_k 项，*kept 返回实际个数；内存不足返回 -1。
+// weighted 为 1 时按 TF-IDF 加权 (须先调用 archive_load_tfidf)
+int archive_query_cosine(ThreadPool *pool, const Archive *archive, const int vector[], int weighted,
+                         size_t top_k, ArchiveMatch *best, size_t *kept);
+
+// 查询向量与全局第 index 个文件的余弦得分，weighted 同上
+double archive_score(const Archive *archive, const int vector[], int weighted, uint64_t index);
+
+// MinHash：各段并行查 LSH 桶，只对候选估计 Jaccard。*candidates 返回候选总数；
+// 有段没有 MinHash 索引时返回 -1
+int archive_query_minhash(ThreadPool *pool, const Archive *archive, const MinHashSignature *sig,
+                          size_t top_k, ArchiveMatch *best, size_t *kept, size_t *candidates);
+
+// 压缩结果统计
+typedef struct {
+    size_t merged_segments;     // 被合并的段数，0 表示无需压缩
+    uint64_t kept;              // 合并后留下的文件数
+    uint64_t dropped;           // 因删除标记丢掉的文件数
+} ArchiveCompaction;
+
+// 按上面的策略合并一次；full 为 1 时把所有段合成一个并清掉所有用过的删除标记。
+// 同一归档同时只能有一个压缩在跑，另一个会直接返回 -1
+int archive_compact(ThreadPool *pool, const char *dir, int full, ArchiveCompaction *stats);
+
+// 追加之后调用：按上面的策略能一次合并至少 ARCHIVE_COMPACT_TRIGGER 段时才压缩，
+// 另一个压缩正在跑时直接跳过 (stats->merged_segments 为 0)
+int archive_compact_auto(ThreadPool *pool, const char *dir, ArchiveCompaction *stats);
+
+#endif
@@ -3,6 +3,19 @@
 
 #include <math.h>
 
+// 双文件模式给出结论的分档：得分不低于这几个阈值分别判为 [极高] / [高] / [中]，其余为 [低]。
+// 基准程序 (bench/bench.c) 按同样的阈值统计精确率和召回率，改这里两边一起变
+#define SIMILARITY_THRESHOLD_VERY_HIGH 0.9
+#define SIMILARITY_THRESHOLD_HIGH      0.75
+#define SIMILARITY_THRESHOLD_MEDIUM    0.5
+
 double calculate_cosine_similarity(const int* vecA, const int* vecB, int size);
 
-#endif
\ No newline at end of file
+// 计算向量的模长 ||A||，供语料库预先保存
+double calculate_vector_norm(const int* vec, int size);
+
+// 使用预先算好的模长计算余弦相似度，结果与 calculate_cosine_similarity 完全一致
+double calculate_cosine_similarity_normed(const int* vecA, double normA,
+                                          const int* vecB, double normB, int size);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef CODESIM_H
+#define CODESIM_H
+
+// libcodesim：可嵌入的代码相似度库
+// 把预处理、分词、向量化、打分封装成一组可重入的函数，Python/Go 等服务可以在进程内直接调用，
+// 不用每次比较都 fork/exec 一个 sim 进程。
+//
+// 约定：
+//   * 所有函数都返回 CODESIM_OK 或一个负的错误码，不向 stdout/stderr 打印任何内容；
+//   * 上下文 (CodeSimContext) 创建之后只读，同一个上下文可以被多个线程同时使用；
+//   * 库内部的内存都通过配置里的分配器申请。
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(CODESIM_BUILD_SHARED)
+#define CODESIM_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define CODESIM_API __attribute__((visibility("default")))
+#else
+#define CODESIM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CODESIM_DIMENSION 35   // 与 VECTOR_DIMENSION 一致
+
+// 错误码
+typedef enum {
+    CODESIM_OK              =  0,
+    CODESIM_ERR_INVALID_ARG = -1,   // 参数为 NULL 或取值不合法
+    CODESIM_ERR_NO_MEMORY   = -2,   // 分配器返回了 NULL
+    CODESIM_ERR_EMPTY_INPUT = -3,   // 输入为空 (与命令行工具拒绝空文件的行为一致)
+    CODESIM_ERR_VERSION     = -4    // 配置结构体版本不认识
+} CodeSimStatus;
+
+// 自定义分配器；不设置时使用 malloc/free
+typedef struct {
+    void *(*alloc)(size_t size, void *user);
+    void (*release)(void *ptr, void *user);
+    void *user;
+} CodeSimAllocator;
+
+#define CODESIM_CONFIG_VERSION 1
+
+typedef struct {
+    int version;                        // 固定填 CODESIM_CONFIG_VERSION
+    CodeSimAllocator allocator;         // 可选
+    // 可选：每一维特征的权重 (CODESIM_DIMENSION 个)，打分时按加权余弦计算；
+    // 为 NULL 时所有维度权重为 1，结果与命令行工具完全相同。创建时会复制一份
+    const double *feature_weights;
+} CodeSimConfig;
+
+// 一个文件的特征：原始计数 + 预先算好的 (加权) 模长
+typedef struct {
+    int counts[CODESIM_DIMENSION];
+    double norm;
+} CodeSimVector;
+
+typedef struct CodeSimContext CodeSimContext;
+
+// 用默认值填充配置
+CODESIM_API void codesim_config_init(CodeSimConfig *config);
+
+// config 为 NULL 时使用默认配置
+CODESIM_API int codesim_context_create(const CodeSimConfig *config, CodeSimContext **out);
+CODESIM_API void codesim_context_destroy(CodeSimContext *ctx);
+
+// 对内存里的一段源代码做预处理 + 向量化。source 不需要以 '\0' 结尾
+CODESIM_API int codesim_vectorize_buffer(const CodeSimContext *ctx, const char *source, size_t length,
+                                         CodeSimVector *out);
+
+// 两个向量的相似度 (0.0 ~ 1.0)
+CODESIM_API int codesim_score_pair(const CodeSimContext *ctx, const CodeSimVector *a,
+                                   const CodeSimVector *b, double *score);
+
+// 一对多：scores[i] = query 与 candidates[i] 的相似度
+CODESIM_API int codesim_score_batch(const CodeSimContext *ctx, const CodeSimVector *query,
+                                    const CodeSimVector *candidates, size_t count, double *scores);
+
+// 错误码对应的说明文字 (静态字符串)
+CODESIM_API const char *codesim_strerror(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+// 各个命令行子命令的实现，main 根据第一个参数分派到这里
+// argc/argv 已经去掉了程序名和子命令本身；返回值就是进程退出码
+
+// --build-corpus <输出文件> <源文件...>   (源文件写成 "-" 表示从标准输入逐行读取路径)
+//   --tokens 同时保存每个文件的 token 流缓存
+int cmd_build_corpus(int argc, char *argv[]);
+
+// --rescore-corpus <旧语料库文件> <新语料库文件>   特征表改动后，从 token 流缓存重算向量 (和签名)，不读源文件
+int cmd_rescore_corpus(int argc, char *argv[]);
+
+// --query <语料库文件> <源文件> [前 k 名]
+//   --gst 对前 k 名再做贪心串覆盖，输出成段相同的 token 占比；--locate 同时列出每段匹配的行号范围
+int cmd_query(int argc, char *argv[]);
+
+// --all-pairs <语料库文件> [阈值]   语料库内部两两比较，输出得分不低于阈值的文件对
+//   --format text|csv|jsonl|binary 指定输出格式，--output 写到文件，
+//   --stream 让各线程边算边写 (不排序，省内存)，
+//   --memory MB 限定常驻内存：向量分块读入、结果溢写到临时文件后归并，输出与默认方式相同，
+//   --dedup 先把特征向量相同的文件归成一类，只比较各类代表再展开，输出同样不变，
+//   --locate 给每条结果附上贪心串覆盖找到的匹配片段行号 (不支持 binary)
+int cmd_all_pairs(int argc, char *argv[]);
+
+// --shard-plan <语料库文件> <块大小>   列出所有分片描述 (行块:列块:块大小)，每行一个
+int cmd_shard_plan(int argc, char *argv[]);
+
+// --run-shard <语料库文件> <分片描述> <部分结果文件> [阈值]   只计算一个分片，结果写到文件
+int cmd_run_shard(int argc, char *argv[]);
+
+// --merge-shards <语料库文件> <部分结果文件...>   校验并合并所有分片，输出与 --all-pairs 完全相同
+//   同样支持 --format / --output，另可用 --min-score 提高阈值
+int cmd_merge_shards(int argc, char *argv[]);
+
+// --pairs [文件对列表|-]   逐行读 "文件A 文件B" (有制表符时按制表符分开)，默认从标准输入读。
+//   同一个文件无论出现在多少对里都只预处理、向量化一次，按输入顺序输出每一对的得分；
+//   支持 --format text|csv|jsonl、--output，--min-score 只输出不低于阈值的对
+int cmd_pairs(int argc, char *argv[]);
+
+// 分段归档 (见 archive.h)：
+// --archive-add <归档目录> <源文件...>   把这批文件写成一个新段，目录不存在时创建；同样支持 --minhash / --tokens，
+//                                      之后按压缩策略自动合并 (--no-compact 关掉)
+int cmd_archive_add(int argc, char *argv[]);
+// --archive-delete <归档目录> <路径...>   记删除标记、从各段的文档频率里减掉这些文件，不改动段文件
+int cmd_archive_delete(int argc, char *argv[]);
+// --archive-query <归档目录> <源文件> [前 k 名]   各段并行打分，--minhash 走各段的 LSH 索引，--tfidf 按冻结的权重加权
+int cmd_archive_query(int argc, char *argv[]);
+// --archive-compact <归档目录>   合并相邻的小段、丢掉已删除的文件，可以和其他命令同时跑；--full 合成一个段
+int cmd_archive_compact(int argc, char *argv[]);
+// --archive-info <归档目录>   列出各段和删除标记
+int cmd_archive_info(int argc, char *argv[]);
+
+// 以上命令都可以追加 --threads N 指定线程数，默认使用全部 CPU 核。
+// --build-corpus / --rescore-corpus 加 --tfidf 会保存 TF-IDF 模型；--query / --all-pairs / --run-shard
+// 加 --tfidf 按 TF-IDF 加权打分 (语料库里没有模型时现算)
+
+#endif
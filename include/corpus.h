@@ -0,0 +1,139 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "minhash.h"
+
+// 语料库二进制文件 (corpus file)
+// 把一批源文件的特征向量一次性算好存盘，之后直接 mmap 进来就能查询，
+// 不用每次启动都重新预处理、分词。多个进程映射同一个文件时共享物理页。
+//
+// 文件布局 (所有整数均为本机字节序)：
+//   [CorpusHeader][CorpusSection * section_count][...各个段...]
+// 每个段的起始位置按 CORPUS_ALIGNMENT 对齐，方便向量块直接按数组访问。
+
+#define CORPUS_MAGIC           "CSIMCORP"
+#define CORPUS_FORMAT_VERSION  1
+#define CORPUS_ALIGNMENT       64
+
+// 段编号：以后新增的段只要编号不冲突，旧程序会直接忽略它
+enum {
+    CORPUS_SECTION_VECTORS    = 1,  // int32[count * dimension] 特征向量块
+    CORPUS_SECTION_NORMS      = 2,  // double[count] 预先算好的模长
+    CORPUS_SECTION_PATH_INDEX = 3,  // uint64[count + 1] 路径在字符串表里的偏移
+    CORPUS_SECTION_PATH_DATA  = 4,  // 以 '\0' 结尾的路径字符串表
+    CORPUS_SECTION_MINHASH    = 5,  // 可选：CorpusMinHashHeader + MinHashSignature[count]
+    CORPUS_SECTION_LSH_KEYS   = 6,  // 可选：uint64[bands * count]，每段内按桶键升序
+    CORPUS_SECTION_LSH_IDS    = 7,  // 可选：uint32[bands * count]，与桶键一一对应的文件下标
+    CORPUS_SECTION_TOKEN_INDEX = 8, // 可选：CorpusTokenHeader + uint64[count + 1] token 流偏移
+    CORPUS_SECTION_TOKEN_DATA  = 9, // 可选：所有文件的 token 流 (见 tokenstream.h) 首尾相接
+    CORPUS_SECTION_TFIDF_DF    = 10, // 可选：uint64[1 + dimension] 建库时的文件数和文档频率
+    CORPUS_SECTION_TFIDF_NORMS = 11, // 可选：double[count] 按上面的文档频率加权后的模长
+    CORPUS_SECTION_CONTENT_HASH = 12 // 可选：uint64[count] 预处理结果的哈希，用于找出完全相同的文件
+};
+
+typedef struct {
+    char     magic[8];          // "CSIMCORP"
+    uint32_t format_version;    // CORPUS_FORMAT_VERSION
+    uint32_t feature_version;   // feature_table_version() 的值
+    uint32_t dimension;         // 向量维度
+    uint32_t section_count;     // 段目录的项数
+    uint64_t entry_count;       // 文件(向量)个数
+    uint64_t file_size;         // 整个文件的字节数，用来发现被截断的文件
+} CorpusHeader;
+
+// MinHash 段开头记录签名参数，参数对不上时这一段会被忽略
+typedef struct {
+    uint32_t version;           // MINHASH_VERSION
+    uint32_t k;                 // MINHASH_K
+    uint32_t bands;             // MINHASH_BANDS
+    uint32_t shingle;           // MINHASH_SHINGLE
+} CorpusMinHashHeader;
+
+// token 流缓存记录编号方案的版本，对不上时缓存作废
+typedef struct {
+    uint32_t version;           // TOKEN_ID_VERSION
+    uint32_t id_count;          // TOKEN_ID_COUNT
+} CorpusTokenHeader;
+
+typedef struct {
+    uint32_t id;                // CORPUS_SECTION_*
+    uint32_t reserved;
+    uint64_t offset;            // 从文件开头算起的偏移
+    uint64_t size;              // 字节数
+} CorpusSection;
+
+// 打开后的语料库，所有指针都直接指向映射的内存，不要手动释放
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    int mapped;                 // 1 = mmap 映射，0 = 整个读进了 malloc 的缓冲区
+
+    uint64_t count;
+    uint32_t dimension;
+    const int *vectors;
+    const double *norms;
+    const uint64_t *path_offsets;
+    const char *path_data;
+
+    // 以下是可选段，文件里没有时为 NULL
+    const MinHashSignature *signatures;
+    const uint64_t *lsh_keys;
+    const uint32_t *lsh_ids;
+    const uint64_t *token_offsets;         // 第 i 个文件的 token 流是 [token_offsets[i], token_offsets[i+1])
+    const unsigned char *token_data;
+    const uint64_t *df_table;              // 见 tfidf.h 的 DfTable
+    const double *tfidf_norms;
+    const uint64_t *content_hashes;
+
+    int stale;                  // 1 = 特征表已经变了，向量不能直接用 (只有 CORPUS_OPEN_STALE 才会打开这种文件)
+} Corpus;
+
+// 写语料库需要的数据
+typedef struct {
+    const char *const *paths;
+    const int *vectors;                    // count 个向量，每个 dimension 维，连续存放
+    size_t count;
+    int dimension;
+    const MinHashSignature *signatures;    // 可选：有的话同时写入签名和 LSH 索引
+    const uint64_t *token_offsets;         // 可选：count + 1 个偏移，与 token_data 一起写入 token 流缓存
+    const unsigned char *token_data;
+    const uint64_t *df_table;              // 可选：1 + dimension 个值，与 tfidf_norms 一起写入 TF-IDF 模型
+    const double *tfidf_norms;
+    const uint64_t *content_hashes;        // 可选：count 个预处理结果的哈希
+} CorpusInput;
+
+// 写成语料库文件；成功返回 0，失败返回 -1
+int corpus_write(const char *out_path, const CorpusInput *input);
+
+// 映射语料库文件并校验头部；成功返回 0，失败返回 -1
+int corpus_open(const char *path, Corpus *corpus);
+
+// 打开选项
+#define CORPUS_OPEN_STALE 1   // 特征表变了也照样打开 (置 corpus->stale)，用于从 token 流缓存重新计算
+
+int corpus_open_flags(const char *path, Corpus *corpus, unsigned int flags);
+void corpus_close(Corpus *corpus);
+
+// 把映射里 [data, data + bytes) 这段的物理页还给系统 (data 为 NULL 表示整个文件)，之后访问会重新从页缓存读入。
+// 只读映射丢掉页面不影响内容，用于按内存预算分块扫描时控制常驻内存；没有 mmap 的平台上什么也不做
+void corpus_release(const Corpus *corpus, const void *data, size_t bytes);
+
+// 查找某个段，找不到返回 NULL
+const void *corpus_find_section(const Corpus *corpus, uint32_t id, uint64_t *size);
+
+static inline const int *corpus_vector(const Corpus *corpus, size_t i) {
+    return corpus->vectors + i * corpus->dimension;
+}
+
+static inline const char *corpus_path(const Corpus *corpus, size_t i) {
+    return corpus->path_data + corpus->path_offsets[i];
+}
+
+// 用 LSH 桶找出至少有一段签名与 sig 相同的文件，每段只需一次二分查找。
+// *ids 返回升序、去重的文件下标 (调用者 free)。没有 LSH 索引时返回 -1
+int corpus_lsh_candidates(const Corpus *corpus, const MinHashSignature *sig,
+                          uint32_t **ids, size_t *count);
+
+#endif
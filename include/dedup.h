@@ -0,0 +1,32 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "allpairs.h"
+#include "corpus.h"
+#include "threadpool.h"
+#include "tfidf.h"
+
+// 重复文件折叠
+// 作业里常有大量文件在去掉注释、空白、大小写之后完全相同 (预处理结果的哈希相同)，
+// 更多的文件虽然文字不同，特征向量却一模一样。得分只由向量决定，所以向量相同的文件
+// 和任何其他文件的得分都相同：把它们归成一类，每类只拿一个代表参与两两比较，最后再展开。
+// N 个文件折成 K 类，打分量从 N^2 / 2 降到 K^2 / 2，输出与不折叠时逐字节相同。
+
+typedef struct {
+    size_t class_count;
+    uint32_t *class_begin;   // 第 c 类的成员是 members[class_begin[c] .. class_begin[c + 1])，共 class_count + 1 项
+    uint32_t *members;       // 按类排列的文件下标，类内升序；每类第一个就是代表
+    size_t exact_duplicates; // 与同类里更早的某个文件预处理结果完全相同的文件数 (语料库没有内容哈希时为 0)
+} DedupClasses;
+
+// 按向量 (和内容哈希) 把语料库分类，类按代表的下标升序编号。失败返回 -1
+int dedup_build(ThreadPool *pool, const Corpus *corpus, DedupClasses *out);
+void dedup_free(DedupClasses *classes);
+
+// 只对每类的代表做两两比较，再展开成原始文件对；结果与 allpairs_score 对整个语料库的结果完全相同
+int allpairs_dedup(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                   const DedupClasses *classes, double threshold, PairList *out);
+
+#endif
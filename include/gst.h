@@ -0,0 +1,36 @@
+#ifndef GST_H
+#define GST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 贪心串覆盖 (Greedy String Tiling, JPlag 用的算法)
+// 在两个 token 编号序列里反复找最长的公共片段，找到就把它 "铺" 成一块 tile 并标记掉，
+// 标记过的 token 不能再参与匹配，直到剩下的公共片段都短于 min_match。
+// 代码块被调换顺序时每一块仍然各自成为一个 tile，这是计数向量给不出的证据。
+//
+// 用的是 Running-Karp-Rabin 版本：每轮只找长度 >= s 的匹配，窗口哈希用前缀哈希 O(1) 算出，
+// 文本一侧的窗口哈希排序后二分查找，整体接近线性，而不是朴素算法的立方复杂度。
+
+#define GST_MIN_MATCH 8   // 默认最短匹配长度 (token 数)，太短的公共片段没有证据价值
+
+// 一块 tile：a 序列从 a 开始、b 序列从 b 开始的 length 个 token 完全相同
+typedef struct {
+    uint32_t a;
+    uint32_t b;
+    uint32_t length;
+} GstTile;
+
+typedef struct {
+    GstTile *tiles;       // 按找到的顺序 (长的在前)
+    size_t count;
+    size_t covered;       // 所有 tile 的 token 总数
+    double coverage;      // 2 * covered / (len_a + len_b)，0.0 ~ 1.0
+} GstResult;
+
+// 比较两个 token 序列；min_match <= 0 时用 GST_MIN_MATCH。成功返回 0，内存不足返回 -1
+int gst_compare(const uint16_t *a, size_t len_a, const uint16_t *b, size_t len_b,
+                int min_match, GstResult *out);
+void gst_result_free(GstResult *result);
+
+#endif
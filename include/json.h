@@ -0,0 +1,16 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+
+// JSON 字符串输出，结果输出器 (jsonl 格式) 和追踪文件共用。
+// 转义引号、反斜杠和控制字符；JSON 文本必须是合法的 UTF-8，合法的多字节序列原样保留，
+// 其余字节 (例如 GBK 编码的文件名) 每个换成 �。
+
+// 长度为 length 的字符串写成 JSON 后最多占的字节数：每个输入字节最多 6 字节 (\u00XX 或 �)，加两边的引号
+#define JSON_STRING_MAX(length) (6 * (length) + 2)
+
+// 把 s 写成带引号的 JSON 字符串，返回写完之后的位置 (不补 '\0')。p 至少要有 JSON_STRING_MAX(strlen(s)) 字节
+char *json_put_string(char *p, const char *s);
+
+#endif
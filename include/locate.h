@@ -0,0 +1,49 @@
+#ifndef LOCATE_H
+#define LOCATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gst.h"
+
+// 匹配定位：把贪心串覆盖找到的公共 token 片段映射回两份源文件的行号范围
+// 预处理时记下每个输出字符来自原文件的哪个字节 (preprocess_source_mapped)，
+// 分词时记下每个 token 的起止位置，两者相乘就是 token 在原文件里的字节范围；
+// 再用每个文件建一次的行首偏移表做二分查找，字节偏移 → 行号只要 O(log n)。
+
+// 行首偏移表：starts[i] 是第 i + 1 行第一个字节的偏移
+typedef struct {
+    uint32_t *starts;
+    size_t count;
+} LineIndex;
+
+// 扫描一遍源代码建表，失败返回 -1
+int line_index_build(const char *source, size_t length, LineIndex *index);
+// 字节偏移所在的行号 (从 1 开始)
+size_t line_index_lookup(const LineIndex *index, uint32_t offset);
+void line_index_free(LineIndex *index);
+
+// 一个源文件的 token 序列，以及每个 token 在原文件里的字节范围 [begin, end)
+typedef struct {
+    uint16_t *ids;        // 规范化编号，与 token_stream_collect 的结果相同
+    uint32_t *begin;
+    uint32_t *end;
+    size_t count;
+    LineIndex lines;
+} LocatedTokens;
+
+// 读取并预处理文件，同时记录位置。失败返回 -1 (错误信息已打印)
+int located_tokens_load(const char *path, LocatedTokens *out);
+void located_tokens_free(LocatedTokens *tokens);
+
+// 一段匹配：A 的 [a_first, a_last] 行与 B 的 [b_first, b_last] 行相同 (行号从 1 开始)
+typedef struct {
+    size_t a_first, a_last;
+    size_t b_first, b_last;
+    size_t tokens;        // 这段匹配含的 token 数
+} MatchRegion;
+
+// 把 gst 的每块 tile 换算成行号范围，按 A 的行号排序。*regions 由调用者 free，内存不足返回 -1
+int locate_matches(const LocatedTokens *a, const LocatedTokens *b, const GstResult *gst,
+                   MatchRegion **regions, size_t *count);
+
+#endif
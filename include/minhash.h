@@ -0,0 +1,39 @@
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MinHash 签名 + LSH 分段
+// 把预处理后的代码切成 token shingle (连续 MINHASH_SHINGLE 个 token 的规范化编号)，
+// 对每个排列记录所有 shingle 的最小哈希值。两个签名相同位置相等的比例，
+// 就是两份代码 shingle 集合 Jaccard 相似度的无偏估计。
+// 比 35 维计数向量细得多：它看的是 token 的先后顺序，而不只是出现次数。
+
+#define MINHASH_K          128   // 签名长度 (排列个数)
+#define MINHASH_SHINGLE    5     // 每个 shingle 含的 token 数
+#define MINHASH_BANDS      16    // LSH 分段数
+#define MINHASH_ROWS       (MINHASH_K / MINHASH_BANDS)   // 每段 8 个值
+#define MINHASH_VERSION    1     // 哈希函数或上面任一参数改动时加一
+
+// 签名只保存每个最小值的低 16 位 (b-bit MinHash)，一个文件 256 字节。
+// 偶然相等的概率只有 1/65536，对估计值的影响可以忽略
+typedef struct {
+    uint16_t v[MINHASH_K];
+} MinHashSignature;
+
+// 由预处理后的代码计算签名
+void minhash_compute(const char *code, MinHashSignature *sig);
+
+// 由规范化 token 编号序列计算签名 (token 流缓存用)，与对原始代码调用 minhash_compute 结果相同
+void minhash_compute_ids(const uint16_t *ids, size_t count, MinHashSignature *sig);
+
+// 估计 Jaccard 相似度 (0.0 ~ 1.0)；任意一方没有 token 时返回 0.0
+double minhash_jaccard(const MinHashSignature *a, const MinHashSignature *b);
+
+// 把第 band 段的 MINHASH_ROWS 个值哈希成 64 位桶键。
+// 两份代码只要有一段完全相同就会落进同一个桶，成为候选对；
+// 16 段 x 8 行时，Jaccard 约 0.7 以上的文件对大概率至少撞上一段
+uint64_t minhash_band_key(const MinHashSignature *sig, int band);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "threadpool.h"
+#include "minhash.h"
+#include "tokenstream.h"
+
+// 处理流水线：把 "读文件 -> 预处理 -> 分词 -> 向量化" 串起来，
+// 批量处理时交给线程池并行执行
+
+// 默认同时在读的文件数
+#define PIPELINE_DEFAULT_IN_FLIGHT 32
+
+// 批量处理的输出，第 i 个文件的结果写在各数组的第 i 项
+typedef struct {
+    int *vectors;                   // count * VECTOR_DIMENSION
+    int *ok;                        // 1 = 成功，0 = 失败(打不开、空文件等)
+    MinHashSignature *signatures;   // 可选：不为 NULL 时同时计算 MinHash 签名
+    TokenStream *tokens;            // 可选：不为 NULL 时同时输出 token 流缓存 (data 由调用者 free)
+    uint64_t *content_hashes;       // 可选：不为 NULL 时同时输出预处理结果的哈希
+} PipelineOutput;
+
+// 处理单个文件，vector 长度必须是 VECTOR_DIMENSION，sig 可以为 NULL；失败返回 -1。
+// 大文件的预处理和分词用 pool 分块并行 (pool 可以为 NULL)
+int pipeline_vectorize_file(ThreadPool *pool, const char *path, int vector[], MinHashSignature *sig);
+
+// 并行处理 count 个文件，每个文件一个任务，大文件在任务里再分块并行。读文件交给后台预读 (见 prefetch.h)，
+// in_flight 是同时在读的文件数，<= 0 时用默认值
+void pipeline_vectorize_files(ThreadPool *pool, const char *const *paths, size_t count,
+                              int in_flight, PipelineOutput *out);
+
+#endif
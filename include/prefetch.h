@@ -0,0 +1,36 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+
+// 异步预读 (prefetch)
+// 后台 I/O 负责把文件读进内存，同时保持若干个文件处于"正在读"的状态，
+// 读好的缓冲区放进一个有界队列，分词线程从队列里取。
+// 这样网络存储的延迟被藏在分词计算后面，CPU 不用干等 fread。
+//
+// Linux 上优先使用 io_uring (一个 I/O 线程同时挂着 in_flight 个读请求)，
+// io_uring 不可用时退回到 in_flight 个普通 I/O 线程各自阻塞读取。
+
+typedef struct Prefetcher Prefetcher;
+
+typedef struct {
+    size_t index;   // 文件在输入数组里的下标
+    char *data;     // 文件内容，以 '\0' 结尾；失败时为 NULL。由取走的人负责 free
+    size_t size;    // 不含 '\0' 的字节数
+} PrefetchItem;
+
+// 按 order 给出的顺序(可以为 NULL，表示 0..count-1)开始预读 count 个文件；
+// in_flight 同时也是队列容量，限制了同时占用的缓冲区数量
+Prefetcher *prefetch_start(const char *const *paths, const size_t *order, size_t count,
+                           int in_flight);
+
+// 取出下一个读完的文件(完成顺序，不一定是提交顺序)；全部取完后返回 0
+int prefetch_next(Prefetcher *prefetcher, PrefetchItem *item);
+
+// 停止并释放；还没被取走的缓冲区会被一并释放
+void prefetch_stop(Prefetcher *prefetcher);
+
+// 返回实际使用的后端名字 ("io_uring" 或 "threads")，用于诊断输出
+const char *prefetch_backend(const Prefetcher *prefetcher);
+
+#endif
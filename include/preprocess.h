@@ -5,7 +5,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include "threadpool.h"
 
 char* preprocess_file(const char* filepath);
 
+// 把整个文件读进内存并补上 '\0'，length 返回字节数(可以传 NULL)
+char* read_source_file(const char* filepath, size_t* length);
+
+// 对已经在内存里的源代码做同样的预处理，source 必须以 '\0' 结尾，
+// length 是不含 '\0' 的长度；调用者负责 free 返回值
+char* preprocess_source(const char* source, size_t length);
+
+// 核心转换：把结果写进调用者准备的 result (至少 length + 1 字节)，返回结果长度。
+// source 同样必须以 '\0' 结尾 (length 是 '\0' 的位置)，注释和字符串内部用向量指令按块扫描。
+// 不分配内存、不打印任何信息，可以在任意线程里并发调用
+size_t preprocess_source_into(const char* source, size_t length, char* result);
+
+// 同上，另外在 offsets[j] 里记下 result[j] 来自原文件的第几个字节 (offsets 至少 length 个元素，可以为 NULL)，
+// 用于把匹配到的 token 映射回原文件的行号；只支持 4 GB 以内的文件
+size_t preprocess_source_mapped(const char* source, size_t length, char* result, uint32_t* offsets);
+
+// 大文件分块并行预处理：不小于 PREPROCESS_PARALLEL_MIN 字节的源代码切成约 PREPROCESS_CHUNK_SIZE 的块，
+// 先推算每块开头处于注释、字符串还是普通代码，再各块并行处理，结果与 preprocess_source_into 逐字节相同。
+// pool 为 NULL、只有一个线程或文件较小时直接串行处理。可以在线程池的任务里调用 (嵌套并行)
+#define PREPROCESS_PARALLEL_MIN  (8u << 20)
+#define PREPROCESS_CHUNK_SIZE    (2u << 20)
+size_t preprocess_source_parallel(ThreadPool* pool, const char* source, size_t length, char* result);
+
 #endif
\ No newline at end of file
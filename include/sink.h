@@ -0,0 +1,55 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "corpus.h"
+#include "threadpool.h"
+
+// 结果输出器 (result sink)
+// 两两比较的结果可能有上亿条，逐条 printf 比算分本身还慢。输出器给每个工作线程一块缓冲区，
+// 线程只往自己的缓冲区里格式化，攒满一块才加锁整块写出去，所以打分线程之间几乎没有争用。
+// 低于阈值的结果在进缓冲区之前就被丢掉。
+//
+// 支持的格式：
+//   text   每行 "得分\t文件A\t文件B"，与 --all-pairs 一直以来的输出相同
+//   csv    带表头 file_a,file_b,score，路径里有逗号、引号时按 RFC 4180 加引号
+//   jsonl  每行一个 {"a":...,"b":...,"score":...} 对象
+//   binary 每条 12 字节：uint32 下标 A、uint32 下标 B、float 得分 (本机字节序，无文件头)，
+//          下标就是语料库里的文件编号
+
+typedef enum {
+    SINK_FORMAT_TEXT,
+    SINK_FORMAT_CSV,
+    SINK_FORMAT_JSONL,
+    SINK_FORMAT_BINARY
+} SinkFormat;
+
+#define SINK_BUFFER_SIZE (64 * 1024)   // 每个线程的缓冲区大小
+
+typedef struct ResultSink ResultSink;
+
+// 解析 "text" / "csv" / "jsonl" / "binary"；不认识返回 -1
+int sink_parse_format(const char *name, SinkFormat *format);
+
+// 打开输出器。out_path 为 NULL 或 "-" 时写到标准输出；workers 是会调用 result_sink_emit 的
+// 工作线程数 (通常是 threadpool_size)，另外还会多准备一块给非工作线程用。失败返回 NULL
+ResultSink *result_sink_open(const char *out_path, SinkFormat format, const Corpus *corpus,
+                             double threshold, int workers);
+
+// 输出一条结果。worker 是 threadpool_worker_id() 的值 (-1 表示不在线程池里)；
+// 同一个 worker 编号同一时间只能有一个线程在用
+void result_sink_emit(ResultSink *sink, int worker, uint32_t a, uint32_t b, double score);
+
+// --locate：每条达到阈值的结果再做一次贪心串覆盖，在结果后面附上匹配片段的行号范围
+// (text 是结果行下面缩进的几行，csv 多一列 regions，jsonl 多一个 "regions" 数组；binary 不支持)。
+// 每个文件的 token 序列和位置第一次用到时读一次，之后所有含它的文件对都复用，一直留到关闭
+// (所以 --all-pairs 的 --locate 不能和 --memory 同用)。
+// 工作线程输出的结果当场定位；非工作线程输出的结果先攒一批，再交给 pool 并行定位，
+// 这时 pool 必须空闲。必须在输出第一条结果之前调用，内存不足返回 -1
+int result_sink_enable_locate(ResultSink *sink, ThreadPool *pool);
+
+// 写出所有缓冲区并关闭；中途有任何写入失败返回 -1
+int result_sink_close(ResultSink *sink);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TFIDF_H
+#define TFIDF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "corpus.h"
+#include "threadpool.h"
+#include "vectorization.h"
+
+// TF-IDF 加权
+// 原始计数里 ";"、"=" 这类几乎每个文件都有的 token 占了大头，会把毫不相干的两份代码的余弦得分抬高。
+// TF-IDF 给每一维乘上 idf = ln((1 + N) / (1 + df)) + 1，N 是文件数，df 是含有这种特征的文件数，
+// 到处都有的特征权重接近 1，少见的特征权重更高。
+//
+// 加权后的余弦：sum(a_i * b_i * idf_i^2) / (|a|_w * |b|_w)，其中 |a|_w = sqrt(sum(a_i^2 * idf_i^2))。
+// 计数向量本身不变，只需要额外保存 idf 表和每个文件的加权模长。
+
+// 文档频率表：可以逐个文件增减，不用每次从头统计
+typedef struct {
+    uint64_t docs;                       // 文件数 N
+    uint64_t df[VECTOR_DIMENSION];       // 每一维有多少个文件计数 > 0
+} DfTable;
+
+// 由文档频率表算出的权重
+typedef struct {
+    double idf[VECTOR_DIMENSION];
+    double idf2[VECTOR_DIMENSION];       // idf 的平方，打分时直接用
+} TfIdfWeights;
+
+// 一个语料库的 TF-IDF 模型：冻结时的文档频率、权重和每个文件的加权模长
+typedef struct {
+    DfTable df;
+    TfIdfWeights weights;
+    const double *norms;                 // count 个，指向语料库里的段或者 owned_norms
+    double *owned_norms;                 // 语料库里没有时在内存里现算，由模型负责释放
+} TfIdfModel;
+
+void df_table_init(DfTable *table);
+void df_table_add(DfTable *table, const int vector[]);
+void df_table_remove(DfTable *table, const int vector[]);
+
+// 并行统计 count 个向量的文档频率 (每个线程一张表，最后合并)
+void df_table_build(ThreadPool *pool, const int *vectors, size_t count, DfTable *table);
+
+void tfidf_weights(const DfTable *table, TfIdfWeights *weights);
+
+// 文件增删之后，当前文档频率算出的 idf 与冻结的权重相差超过 tolerance (相对误差) 时返回 1，
+// 说明需要重新加权；否则新文件直接沿用冻结的权重，已有文件的模长不用重算
+int tfidf_needs_reweight(const TfIdfWeights *frozen, const DfTable *current, double tolerance);
+
+double tfidf_norm(const TfIdfWeights *weights, const int vector[]);
+
+// 并行计算 count 个向量的加权模长
+void tfidf_norms_build(ThreadPool *pool, const TfIdfWeights *weights, const int *vectors,
+                       size_t count, double *norms);
+
+static inline double tfidf_cosine(const TfIdfWeights *weights, const int *a, double norm_a,
+                                  const int *b, double norm_b) {
+    double dot_product = 0.0;
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        dot_product += weights->idf2[i] * ((double)a[i] * b[i]);
+    }
+    double denominator = norm_a * norm_b;
+    if (denominator == 0.0) return 0.0;
+    return dot_product / denominator;
+}
+
+// 加载语料库的 TF-IDF 模型：建库时保存过就直接用，否则用一次并行扫描现算。失败返回 -1
+int tfidf_model_load(ThreadPool *pool, const Corpus *corpus, TfIdfModel *model);
+void tfidf_model_free(TfIdfModel *model);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+// 工作窃取线程池 (work-stealing thread pool)
+// 每个工作线程有自己的双端队列：自己从底部压入/弹出(后进先出，缓存友好)，
+// 自己没活干时随机挑一个别人的队列，从顶部偷最早压入的任务(通常是最大的一块)。
+// 这样即使某个文件特别大，其他线程也会把剩下的任务偷走，不会在最后干等。
+
+typedef void (*TaskFunc)(void *arg);
+
+// 区间任务：处理 [begin, end) 这一段
+typedef void (*RangeFunc)(size_t begin, size_t end, void *ctx);
+
+// 二维区间任务：处理 [row_begin, row_end) x [col_begin, col_end) 这一块
+typedef void (*TileFunc)(size_t row_begin, size_t row_end,
+                         size_t col_begin, size_t col_end, void *ctx);
+
+typedef struct ThreadPool ThreadPool;
+
+// num_threads <= 0 时自动使用 CPU 核数；失败返回 NULL
+ThreadPool *threadpool_create(int num_threads);
+void threadpool_destroy(ThreadPool *pool);
+
+int threadpool_size(const ThreadPool *pool);
+
+// 当前线程在池里的编号 (0 ~ size-1)，不是工作线程时返回 -1
+int threadpool_worker_id(void);
+
+// 提交一个任务。在工作线程里调用时压进自己的队列，否则轮流分给各个队列
+int threadpool_submit(ThreadPool *pool, TaskFunc func, void *arg);
+
+// 阻塞直到所有已提交的任务(包括任务里再提交的子任务)全部完成。只能在线程池外调用
+void threadpool_wait(ThreadPool *pool);
+
+// 并行处理 [begin, end)：区间大于 grain 时一分为二，一半留给自己，一半压队列给别人偷。
+// func 只在工作线程里执行 (threadpool_worker_id() 总在 0 ~ size-1)，下同。
+// 只等这一次调用拆出来的任务。可以在 func 里嵌套调用：等待的工作线程会顺手做队列里的任务，不会干等
+void threadpool_parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain,
+                             RangeFunc func, void *ctx);
+
+// 并行处理 [row_begin, row_end) x [col_begin, col_end) 这块矩形里 row < col 的部分，
+// 用于两两比较；块的行数和列数都不超过 tile 之前会不断沿较长的一边对半拆分
+void threadpool_parallel_tiles(ThreadPool *pool, size_t row_begin, size_t row_end,
+                               size_t col_begin, size_t col_end, size_t tile,
+                               TileFunc func, void *ctx);
+
+#endif
@@ -23,8 +23,28 @@ typedef struct {
     char value[100];//值
 }Token;
 
+//value 最多保存的字符数(不含'\0')，更长的单词/数字/字符串只保存前面这一段
+#define TOKEN_VALUE_MAX ((int)sizeof(((Token*)0)->value) - 1)
+
 // 3. 声明函数 (告诉编译器这些函数在另一个文件里)
 int is_keyword(const char *str);
 void get_next_token(const char *source, int *pos, Token *token);
 
+// 4. token 的规范化编号
+// 同一种 token 永远得到同一个编号，变量名/数字/字符串不区分具体内容，
+// 供 shingle、n-gram 等需要 "token 序列" 的算法使用
+#define TOKEN_ID_KEYWORD_BASE    0
+#define TOKEN_ID_IDENTIFIER      18
+#define TOKEN_ID_NUMBER          19
+#define TOKEN_ID_STRING          20
+#define TOKEN_ID_CHAR_BASE       32
+#define TOKEN_ID_DOUBLE_OP_BASE  288
+#define TOKEN_ID_COUNT           296   // 编号的上界 (不含)
+#define TOKEN_ID_VERSION         1     // 编号方案(包括关键字表)改动时加一，缓存的 token 流随之失效
+
+int token_canonical_id(const Token *token);
+
+// 由编号还原 token 文本 (buf 至少 3 字节)；变量名/数字/字符串返回 NULL
+const char *token_canonical_text(int id, char buf[3]);
+
 #endif
\ No newline at end of file
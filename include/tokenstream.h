@@ -0,0 +1,29 @@
+#ifndef TOKENSTREAM_H
+#define TOKENSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 规范化 token 流 (token stream) 缓存
+// 预处理 + 分词是整条流水线里最慢的部分。把每个文件的规范化 token 编号序列 (见 token_canonical_id)
+// 压缩后存进语料库，以后改了特征表或者换一种相似度算法，可以直接从缓存重新计算
+// 向量、shingle 和签名，不用再读一遍源文件。
+//
+// 编码：每个编号写成 LEB128 变长整数，小于 128 的占 1 字节，其余占 2 字节。
+// 关键字、变量名、数字这些最常见的 token 都在 1 字节范围内。
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+} TokenStream;
+
+// 对预处理后的代码分词，*ids 返回规范化编号数组 (调用者 free)。成功返回 0，内存不足返回 -1
+int token_stream_collect(const char *code, uint16_t **ids, size_t *count);
+
+// 把编号数组编码成字节流 (out->data 由调用者 free)；成功返回 0，失败返回 -1
+int token_stream_encode(const uint16_t *ids, size_t count, TokenStream *out);
+
+// 解码字节流，*ids 返回编号数组 (调用者 free)。数据损坏或内存不足返回 -1
+int token_stream_decode(const unsigned char *data, size_t size, uint16_t **ids, size_t *count);
+
+#endif
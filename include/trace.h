@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// 时间线追踪 (Chrome trace-event 格式)
+// 语料库跑得慢时，光看总时间分不清是某个巨大的文件、I/O 等待还是打分占了大头。
+// 加上 --trace 文件 后，每个线程把 "读文件 / 等 I/O / 预处理 / 向量化 / 打分块" 的起止时间
+// 记进自己的环形缓冲区 (只有自己写，不加锁)，程序退出时写成 JSON，用 Perfetto 或
+// chrome://tracing 打开就能看到每个线程的时间线。
+//
+// 没开追踪时每个埋点只有一次对 trace_enabled 的判断，分支预测总是猜中。
+
+#define TRACE_RING_EVENTS  65536   // 每个线程最多保留的事件数，写满后覆盖最早的
+#define TRACE_ARG_MAX      48      // 事件参数 (文件名、块范围) 最多保留的字节数，太长的保留末尾
+
+extern int trace_enabled;          // 只在 trace_start 里置 1，之后只读
+
+// 开启追踪，程序退出时把所有线程的事件写到 path。失败返回 -1
+int trace_start(const char *path);
+
+// 单调时钟，纳秒
+uint64_t trace_clock(void);
+
+// 记一个从 begin 到现在的事件；name 必须是字符串常量，arg 可以为 NULL
+void trace_record(const char *name, const char *arg, uint64_t begin);
+
+// 给当前线程起名，显示在时间线的左侧 (不起名时工作线程叫 "worker N"，其他线程叫 "thread N")
+void trace_thread_name(const char *name);
+
+#if defined(__GNUC__)
+#define TRACE_LIKELY_OFF(x) __builtin_expect((x), 0)
+#else
+#define TRACE_LIKELY_OFF(x) (x)
+#endif
+
+// 用法：uint64_t t = TRACE_BEGIN(); ...; TRACE_END("preprocess", path, t);
+#define TRACE_BEGIN() (TRACE_LIKELY_OFF(trace_enabled) ? trace_clock() : 0)
+#define TRACE_END(name, arg, begin) \
+    do { if (TRACE_LIKELY_OFF(trace_enabled)) trace_record((name), (arg), (begin)); } while (0)
+
+#endif
@@ -4,6 +4,11 @@
 #ifndef VECTORIZATION_H
 #define VECTORIZATION_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "tokenization.h"
+#include "threadpool.h"
+
 // 1. 宏定义搬家
 // 把维度定义在这里，这样 main.c 和 vectorization.c 都能看到同一个数字
 // 必须保持和你代码里的逻辑一致 (32个具体 + 3个抽象 = 35)
@@ -18,4 +23,27 @@ extern const char *FEATURE_MAP[VECTOR_DIMENSION];
 // 告诉外界：给我一段代码和一个数组，我帮你填满它
 void generate_vector(const char *code, int vector[]);
 
+// 4. 特征表版本号
+// 对 FEATURE_MAP 的内容做哈希，特征表一改版本号就变，
+// 语料库文件靠它判断里面的向量还能不能直接用
+unsigned int feature_table_version(void);
+
+// 5. 从 token 编号序列计算向量 (用于 token 流缓存，见 tokenstream.h)
+// 先用 build_feature_id_map 建好 "编号 -> 特征下标" 表，再逐个文件调用 generate_vector_from_ids，
+// 结果与对原始代码调用 generate_vector 完全相同。
+// build_feature_id_map 返回特征表里有几个具体特征无法由编号得到 (例如把某个函数名加进了特征表)，
+// 不为 0 时缓存的 token 流不足以重算向量
+int build_feature_id_map(int map[TOKEN_ID_COUNT]);
+void generate_vector_from_ids(const uint16_t *ids, size_t count, const int map[TOKEN_ID_COUNT],
+                              int vector[]);
+
+// 6. 大文件分块并行统计
+// 预处理后的代码里没有字符串 (连引号一起去掉了)，空格两边一定是不同的 token，
+// 所以不小于 VECTOR_PARALLEL_MIN 字节的代码在空格处切成约 VECTOR_CHUNK_SIZE 的块，
+// 各块并行统计后相加，结果与 generate_vector 完全相同。length 是 code 的长度 (不含 '\0')；
+// pool 为 NULL、只有一个线程或代码较短时直接调用 generate_vector。可以在线程池的任务里调用
+#define VECTOR_PARALLEL_MIN  (8u << 20)
+#define VECTOR_CHUNK_SIZE    (2u << 20)
+void generate_vector_parallel(ThreadPool *pool, const char *code, size_t length, int vector[]);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vectorization.h"
+
+// 滑动窗口局部相似度
+// 把一段 40 行的函数原样贴进 2000 行的大作业里，整个文件的计数向量被其余代码稀释，
+// 整体余弦分数很低。这里改成比较两个文件里长度相同的 token 窗口：
+// 特征计数的前缀和 P[i] 是前 i 个 token 的 35 维计数，窗口 [s, e) 的向量就是 P[e] - P[s]，
+// 只要 O(维数) 而不用重新分词。只有窗口的起点和终点会被查到，所以只在这些位置存一行
+// (步长的倍数、贴着末尾的最后一个起点，以及它们加上窗口长度)，不必每个 token 存一行 35 个计数。
+// 窗口按步长滑过两个文件，每个 A 窗口找最像的 B 窗口，再挑出互不重叠的最高几段。
+
+#define WINDOW_DEFAULT_TOKENS  100   // 默认窗口长度 (token 数)，大致是一个 20 行左右的函数
+#define WINDOW_STRIDE_DIVISOR  4     // 步长 = 窗口长度 / 4
+#define WINDOW_TOP_REGIONS     5     // 最多报告几段
+
+// 一个 token 序列在各个检查点上的特征前缀和：sums[k * VECTOR_DIMENSION + f] 是
+// 前 positions[k] 个 token 里特征 f 的个数，positions 升序，总包含 0 和 count
+typedef struct {
+    uint32_t *sums;
+    size_t *positions;
+    size_t rows;
+    size_t count;         // token 总数
+    size_t window;        // 建表时的窗口长度 (不是文件里实际的窗口长度，文件更短时取文件长度)
+} FeaturePrefix;
+
+// 为长度为 window 的窗口扫描建检查点 (window 为 0 时用 WINDOW_DEFAULT_TOKENS)。
+// map 由 build_feature_id_map 得到。内存不足返回 -1
+int feature_prefix_build(const uint16_t *ids, size_t count, const int map[TOKEN_ID_COUNT],
+                         size_t window, FeaturePrefix *out);
+// 窗口 [begin, end) 的特征向量，与对这段 token 调用 generate_vector_from_ids 的结果相同。
+// begin 和 end 必须是检查点，即 window_best_matches 会扫到的窗口的起点或终点
+void feature_prefix_window(const FeaturePrefix *prefix, size_t begin, size_t end, int vector[]);
+void feature_prefix_free(FeaturePrefix *prefix);
+
+// 一对相似的窗口：A 的 token [a_begin, a_end) 与 B 的 token [b_begin, b_end)
+typedef struct {
+    size_t a_begin, a_end;
+    size_t b_begin, b_end;
+    double score;
+} WindowMatch;
+
+// 用建表时的窗口长度扫描 (a、b 必须用同一个 window 建表；某个文件比窗口短时整个文件就是一个窗口)，
+// 按得分从高到低把至多 top 段互不重叠 (在 A 里) 的匹配写进 matches，*count 返回个数。
+// 内存不足返回 -1
+int window_best_matches(const FeaturePrefix *a, const FeaturePrefix *b, size_t top,
+                        WindowMatch *matches, size_t *count);
+
+#endif
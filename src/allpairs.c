@@ -0,0 +1,711 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "allpairs.h"
+#include "calculate.h"
+#include "vectorization.h"
+#include "trace.h"
+
+// ---------------- 并行打分 ----------------
+
+// 每个工作线程一个结果数组，各写各的，不需要加锁
+typedef struct {
+    PairResult *items;
+    size_t count;
+    size_t capacity;
+    int failed;            // 扩容失败过，结果不完整
+} PairBuffer;
+
+typedef struct SpillSet SpillSet;
+
+typedef struct {
+    const Corpus *corpus;
+    const TfIdfModel *tfidf;   // 不为 NULL 时按 TF-IDF 加权打分
+    double threshold;
+    PairBuffer *buffers;   // 按 threadpool_worker_id() 下标
+    ResultSink *sink;      // 不为 NULL 时结果直接交给输出器，不再收集排序
+    SpillSet *spill;       // 不为 NULL 时缓冲区容量固定，写满就排序后溢写到临时文件
+} AllPairsJob;
+
+static int spill_buffer(SpillSet *set, PairBuffer *buf);
+
+static int pair_buffer_push(PairBuffer *buf, PairResult r) {
+    if (buf->count == buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity * 2 : 1024;
+        PairResult *items = (PairResult*)realloc(buf->items, capacity * sizeof(PairResult));
+        if (!items) return -1;
+        buf->items = items;
+        buf->capacity = capacity;
+    }
+    buf->items[buf->count++] = r;
+    return 0;
+}
+
+static void score_tile(size_t row_begin, size_t row_end, size_t col_begin, size_t col_end, void *ctx) {
+    AllPairsJob *job = (AllPairsJob*)ctx;
+    const Corpus *corpus = job->corpus;
+    int worker = threadpool_worker_id();
+    PairBuffer *buf = job->buffers ? &job->buffers[worker] : NULL;
+    uint64_t t = TRACE_BEGIN();
+
+    for (size_t i = row_begin; i < row_end; i++) {
+        const int *vi = corpus_vector(corpus, i);
+        size_t j = col_begin > i + 1 ? col_begin : i + 1;   // 只算 i < j
+        for (; j < col_end; j++) {
+            double score = job->tfidf
+                ? tfidf_cosine(&job->tfidf->weights, vi, job->tfidf->norms[i],
+                               corpus_vector(corpus, j), job->tfidf->norms[j])
+                : calculate_cosine_similarity_normed(vi, corpus->norms[i],
+                                                     corpus_vector(corpus, j),
+                                                     corpus->norms[j], VECTOR_DIMENSION);
+            if (score < job->threshold) continue;
+            if (job->sink) {
+                result_sink_emit(job->sink, worker, (uint32_t)i, (uint32_t)j, score);
+                continue;
+            }
+            PairResult r = { (uint32_t)i, (uint32_t)j, score };
+            if (job->spill && buf->count == buf->capacity && spill_buffer(job->spill, buf) != 0) {
+                buf->failed = 1;
+                continue;
+            }
+            if (pair_buffer_push(buf, r) != 0) buf->failed = 1;
+        }
+    }
+    if (TRACE_LIKELY_OFF(trace_enabled)) {
+        char range[TRACE_ARG_MAX];
+        snprintf(range, sizeof(range), "%zu-%zu x %zu-%zu", row_begin, row_end, col_begin, col_end);
+        trace_record("score_tile", range, t);
+    }
+}
+
+static int compare_pair(const void *a, const void *b) {
+    const PairResult *x = (const PairResult*)a;
+    const PairResult *y = (const PairResult*)b;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    return (x->b > y->b) - (x->b < y->b);
+}
+
+int allpairs_score(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                   size_t row_begin, size_t row_end, size_t col_begin, size_t col_end,
+                   double threshold, PairList *out) {
+    out->items = NULL;
+    out->count = 0;
+    if (corpus->count > UINT32_MAX) {
+        fprintf(stderr, "错误：语料库文件过多\n");
+        return -1;
+    }
+    if (row_end > corpus->count) row_end = (size_t)corpus->count;
+    if (col_end > corpus->count) col_end = (size_t)corpus->count;
+
+    int workers = threadpool_size(pool);
+    AllPairsJob job = { corpus, tfidf, threshold, (PairBuffer*)calloc((size_t)workers, sizeof(PairBuffer)), NULL, NULL };
+    if (!job.buffers) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+
+    // 1. 按 256x256 的块并行打分，块越大拆得越细，窃取时总能分到活
+    threadpool_parallel_tiles(pool, row_begin, row_end, col_begin, col_end, 256, score_tile, &job);
+
+    // 2. 合并各线程的结果，按 (a, b) 排序保证输出与线程数无关
+    size_t total = 0;
+    int failed = 0;
+    for (int w = 0; w < workers; w++) {
+        total += job.buffers[w].count;
+        failed |= job.buffers[w].failed;
+    }
+    PairResult *all = failed ? NULL : (PairResult*)malloc((total ? total : 1) * sizeof(PairResult));
+    if (all) {
+        size_t k = 0;
+        for (int w = 0; w < workers; w++) {
+            memcpy(all + k, job.buffers[w].items, job.buffers[w].count * sizeof(PairResult));
+            k += job.buffers[w].count;
+        }
+        qsort(all, total, sizeof(PairResult), compare_pair);
+    }
+    for (int w = 0; w < workers; w++) free(job.buffers[w].items);
+    free(job.buffers);
+
+    if (!all) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    out->items = all;
+    out->count = total;
+    return 0;
+}
+
+int allpairs_stream(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                    size_t row_begin, size_t row_end, size_t col_begin, size_t col_end,
+                    double threshold, ResultSink *sink) {
+    if (corpus->count > UINT32_MAX) {
+        fprintf(stderr, "错误：语料库文件过多\n");
+        return -1;
+    }
+    if (row_end > corpus->count) row_end = (size_t)corpus->count;
+    if (col_end > corpus->count) col_end = (size_t)corpus->count;
+
+    AllPairsJob job = { corpus, tfidf, threshold, NULL, sink, NULL };
+    threadpool_parallel_tiles(pool, row_begin, row_end, col_begin, col_end, 256, score_tile, &job);
+    return 0;
+}
+
+void pair_list_free(PairList *list) {
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+}
+
+// ---------------- 内存预算模式 (out-of-core) ----------------
+
+// 已经排好序的一段结果 (run)：溢写在匿名临时文件里，或者还在某个线程的缓冲区里
+typedef struct {
+    FILE *file;                  // NULL 表示在内存里
+    const PairResult *items;
+    uint64_t count;
+} SpillRun;
+
+// 按层存放的 run：同一层攒够 SPILL_FAN_IN 个就归并成上一层的一个，
+// 打开的临时文件数最多 SPILL_FAN_IN * SPILL_LEVELS，归并总代价是 O(N log N)
+#define SPILL_FAN_IN 32
+#define SPILL_LEVELS 8
+
+struct SpillSet {
+    pthread_mutex_t lock;
+    SpillRun runs[SPILL_LEVELS][SPILL_FAN_IN];
+    size_t counts[SPILL_LEVELS];
+};
+
+// 归并时每个 run 的读取位置
+typedef struct {
+    const SpillRun *run;
+    uint64_t next;
+    PairResult current;
+} RunCursor;
+
+// 读下一条记录；读完返回 0
+static int cursor_advance(RunCursor *c) {
+    if (c->next == c->run->count) return 0;
+    if (c->run->file) {
+        if (fread(&c->current, sizeof(PairResult), 1, c->run->file) != 1) return -1;
+    } else {
+        c->current = c->run->items[c->next];
+    }
+    c->next++;
+    return 1;
+}
+
+static void cursor_sift_down(RunCursor **heap, size_t n, size_t i) {
+    for (;;) {
+        size_t smallest = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && compare_pair(&heap[l]->current, &heap[smallest]->current) < 0) smallest = l;
+        if (r < n && compare_pair(&heap[r]->current, &heap[smallest]->current) < 0) smallest = r;
+        if (smallest == i) return;
+        RunCursor *tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// k 路归并 n 个 run，按 (a, b) 升序逐条交给 sink。成功返回 0，读失败或内存不足返回 -1
+static int merge_runs(const SpillRun *runs, size_t n, PairSink sink, void *ctx) {
+    RunCursor *cursors = (RunCursor*)calloc(n ? n : 1, sizeof(RunCursor));
+    RunCursor **heap = (RunCursor**)malloc((n ? n : 1) * sizeof(RunCursor*));
+    int rc = -1;
+    if (!cursors || !heap) goto done;
+
+    size_t live = 0;
+    for (size_t k = 0; k < n; k++) {
+        cursors[k].run = &runs[k];
+        if (runs[k].file) rewind(runs[k].file);
+        int got = cursor_advance(&cursors[k]);
+        if (got < 0) goto done;
+        if (got) heap[live++] = &cursors[k];
+    }
+    for (size_t i = live / 2; i-- > 0;) cursor_sift_down(heap, live, i);
+
+    while (live > 0) {
+        RunCursor *top = heap[0];
+        sink(&top->current, ctx);
+        int got = cursor_advance(top);
+        if (got < 0) goto done;
+        if (!got) heap[0] = heap[--live];
+        cursor_sift_down(heap, live, 0);
+    }
+    rc = 0;
+
+done:
+    free(cursors);
+    free(heap);
+    return rc;
+}
+
+typedef struct {
+    FILE *file;
+    int failed;
+} RunWriter;
+
+static void write_run_pair(const PairResult *pair, void *ctx) {
+    RunWriter *w = (RunWriter*)ctx;
+    if (!w->failed && fwrite(pair, sizeof(PairResult), 1, w->file) != 1) w->failed = 1;
+}
+
+// 把一个新 run 放进第 0 层，层满了就逐层往上归并 (调用者不持锁)。
+// 锁只保护各层的登记：层满时在锁内把这一层的 run 全部取走，解锁后再归并 (高层的归并是几个 GB 的 I/O)，
+// 归并出的 run 再加锁放进上一层。归并期间别的线程照常往这一层 (已经清空) 放新的 run
+static int spill_add(SpillSet *set, SpillRun run) {
+    for (int level = 0;; level++) {
+        SpillRun full[SPILL_FAN_IN];
+        pthread_mutex_lock(&set->lock);
+        if (set->counts[level] == SPILL_FAN_IN) {   // 只有最高层可能满着，实际上碰不到
+            pthread_mutex_unlock(&set->lock);
+            fclose(run.file);
+            return -1;
+        }
+        set->runs[level][set->counts[level]++] = run;
+        int merge = set->counts[level] == SPILL_FAN_IN && level < SPILL_LEVELS - 1;
+        if (merge) {
+            memcpy(full, set->runs[level], sizeof(full));
+            set->counts[level] = 0;
+        }
+        pthread_mutex_unlock(&set->lock);
+        if (!merge) return 0;
+
+        // 这一层满了：归并成一个新 run，放到上一层
+        RunWriter writer = { tmpfile(), 0 };
+        uint64_t total = 0;
+        for (size_t k = 0; k < SPILL_FAN_IN; k++) total += full[k].count;
+        int ok = writer.file && merge_runs(full, SPILL_FAN_IN, write_run_pair, &writer) == 0 && !writer.failed;
+        for (size_t k = 0; k < SPILL_FAN_IN; k++) fclose(full[k].file);
+        if (!ok) {
+            if (writer.file) fclose(writer.file);
+            return -1;
+        }
+        run.file = writer.file;
+        run.items = NULL;
+        run.count = total;
+    }
+}
+
+// 工作线程的缓冲区写满了：原地排序，写进匿名临时文件 (关闭时自动删除)，清空缓冲区
+static int spill_buffer(SpillSet *set, PairBuffer *buf) {
+    uint64_t t = TRACE_BEGIN();
+    qsort(buf->items, buf->count, sizeof(PairResult), compare_pair);
+    FILE *file = tmpfile();
+    if (!file || fwrite(buf->items, sizeof(PairResult), buf->count, file) != buf->count) {
+        if (file) fclose(file);
+        return -1;
+    }
+    TRACE_END("spill", NULL, t);
+    SpillRun run = { file, NULL, buf->count };
+    buf->count = 0;
+    return spill_add(set, run);
+}
+
+// 计算完一块后把它在映射里的页 (向量、模长、加权模长) 还给系统
+static void release_rows(const Corpus *corpus, const TfIdfModel *tfidf, size_t begin, size_t end) {
+    corpus_release(corpus, corpus_vector(corpus, begin), (end - begin) * corpus->dimension * sizeof(int));
+    corpus_release(corpus, corpus->norms + begin, (end - begin) * sizeof(double));
+    if (tfidf && !tfidf->owned_norms) corpus_release(corpus, tfidf->norms + begin, (end - begin) * sizeof(double));
+}
+
+typedef struct {
+    const Corpus *corpus;
+    ResultSink *sink;
+    uint64_t emitted;
+} BoundedOutput;
+
+static void emit_bounded(const PairResult *pair, void *ctx) {
+    BoundedOutput *out = (BoundedOutput*)ctx;
+    result_sink_emit(out->sink, -1, pair->a, pair->b, pair->score);
+    // 文本格式会读路径表，隔一段就把读过的页还回去
+    if (++out->emitted % (1u << 16) == 0) corpus_release(out->corpus, NULL, 0);
+}
+
+int allpairs_bounded(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                     double threshold, size_t memory_budget, ResultSink *sink) {
+    if (corpus->count > UINT32_MAX) {
+        fprintf(stderr, "错误：语料库文件过多\n");
+        return -1;
+    }
+    size_t n = (size_t)corpus->count;
+    int workers = threadpool_size(pool);
+
+    // 1. 分配预算：现算的 TF-IDF 模长常驻内存，剩下的一半给向量块，四分之一给结果缓冲区，
+    //    最后四分之一留给程序本身、线程栈、输出缓冲和归并时的文件缓冲
+    size_t fixed = tfidf && tfidf->owned_norms ? n * sizeof(double) : 0;
+    size_t row_bytes = corpus->dimension * sizeof(int) + sizeof(double) + (tfidf ? sizeof(double) : 0);
+    size_t usable = memory_budget > fixed ? memory_budget - fixed : 0;
+    size_t tile_rows = usable / 2 / row_bytes;
+    size_t col_rows = tile_rows / 8;                // 列块小、行块大：每读一遍列块能和更多行配对
+    size_t row_rows = tile_rows - col_rows;
+    size_t buffer_cap = usable / 4 / (size_t)workers / sizeof(PairResult);
+    if (memory_budget < ALLPAIRS_MIN_BUDGET || col_rows < 256 || buffer_cap < 1024) {
+        fprintf(stderr, "错误：内存预算太小，至少需要 %zu MB\n",
+                (ALLPAIRS_MIN_BUDGET + fixed + 1024 * 1024 - 1) / (1024 * 1024));
+        return -1;
+    }
+
+    SpillSet *set = (SpillSet*)calloc(1, sizeof(SpillSet));
+    PairBuffer *buffers = (PairBuffer*)calloc((size_t)workers, sizeof(PairBuffer));
+    SpillRun *finals = NULL;
+    int rc = -1;
+    if (!set || !buffers) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(set);
+        free(buffers);
+        return -1;
+    }
+    pthread_mutex_init(&set->lock, NULL);
+    for (int w = 0; w < workers; w++) {
+        buffers[w].items = (PairResult*)malloc(buffer_cap * sizeof(PairResult));
+        buffers[w].capacity = buffer_cap;
+        if (!buffers[w].items) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            goto cleanup;
+        }
+    }
+
+    // 2. 行块常驻，列块依次流过；每块算完就把它的页还回去，常驻内存只有当前的行块和列块
+    AllPairsJob job = { corpus, tfidf, threshold, buffers, NULL, set };
+    corpus_release(corpus, NULL, 0);   // 打开和加载模型时读过的页先还回去
+    for (size_t rb = 0; rb < n; rb += row_rows) {
+        size_t re = rb + row_rows < n ? rb + row_rows : n;
+        threadpool_parallel_tiles(pool, rb, re, rb, re, 256, score_tile, &job);
+        for (size_t cb = re; cb < n; cb += col_rows) {
+            size_t ce = cb + col_rows < n ? cb + col_rows : n;
+            threadpool_parallel_tiles(pool, rb, re, cb, ce, 256, score_tile, &job);
+            release_rows(corpus, tfidf, cb, ce);
+        }
+        release_rows(corpus, tfidf, rb, re);
+    }
+    for (int w = 0; w < workers; w++) {
+        if (buffers[w].failed) {
+            fprintf(stderr, "错误：溢写临时文件失败\n");
+            goto cleanup;
+        }
+    }
+
+    // 3. 磁盘上的 run 加上各线程缓冲区里剩下的 (原地排序)，一起 k 路归并输出
+    size_t total_runs = (size_t)workers;
+    for (int level = 0; level < SPILL_LEVELS; level++) total_runs += set->counts[level];
+    finals = (SpillRun*)malloc(total_runs * sizeof(SpillRun));
+    if (!finals) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto cleanup;
+    }
+    size_t k = 0;
+    for (int level = 0; level < SPILL_LEVELS; level++) {
+        for (size_t r = 0; r < set->counts[level]; r++) finals[k++] = set->runs[level][r];
+    }
+    for (int w = 0; w < workers; w++) {
+        qsort(buffers[w].items, buffers[w].count, sizeof(PairResult), compare_pair);
+        SpillRun run = { NULL, buffers[w].items, buffers[w].count };
+        finals[k++] = run;
+    }
+    BoundedOutput output = { corpus, sink, 0 };
+    if (merge_runs(finals, k, emit_bounded, &output) != 0) {
+        fprintf(stderr, "错误：读取临时文件失败\n");
+        goto cleanup;
+    }
+    rc = 0;
+
+cleanup:
+    for (int level = 0; level < SPILL_LEVELS; level++) {
+        for (size_t r = 0; r < set->counts[level]; r++) fclose(set->runs[level][r].file);
+    }
+    for (int w = 0; w < workers; w++) free(buffers[w].items);
+    pthread_mutex_destroy(&set->lock);
+    free(finals);
+    free(buffers);
+    free(set);
+    return rc;
+}
+
+// ---------------- 分片 ----------------
+
+#define PART_MAGIC          "CSIMPART"
+#define PART_FORMAT_VERSION 2
+
+// 部分结果文件 = 头部 + pair_count 条按 (a, b) 升序的 PairResult
+typedef struct {
+    char     magic[8];
+    uint32_t format_version;
+    uint32_t feature_version;
+    uint64_t corpus_count;
+    uint64_t corpus_fingerprint;   // 防止把不同语料库的分片混在一起
+    uint64_t row_block;
+    uint64_t col_block;
+    uint64_t block_size;
+    double   threshold;
+    uint32_t weighting;            // 0 = 原始计数，1 = TF-IDF
+    uint32_t reserved;
+    uint64_t pair_count;
+} PartHeader;
+
+_Static_assert(sizeof(PairResult) == 16, "PairResult must be packed for the part file format");
+
+// 对路径表和向量块做 FNV-1a，作为语料库的指纹
+static uint64_t corpus_fingerprint(const Corpus *corpus) {
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char *blocks[2] = {
+        (const unsigned char*)corpus->path_data,
+        (const unsigned char*)corpus->vectors
+    };
+    uint64_t sizes[2] = {
+        corpus->path_offsets[corpus->count],
+        corpus->count * corpus->dimension * sizeof(int)
+    };
+    for (int k = 0; k < 2; k++) {
+        for (uint64_t i = 0; i < sizes[k]; i++) {
+            hash ^= blocks[k][i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+int shard_parse(const char *text, ShardSpec *spec) {
+    unsigned long long row, col, size;
+    char tail;
+    if (sscanf(text, "%llu:%llu:%llu%c", &row, &col, &size, &tail) != 3 || size == 0 || row > col) {
+        fprintf(stderr, "错误：分片描述 '%s' 无效，应为 行块:列块:块大小 且行块 <= 列块\n", text);
+        return -1;
+    }
+    spec->row_block = row;
+    spec->col_block = col;
+    spec->block_size = size;
+    return 0;
+}
+
+static size_t clamp_bound(uint64_t value, uint64_t count) {
+    return (size_t)(value < count ? value : count);
+}
+
+void shard_bounds(const ShardSpec *spec, uint64_t count,
+                  size_t *row_begin, size_t *row_end, size_t *col_begin, size_t *col_end) {
+    *row_begin = clamp_bound(spec->row_block * spec->block_size, count);
+    *row_end = clamp_bound((spec->row_block + 1) * spec->block_size, count);
+    *col_begin = clamp_bound(spec->col_block * spec->block_size, count);
+    *col_end = clamp_bound((spec->col_block + 1) * spec->block_size, count);
+}
+
+int shard_run(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf, const ShardSpec *spec,
+              double threshold, const char *out_path) {
+    size_t rb, re, cb, ce;
+    shard_bounds(spec, corpus->count, &rb, &re, &cb, &ce);
+
+    PairList pairs;
+    if (allpairs_score(pool, corpus, tfidf, rb, re, cb, ce, threshold, &pairs) != 0) return -1;
+
+    PartHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PART_MAGIC, sizeof(header.magic));
+    header.format_version = PART_FORMAT_VERSION;
+    header.feature_version = feature_table_version();
+    header.corpus_count = corpus->count;
+    header.corpus_fingerprint = corpus_fingerprint(corpus);
+    header.row_block = spec->row_block;
+    header.col_block = spec->col_block;
+    header.block_size = spec->block_size;
+    header.threshold = threshold;
+    header.weighting = tfidf != NULL;
+    header.pair_count = pairs.count;
+
+    FILE *file = fopen(out_path, "wb");
+    int ok = file != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(pairs.items, sizeof(PairResult), pairs.count, file) == pairs.count;
+        if (fclose(file) != 0) ok = 0;
+    }
+    pair_list_free(&pairs);
+    if (!ok) {
+        fprintf(stderr, "错误：写入部分结果文件 %s 失败\n", out_path);
+        if (file) remove(out_path);
+        return -1;
+    }
+    return 0;
+}
+
+// ---------------- 归并 ----------------
+
+typedef struct {
+    FILE *file;
+    const char *path;
+    PartHeader header;
+    uint64_t remaining;
+    PairResult current;
+} PartReader;
+
+// 读下一条记录；读完返回 0
+static int part_advance(PartReader *r) {
+    if (r->remaining == 0) return 0;
+    if (fread(&r->current, sizeof(PairResult), 1, r->file) != 1) return -1;
+    r->remaining--;
+    return 1;
+}
+
+// 上三角里 [rb, re) x [cb, ce) 范围内 a < b 的格子数
+static uint64_t upper_cells(uint64_t rb, uint64_t re, uint64_t cb, uint64_t ce) {
+    uint64_t total = 0;
+    if (rb >= re || cb >= ce) return 0;
+    // a < cb 的行：每行都是整行 ce - cb 个
+    uint64_t full_end = re < cb ? re : cb;
+    if (full_end > rb) total += (full_end - rb) * (ce - cb);
+    // a >= cb 的行：每行 ce - a - 1 个，是一个等差数列
+    uint64_t lo = rb > cb ? rb : cb;
+    uint64_t hi = re < ce ? re : ce;   // a 只能取到 ce - 1
+    if (lo < hi) {
+        uint64_t first = ce - lo - 1, last = ce - (hi - 1) - 1;
+        total += (first + last) * (hi - lo) / 2;
+    }
+    return total;
+}
+
+static int compare_shard_cell(const void *a, const void *b) {
+    const PartReader *x = *(const PartReader *const *)a;
+    const PartReader *y = *(const PartReader *const *)b;
+    if (x->header.row_block != y->header.row_block) return x->header.row_block < y->header.row_block ? -1 : 1;
+    return (x->header.col_block > y->header.col_block) - (x->header.col_block < y->header.col_block);
+}
+
+// 堆按当前记录的 (a, b) 排成小根堆
+static int reader_less(const PartReader *x, const PartReader *y) {
+    return compare_pair(&x->current, &y->current) < 0;
+}
+
+static void heap_sift_down(PartReader **heap, size_t n, size_t i) {
+    for (;;) {
+        size_t smallest = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && reader_less(heap[l], heap[smallest])) smallest = l;
+        if (r < n && reader_less(heap[r], heap[smallest])) smallest = r;
+        if (smallest == i) return;
+        PartReader *tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// 打开并校验所有部分结果
+static int open_parts(const Corpus *corpus, const char *const *part_paths, size_t part_count,
+                      PartReader *readers) {
+    uint64_t fingerprint = corpus_fingerprint(corpus);
+    for (size_t k = 0; k < part_count; k++) {
+        PartReader *r = &readers[k];
+        r->path = part_paths[k];
+        r->file = fopen(r->path, "rb");
+        if (!r->file) {
+            fprintf(stderr, "错误：无法打开部分结果文件 %s\n", r->path);
+            return -1;
+        }
+        const char *problem = NULL;
+        if (fread(&r->header, sizeof(PartHeader), 1, r->file) != 1 ||
+            memcmp(r->header.magic, PART_MAGIC, sizeof(r->header.magic)) != 0 ||
+            r->header.format_version != PART_FORMAT_VERSION) {
+            problem = "不是部分结果文件";
+        } else if (r->header.feature_version != feature_table_version() ||
+                   r->header.corpus_count != corpus->count ||
+                   r->header.corpus_fingerprint != fingerprint) {
+            problem = "与当前语料库不匹配";
+        } else if (r->header.block_size != readers[0].header.block_size ||
+                   r->header.threshold != readers[0].header.threshold ||
+                   r->header.weighting != readers[0].header.weighting) {
+            problem = "与其他分片的块大小、阈值或加权方式不一致";
+        }
+        if (problem) {
+            fprintf(stderr, "错误：部分结果文件 %s %s\n", r->path, problem);
+            return -1;
+        }
+        r->remaining = r->header.pair_count;
+    }
+    return 0;
+}
+
+// 分片不能重复，而且加起来要正好覆盖整个上三角
+static int check_coverage(const Corpus *corpus, PartReader *readers, size_t part_count) {
+    PartReader **sorted = (PartReader**)malloc(part_count * sizeof(PartReader*));
+    if (!sorted) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    for (size_t k = 0; k < part_count; k++) sorted[k] = &readers[k];
+    qsort(sorted, part_count, sizeof(PartReader*), compare_shard_cell);
+
+    uint64_t covered = 0;
+    int rc = 0;
+    for (size_t k = 0; k < part_count; k++) {
+        if (k > 0 && compare_shard_cell(&sorted[k - 1], &sorted[k]) == 0) {
+            fprintf(stderr, "错误：分片 %s 与 %s 重复\n", sorted[k - 1]->path, sorted[k]->path);
+            rc = -1;
+            break;
+        }
+        ShardSpec spec = { sorted[k]->header.row_block, sorted[k]->header.col_block,
+                           sorted[k]->header.block_size };
+        size_t rb, re, cb, ce;
+        shard_bounds(&spec, corpus->count, &rb, &re, &cb, &ce);
+        covered += upper_cells(rb, re, cb, ce);
+    }
+    uint64_t n = corpus->count;
+    uint64_t expected = n < 2 ? 0 : n * (n - 1) / 2;
+    if (rc == 0 && covered != expected) {
+        fprintf(stderr, "错误：分片不完整，只覆盖了 %llu / %llu 个文件对\n",
+                (unsigned long long)covered, (unsigned long long)expected);
+        rc = -1;
+    }
+    free(sorted);
+    return rc;
+}
+
+int shard_merge(const Corpus *corpus, const char *const *part_paths, size_t part_count,
+                PairSink sink, void *ctx) {
+    if (part_count == 0) {
+        fprintf(stderr, "错误：没有部分结果文件\n");
+        return -1;
+    }
+    PartReader *readers = (PartReader*)calloc(part_count, sizeof(PartReader));
+    PartReader **heap = (PartReader**)malloc(part_count * sizeof(PartReader*));
+    int rc = -1;
+    if (!readers || !heap) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto cleanup;
+    }
+    if (open_parts(corpus, part_paths, part_count, readers) != 0) goto cleanup;
+    if (check_coverage(corpus, readers, part_count) != 0) goto cleanup;
+
+    // k 路归并：每个分片内部已经有序，堆顶就是全局最小的 (a, b)
+    size_t n = 0;
+    for (size_t k = 0; k < part_count; k++) {
+        int got = part_advance(&readers[k]);
+        if (got < 0) {
+            fprintf(stderr, "错误：部分结果文件 %s 不完整\n", readers[k].path);
+            goto cleanup;
+        }
+        if (got) heap[n++] = &readers[k];
+    }
+    for (size_t i = n / 2; i-- > 0;) heap_sift_down(heap, n, i);
+
+    while (n > 0) {
+        PartReader *top = heap[0];
+        sink(&top->current, ctx);
+        int got = part_advance(top);
+        if (got < 0) {
+            fprintf(stderr, "错误：部分结果文件 %s 不完整\n", top->path);
+            goto cleanup;
+        }
+        if (!got) heap[0] = heap[--n];
+        heap_sift_down(heap, n, 0);
+    }
+    rc = 0;
+
+cleanup:
+    for (size_t k = 0; readers && k < part_count; k++) {
+        if (readers[k].file) fclose(readers[k].file);
+    }
+    free(readers);
+    free(heap);
+    return rc;
+}
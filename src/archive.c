@@ -0,0 +1,1073 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE   // flock
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "archive.h"
+#include "calculate.h"
+#include "vectorization.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define ARCHIVE_NO_LOCK
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+// ---------- 目录和锁 ----------
+
+static char *join_path(const char *dir, const char *name) {
+    size_t a = strlen(dir), b = strlen(name);
+    char *path = (char*)malloc(a + b + 2);
+    if (!path) return NULL;
+    memcpy(path, dir, a);
+    path[a] = '/';
+    memcpy(path + a + 1, name, b + 1);
+    return path;
+}
+
+static int make_dir(const char *dir) {
+#ifdef _WIN32
+    int rc = _mkdir(dir);
+#else
+    int rc = mkdir(dir, 0777);
+#endif
+    return rc == 0 || errno == EEXIST ? 0 : -1;
+}
+
+// 归档目录下的锁文件：LOCK 保护 MANIFEST 的读-改-写，COMPACT 保证同时只有一个压缩。
+// 返回文件描述符，nonblock 时拿不到锁返回 -1；没有 flock 的平台上不加锁
+static int lock_dir(const char *dir, const char *name, int nonblock) {
+#ifndef ARCHIVE_NO_LOCK
+    char *path = join_path(dir, name);
+    if (!path) return -1;
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    free(path);
+    if (fd < 0) return -1;
+    if (flock(fd, LOCK_EX | (nonblock ? LOCK_NB : 0)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void)dir;
+    (void)name;
+    (void)nonblock;
+    return 0;
+#endif
+}
+
+static void unlock_dir(int fd) {
+#ifndef ARCHIVE_NO_LOCK
+    close(fd);   // 关闭即释放 flock
+#else
+    (void)fd;
+#endif
+}
+
+static int file_exists(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    fclose(file);
+    return 1;
+}
+
+// ---------- MANIFEST ----------
+
+static void manifest_free(ArchiveManifest *m) {
+    for (size_t i = 0; i < m->segment_count; i++) free(m->segments[i].file);
+    for (size_t i = 0; i < m->tombstone_count; i++) free(m->tombstones[i].path);
+    free(m->segments);
+    free(m->tombstones);
+    memset(m, 0, sizeof(*m));
+}
+
+static int manifest_push_segment(ArchiveManifest *m, uint32_t seq, uint64_t count, const char *file,
+                                 const DfTable *df) {
+    ArchiveSegmentInfo *grown = (ArchiveSegmentInfo*)realloc(m->segments,
+                                                             (m->segment_count + 1) * sizeof(ArchiveSegmentInfo));
+    if (!grown) return -1;
+    m->segments = grown;
+    char *copy = strdup(file);
+    if (!copy) return -1;
+    m->segments[m->segment_count].seq = seq;
+    m->segments[m->segment_count].count = count;
+    m->segments[m->segment_count].file = copy;
+    m->segments[m->segment_count].df = *df;
+    m->segment_count++;
+    return 0;
+}
+
+static int manifest_push_tombstone(ArchiveManifest *m, uint32_t seq, const char *path) {
+    ArchiveTombstone *grown = (ArchiveTombstone*)realloc(m->tombstones,
+                                                         (m->tombstone_count + 1) * sizeof(ArchiveTombstone));
+    if (!grown) return -1;
+    m->tombstones = grown;
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    m->tombstones[m->tombstone_count].seq = seq;
+    m->tombstones[m->tombstone_count].path = copy;
+    m->tombstone_count++;
+    return 0;
+}
+
+// "weights" / "df" 行的数据部分：文件数加每一维的文档频率，个数必须正好对上
+static int parse_df_table(const char *text, DfTable *df) {
+    uint64_t *values = (uint64_t*)df;
+    char *end;
+    for (int i = 0; i <= VECTOR_DIMENSION; i++) {
+        while (*text == ' ') text++;
+        if (*text < '0' || *text > '9') return -1;
+        values[i] = strtoull(text, &end, 10);
+        text = end;
+    }
+    return *text == '\0' ? 0 : -1;
+}
+
+static void print_df_table(FILE *file, const char *tag, const DfTable *df) {
+    const uint64_t *values = (const uint64_t*)df;
+    fprintf(file, "%s", tag);
+    for (int i = 0; i <= VECTOR_DIMENSION; i++) fprintf(file, " %llu", (unsigned long long)values[i]);
+    fputc('\n', file);
+}
+
+// 删除标记里的路径写到行尾，反斜杠、换行和回车分别转义成 \\、\n、\r，保证一条删除标记只占一行
+static void print_escaped_path(FILE *file, const char *path) {
+    for (; *path; path++) {
+        if (*path == '\\') fputs("\\\\", file);
+        else if (*path == '\n') fputs("\\n", file);
+        else if (*path == '\r') fputs("\\r", file);
+        else fputc(*path, file);
+    }
+}
+
+// 原地还原转义，遇到不认识的转义返回 -1
+static int unescape_path(char *path) {
+    char *out = path;
+    for (const char *p = path; *p; p++) {
+        if (*p != '\\') {
+            *out++ = *p;
+            continue;
+        }
+        p++;
+        if (*p == '\\') *out++ = '\\';
+        else if (*p == 'n') *out++ = '\n';
+        else if (*p == 'r') *out++ = '\r';
+        else return -1;
+    }
+    *out = '\0';
+    return 0;
+}
+
+// 读 MANIFEST。文件不存在时 missing_ok 为 1 就当作空归档，否则报错；格式不对返回 -1
+static int read_manifest(const char *dir, ArchiveManifest *m, int missing_ok) {
+    memset(m, 0, sizeof(*m));
+    m->next = 1;
+    char *path = join_path(dir, ARCHIVE_MANIFEST);
+    if (!path) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    FILE *file = fopen(path, "r");
+    free(path);
+    if (!file) {
+        if (missing_ok) return 0;
+        fprintf(stderr, "错误：%s 不是归档目录 (没有 %s)\n", dir, ARCHIVE_MANIFEST);
+        return -1;
+    }
+
+    // 路径可能很长，按行整行读
+    char *line = NULL;
+    size_t capacity = 0;
+    unsigned version = 0;
+    int ok = getline(&line, &capacity, file) > 0 &&
+             sscanf(line, ARCHIVE_MAGIC " %u", &version) == 1 && version == ARCHIVE_FORMAT_VERSION;
+    ssize_t read;
+    while (ok && (read = getline(&line, &capacity, file)) > 0) {
+        size_t len = (size_t)read;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        unsigned seq;
+        unsigned long long count;
+        char name[256];
+        if (sscanf(line, "next %u", &seq) == 1) {
+            m->next = seq;
+        } else if (strncmp(line, "weights ", 8) == 0) {
+            ok = parse_df_table(line + 8, &m->frozen) == 0;
+        } else if (sscanf(line, "segment %u %llu %255s", &seq, &count, name) == 3) {
+            DfTable df;
+            df_table_init(&df);
+            ok = manifest_push_segment(m, seq, count, name, &df) == 0;
+        } else if (strncmp(line, "df ", 3) == 0) {
+            // 属于上一个 segment 行
+            ok = m->segment_count > 0 && parse_df_table(line + 3, &m->segments[m->segment_count - 1].df) == 0;
+        } else if (strncmp(line, "tombstone ", 10) == 0) {
+            // 序号后面正好一个空格，其余到行尾都是 (转义过的) 路径，路径开头的空格也要保留
+            char *end;
+            unsigned long value = strtoul(line + 10, &end, 10);
+            ok = end > line + 10 && *end == ' ' && unescape_path(end + 1) == 0 &&
+                 manifest_push_tombstone(m, (uint32_t)value, end + 1) == 0;
+        } else if (len > 0) {
+            ok = 0;
+        }
+    }
+    free(line);
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "错误：归档 %s 的 %s 已损坏\n", dir, ARCHIVE_MANIFEST);
+        manifest_free(m);
+        return -1;
+    }
+    return 0;
+}
+
+// 先写临时文件再 rename，读者要么看到旧版要么看到新版
+static int write_manifest(const char *dir, const ArchiveManifest *m) {
+    char *path = join_path(dir, ARCHIVE_MANIFEST);
+    char *tmp = join_path(dir, ARCHIVE_MANIFEST ".tmp");
+    if (!path || !tmp) {
+        free(path);
+        free(tmp);
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    FILE *file = fopen(tmp, "w");
+    int ok = file != NULL;
+    if (ok) {
+        fprintf(file, "%s %d\nnext %u\n", ARCHIVE_MAGIC, ARCHIVE_FORMAT_VERSION, m->next);
+        print_df_table(file, "weights", &m->frozen);
+        for (size_t i = 0; i < m->segment_count; i++) {
+            fprintf(file, "segment %u %llu %s\n", m->segments[i].seq,
+                    (unsigned long long)m->segments[i].count, m->segments[i].file);
+            print_df_table(file, "df", &m->segments[i].df);
+        }
+        for (size_t i = 0; i < m->tombstone_count; i++) {
+            fprintf(file, "tombstone %u ", m->tombstones[i].seq);
+            print_escaped_path(file, m->tombstones[i].path);
+            fputc('\n', file);
+        }
+        ok = fflush(file) == 0;
+#ifndef ARCHIVE_NO_LOCK
+        if (ok) ok = fsync(fileno(file)) == 0;
+#endif
+        if (fclose(file) != 0) ok = 0;
+    }
+#ifdef _WIN32
+    if (ok) remove(path);   // Windows 上 rename 不能覆盖已有文件
+#endif
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "错误：无法写入 %s\n", path);
+        remove(tmp);
+    }
+    free(path);
+    free(tmp);
+    return ok ? 0 : -1;
+}
+
+static void segment_name(char *name, size_t size, uint32_t number) {
+    snprintf(name, size, "seg-%06u.bin", number);
+}
+
+// ---------- 打开 ----------
+
+static int compare_tombstone(const void *a, const void *b) {
+    const ArchiveTombstone *x = (const ArchiveTombstone*)a;
+    const ArchiveTombstone *y = (const ArchiveTombstone*)b;
+    int c = strcmp(x->path, y->path);
+    if (c != 0) return c;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static int compare_tombstone_path(const void *a, const void *b) {
+    return strcmp(((const ArchiveTombstone*)a)->path, ((const ArchiveTombstone*)b)->path);
+}
+
+// 标记被删除的文件：删除标记按路径排好序，同一路径只留最大的序号，每个文件二分查找一次
+typedef struct {
+    const ArchiveSegmentInfo *infos;
+    const ArchiveTombstone *tombstones;
+    size_t tombstone_count;
+    uint32_t max_seq;
+    Archive *archive;
+    int failed;
+} MarkJob;
+
+static void mark_range(size_t begin, size_t end, void *ctx) {
+    MarkJob *job = (MarkJob*)ctx;
+    for (size_t s = begin; s < end; s++) {
+        if (job->infos[s].seq > job->max_seq) continue;
+        const Corpus *corpus = &job->archive->segments[s];
+        for (uint64_t i = 0; i < corpus->count; i++) {
+            ArchiveTombstone key = { 0, (char*)corpus_path(corpus, (size_t)i) };
+            const ArchiveTombstone *hit = (const ArchiveTombstone*)bsearch(
+                &key, job->tombstones, job->tombstone_count, sizeof(ArchiveTombstone), compare_tombstone_path);
+            if (!hit || hit->seq < job->infos[s].seq) continue;
+            if (!job->archive->dead[s]) {
+                job->archive->dead[s] = (unsigned char*)calloc((size_t)corpus->count, 1);
+                if (!job->archive->dead[s]) {
+                    job->failed = 1;
+                    break;
+                }
+            }
+            job->archive->dead[s][i] = 1;
+        }
+    }
+}
+
+// 映射 infos 里的 n 个段并按删除标记标出作废的文件，结果放进 archive (不动 archive->manifest)。
+// 段文件不见了 (刚被压缩删掉) 时置 *missing 并返回 -1，调用者可以重读 MANIFEST 再试
+static int open_segments(ThreadPool *pool, const char *dir, const ArchiveSegmentInfo *infos, size_t n,
+                         const ArchiveTombstone *tombstones, size_t tombstone_count,
+                         Archive *archive, int *missing) {
+    *missing = 0;
+    size_t slots = n ? n : 1;
+    archive->segments = (Corpus*)calloc(slots, sizeof(Corpus));
+    archive->dead = (unsigned char**)calloc(slots, sizeof(unsigned char*));
+    archive->first = (uint64_t*)calloc(n + 1, sizeof(uint64_t));
+    ArchiveTombstone *sorted = (ArchiveTombstone*)malloc((tombstone_count ? tombstone_count : 1) *
+                                                         sizeof(ArchiveTombstone));
+    if (!archive->segments || !archive->dead || !archive->first || !sorted) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(sorted);
+        return -1;
+    }
+
+    for (size_t s = 0; s < n; s++) {
+        char *path = join_path(dir, infos[s].file);
+        if (!path) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            free(sorted);
+            return -1;
+        }
+        if (!file_exists(path)) {
+            *missing = 1;
+            free(path);
+            free(sorted);
+            return -1;
+        }
+        int rc = corpus_open(path, &archive->segments[s]);
+        free(path);
+        if (rc != 0) {
+            free(sorted);
+            return -1;
+        }
+        archive->first[s + 1] = archive->first[s] + archive->segments[s].count;
+    }
+
+    // 同一路径的多条删除标记只留序号最大的一条
+    uint32_t max_seq = 0;
+    size_t unique = 0;
+    if (tombstone_count) memcpy(sorted, tombstones, tombstone_count * sizeof(ArchiveTombstone));
+    qsort(sorted, tombstone_count, sizeof(ArchiveTombstone), compare_tombstone);
+    for (size_t t = 0; t < tombstone_count; t++) {
+        if (unique > 0 && compare_tombstone_path(&sorted[unique - 1], &sorted[t]) == 0) unique--;
+        sorted[unique++] = sorted[t];
+        if (sorted[t].seq > max_seq) max_seq = sorted[t].seq;
+    }
+
+    MarkJob job = { infos, sorted, unique, max_seq, archive, 0 };
+    if (unique > 0) threadpool_parallel_for(pool, 0, n, 1, mark_range, &job);
+    free(sorted);
+    if (job.failed) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+
+    archive->live = archive->first[n];
+    for (size_t s = 0; s < n; s++) {
+        if (!archive->dead[s]) continue;
+        for (uint64_t i = 0; i < archive->segments[s].count; i++) archive->live -= archive->dead[s][i];
+    }
+    return 0;
+}
+
+static void close_segments(Archive *archive, size_t n) {
+    for (size_t s = 0; archive->segments && s < n; s++) {
+        if (archive->segments[s].base) corpus_close(&archive->segments[s]);
+    }
+    for (size_t s = 0; archive->dead && s < n; s++) free(archive->dead[s]);
+    free(archive->segments);
+    free(archive->dead);
+    free(archive->first);
+    archive->segments = NULL;
+    archive->dead = NULL;
+    archive->first = NULL;
+    archive->live = 0;
+}
+
+int archive_open(ThreadPool *pool, const char *dir, Archive *archive) {
+    memset(archive, 0, sizeof(*archive));
+    // 读 MANIFEST 和打开段之间，后台压缩可能刚好删掉旧段；重读一次新的 MANIFEST 就行
+    for (int attempt = 0; attempt < 3; attempt++) {
+        if (read_manifest(dir, &archive->manifest, 0) != 0) return -1;
+        int missing = 0;
+        if (open_segments(pool, dir, archive->manifest.segments, archive->manifest.segment_count,
+                          archive->manifest.tombstones, archive->manifest.tombstone_count,
+                          archive, &missing) == 0) {
+            return 0;
+        }
+        archive_close(archive);
+        if (!missing) return -1;
+    }
+    fprintf(stderr, "错误：归档 %s 的段文件缺失\n", dir);
+    return -1;
+}
+
+void archive_close(Archive *archive) {
+    for (size_t s = 0; archive->owned_norms && s < archive->manifest.segment_count; s++) {
+        free(archive->owned_norms[s]);
+    }
+    free(archive->owned_norms);
+    free((void*)archive->tfidf_norms);
+    archive->owned_norms = NULL;
+    archive->tfidf_norms = NULL;
+    close_segments(archive, archive->manifest.segment_count);
+    manifest_free(&archive->manifest);
+}
+
+size_t archive_segment_of(const Archive *archive, uint64_t index) {
+    // 最后一个 first[s] <= index 的段 (空段的 first 与下一段相同，会被跳过)
+    size_t lo = 0, hi = archive->manifest.segment_count;
+    while (lo + 1 < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (archive->first[mid] <= index) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// ---------- TF-IDF ----------
+
+void archive_document_frequency(const ArchiveManifest *manifest, DfTable *df) {
+    df_table_init(df);
+    for (size_t s = 0; s < manifest->segment_count; s++) {
+        df->docs += manifest->segments[s].df.docs;
+        for (int i = 0; i < VECTOR_DIMENSION; i++) df->df[i] += manifest->segments[s].df.df[i];
+    }
+}
+
+// 文件增删之后检查冻结的权重，当前文档频率算出的 idf 偏离太多时才重新冻结
+static void refreeze_weights(ArchiveManifest *m) {
+    DfTable now;
+    TfIdfWeights frozen;
+    archive_document_frequency(m, &now);
+    tfidf_weights(&m->frozen, &frozen);
+    if (tfidf_needs_reweight(&frozen, &now, ARCHIVE_REWEIGHT_TOLERANCE)) m->frozen = now;
+}
+
+int archive_load_tfidf(ThreadPool *pool, Archive *archive) {
+    size_t n = archive->manifest.segment_count;
+    size_t slots = n ? n : 1;
+    tfidf_weights(&archive->manifest.frozen, &archive->weights);
+    archive->tfidf_norms = (const double**)calloc(slots, sizeof(double*));
+    archive->owned_norms = (double**)calloc(slots, sizeof(double*));
+    archive->stale_segments = 0;
+    if (!archive->tfidf_norms || !archive->owned_norms) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    for (size_t s = 0; s < n; s++) {
+        const Corpus *corpus = &archive->segments[s];
+        if (corpus->df_table && corpus->tfidf_norms &&
+            memcmp(corpus->df_table, &archive->manifest.frozen, sizeof(DfTable)) == 0) {
+            archive->tfidf_norms[s] = corpus->tfidf_norms;
+            continue;
+        }
+        // 段写出之后权重重新冻结过：模长在内存里现算，下次压缩重写这一段时再存盘
+        archive->owned_norms[s] = (double*)malloc((corpus->count ? corpus->count : 1) * sizeof(double));
+        if (!archive->owned_norms[s]) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            return -1;
+        }
+        tfidf_norms_build(pool, &archive->weights, corpus->vectors, (size_t)corpus->count, archive->owned_norms[s]);
+        archive->tfidf_norms[s] = archive->owned_norms[s];
+        archive->stale_segments++;
+    }
+    return 0;
+}
+
+// 写一个段文件，带上冻结的文档频率和按它加权的模长：查询时权重没变就直接用
+static int write_segment(const char *path, const CorpusInput *input, const DfTable *frozen) {
+    double *norms = (double*)malloc((input->count ? input->count : 1) * sizeof(double));
+    if (!norms) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    TfIdfWeights weights;
+    tfidf_weights(frozen, &weights);
+    for (size_t i = 0; i < input->count; i++) {
+        norms[i] = tfidf_norm(&weights, input->vectors + i * VECTOR_DIMENSION);
+    }
+    CorpusInput with_norms = *input;
+    with_norms.df_table = (const uint64_t*)frozen;
+    with_norms.tfidf_norms = norms;
+    int rc = corpus_write(path, &with_norms);
+    free(norms);
+    return rc;
+}
+
+// ---------- 追加和删除 ----------
+
+static int compare_path_pointer(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// 在各段里找出要作废的路径 (已经作废的不算)，从所在段的文档频率里减掉，一段一个任务
+typedef struct {
+    const Archive *current;
+    ArchiveSegmentInfo *infos;
+    const char **paths;        // 按字典序排好
+    size_t count;
+    atomic_uchar *found;       // 与 paths 对应：在某一段里找到过
+} RetireJob;
+
+static void retire_range(size_t begin, size_t end, void *ctx) {
+    RetireJob *job = (RetireJob*)ctx;
+    for (size_t s = begin; s < end; s++) {
+        const Corpus *corpus = &job->current->segments[s];
+        for (uint64_t i = 0; i < corpus->count; i++) {
+            if (archive_is_dead(job->current, s, i)) continue;
+            const char *path = corpus_path(corpus, (size_t)i);
+            const char **hit = (const char**)bsearch(&path, job->paths, job->count, sizeof(char*),
+                                                     compare_path_pointer);
+            if (!hit) continue;
+            df_table_remove(&job->infos[s].df, corpus_vector(corpus, (size_t)i));
+            atomic_store(&job->found[hit - job->paths], 1);
+        }
+    }
+}
+
+// 作废 m 的各段里路径属于 paths 且还活着的文件：从所在段的文档频率里减掉，
+// 把找到过的路径 (按字典序排好、去重) 放进 *retired，个数放进 *retired_count，调用者 free。
+// 段文件只读不改；调用者持有 LOCK，压缩换不了 MANIFEST，段文件一定都在。失败返回 -1
+static int retire_live_files(ThreadPool *pool, const char *dir, ArchiveManifest *m,
+                             const char *const *paths, size_t count,
+                             const char ***retired, size_t *retired_count) {
+    *retired = NULL;
+    *retired_count = 0;
+    Archive current;
+    memset(&current, 0, sizeof(current));
+    int missing;
+    int rc = open_segments(pool, dir, m->segments, m->segment_count, m->tombstones, m->tombstone_count,
+                           &current, &missing);
+    if (missing) fprintf(stderr, "错误：归档 %s 的段文件缺失\n", dir);
+
+    const char **sorted = NULL;
+    atomic_uchar *found = NULL;
+    if (rc == 0) {
+        sorted = (const char**)malloc((count ? count : 1) * sizeof(char*));
+        found = (atomic_uchar*)calloc(count ? count : 1, sizeof(atomic_uchar));
+        if (!sorted || !found) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        }
+    }
+    if (rc == 0) {
+        size_t unique = 0;
+        if (count) memcpy(sorted, paths, count * sizeof(char*));
+        qsort(sorted, count, sizeof(char*), compare_path_pointer);
+        for (size_t k = 0; k < count; k++) {
+            if (unique == 0 || strcmp(sorted[unique - 1], sorted[k]) != 0) sorted[unique++] = sorted[k];
+        }
+        RetireJob job = { &current, m->segments, sorted, unique, found };
+        threadpool_parallel_for(pool, 0, m->segment_count, 1, retire_range, &job);
+        for (size_t k = 0; k < unique; k++) {
+            if (atomic_load(&found[k])) sorted[(*retired_count)++] = sorted[k];
+        }
+        *retired = sorted;
+        sorted = NULL;
+    }
+    free(sorted);
+    free(found);
+    close_segments(&current, m->segment_count);
+    return rc;
+}
+
+int archive_add(ThreadPool *pool, const char *dir, const CorpusInput *input, uint32_t *seq) {
+    if (make_dir(dir) != 0) {
+        fprintf(stderr, "错误：无法创建归档目录 %s\n", dir);
+        return -1;
+    }
+    int lock = lock_dir(dir, "LOCK", 0);
+    if (lock < 0) {
+        fprintf(stderr, "错误：无法锁定归档 %s\n", dir);
+        return -1;
+    }
+
+    // 新段的文档频率只统计这一批
+    DfTable df;
+    df_table_init(&df);
+    for (size_t i = 0; i < input->count; i++) df_table_add(&df, input->vectors + i * VECTOR_DIMENSION);
+
+    // 段文件在 MANIFEST 提交之前对读者不可见，写一半失败也只是留下一个没人引用的文件
+    ArchiveManifest m;
+    int rc = read_manifest(dir, &m, 1);
+    const char **retired = NULL;
+    size_t retired_count = 0;
+    char name[32];
+    char *path = NULL;
+
+    // 重新追加已有的路径：旧段里的那一份作废 (删除标记的序号取新段之前最新的段，只对旧段生效)
+    if (rc == 0 && m.segment_count > 0) {
+        uint32_t older = m.segments[m.segment_count - 1].seq;
+        rc = retire_live_files(pool, dir, &m, input->paths, input->count, &retired, &retired_count);
+        for (size_t k = 0; rc == 0 && k < retired_count; k++) {
+            if (manifest_push_tombstone(&m, older, retired[k]) != 0) {
+                fprintf(stderr, "错误：内存分配失败\n");
+                rc = -1;
+            }
+        }
+    }
+    if (rc == 0) {
+        *seq = m.next++;
+        segment_name(name, sizeof(name), *seq);
+        if (manifest_push_segment(&m, *seq, input->count, name, &df) != 0) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        }
+    }
+    if (rc == 0) {
+        refreeze_weights(&m);
+        path = join_path(dir, name);
+        rc = path ? write_segment(path, input, &m.frozen) : -1;
+    }
+    if (rc == 0) {
+        rc = write_manifest(dir, &m);
+        if (rc != 0) remove(path);
+    }
+    free(retired);
+    free(path);
+    manifest_free(&m);
+    unlock_dir(lock);
+    return rc;
+}
+
+int archive_delete(ThreadPool *pool, const char *dir, const char *const *paths, size_t count) {
+    int lock = lock_dir(dir, "LOCK", 0);
+    if (lock < 0) {
+        fprintf(stderr, "错误：无法锁定归档 %s\n", dir);
+        return -1;
+    }
+    ArchiveManifest m;
+    int rc = read_manifest(dir, &m, 0);
+    const char **retired = NULL;
+    size_t retired_count = 0;
+    if (rc == 0) rc = retire_live_files(pool, dir, &m, paths, count, &retired, &retired_count);
+    if (rc == 0) refreeze_weights(&m);
+    free(retired);
+
+    // 序号取当前最新段的序号，之后追加的同名文件不受影响
+    uint32_t seq = m.segment_count ? m.segments[m.segment_count - 1].seq : 0;
+    for (size_t i = 0; rc == 0 && i < count; i++) {
+        if (manifest_push_tombstone(&m, seq, paths[i]) != 0) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        }
+    }
+    if (rc == 0) rc = write_manifest(dir, &m);
+    manifest_free(&m);
+    unlock_dir(lock);
+    return rc;
+}
+
+// ---------- 查询 ----------
+
+// 得分高的排前面，同分按全局下标排，和 --query 的顺序规则一样
+static int compare_archive_match(const ArchiveMatch *x, const ArchiveMatch *y) {
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static void keep_top_k(ArchiveMatch *best, size_t *kept, size_t top_k, ArchiveMatch m) {
+    if (top_k == 0) return;
+    if (*kept == top_k && compare_archive_match(&m, &best[*kept - 1]) >= 0) return;
+    size_t j = *kept < top_k ? (*kept)++ : *kept - 1;
+    while (j > 0 && compare_archive_match(&m, &best[j - 1]) < 0) {
+        best[j] = best[j - 1];
+        j--;
+    }
+    best[j] = m;
+}
+
+// 把 parts 组前 k 名 (每组 top_k 项，各 counts[p] 个) 合成最终的前 k 名
+static void merge_top_k(const ArchiveMatch *parts, const size_t *counts, size_t groups, size_t top_k,
+                        ArchiveMatch *best, size_t *kept) {
+    *kept = 0;
+    for (size_t p = 0; p < groups; p++) {
+        for (size_t i = 0; i < counts[p]; i++) keep_top_k(best, kept, top_k, parts[p * top_k + i]);
+    }
+}
+
+double archive_score(const Archive *archive, const int vector[], int weighted, uint64_t index) {
+    size_t s = archive_segment_of(archive, index);
+    const Corpus *corpus = &archive->segments[s];
+    size_t local = (size_t)(index - archive->first[s]);
+    if (weighted) {
+        return tfidf_cosine(&archive->weights, vector, tfidf_norm(&archive->weights, vector),
+                            corpus_vector(corpus, local), archive->tfidf_norms[s][local]);
+    }
+    return calculate_cosine_similarity_normed(vector, calculate_vector_norm(vector, VECTOR_DIMENSION),
+                                              corpus_vector(corpus, local), corpus->norms[local],
+                                              VECTOR_DIMENSION);
+}
+
+typedef struct {
+    const Archive *archive;
+    const int *vector;
+    int weighted;
+    double norm;            // weighted 时是加权模长
+    size_t top_k;
+    ArchiveMatch *best;    // 按 threadpool_worker_id() 分组，每组 top_k 项
+    size_t *kept;
+} CosineJob;
+
+static void cosine_range(size_t begin, size_t end, void *ctx) {
+    CosineJob *job = (CosineJob*)ctx;
+    const Archive *archive = job->archive;
+    int worker = threadpool_worker_id();
+    ArchiveMatch *best = job->best + (size_t)worker * job->top_k;
+    size_t s = archive_segment_of(archive, begin);
+    for (size_t g = begin; g < end; g++) {
+        while (g >= archive->first[s + 1]) s++;
+        uint64_t i = g - archive->first[s];
+        if (archive_is_dead(archive, s, i)) continue;
+        const Corpus *corpus = &archive->segments[s];
+        const int *v = corpus_vector(corpus, (size_t)i);
+        ArchiveMatch m = { g, job->weighted
+            ? tfidf_cosine(&archive->weights, job->vector, job->norm, v, archive->tfidf_norms[s][i])
+            : calculate_cosine_similarity_normed(job->vector, job->norm, v, corpus->norms[i], VECTOR_DIMENSION) };
+        keep_top_k(best, &job->kept[worker], job->top_k, m);
+    }
+}
+
+int archive_query_cosine(ThreadPool *pool, const Archive *archive, const int vector[], int weighted,
+                         size_t top_k, ArchiveMatch *best, size_t *kept) {
+    *kept = 0;
+    if (top_k == 0) return 0;
+    size_t workers = (size_t)threadpool_size(pool);
+    double norm = weighted ? tfidf_norm(&archive->weights, vector) : calculate_vector_norm(vector, VECTOR_DIMENSION);
+    CosineJob job = { archive, vector, weighted, norm, top_k,
+                      (ArchiveMatch*)malloc(workers * top_k * sizeof(ArchiveMatch)),
+                      (size_t*)calloc(workers, sizeof(size_t)) };
+    if (!job.best || !job.kept) {
+        free(job.best);
+        free(job.kept);
+        return -1;
+    }
+    // 所有段拉平成一个区间，段的大小再悬殊也能均匀分给各线程
+    threadpool_parallel_for(pool, 0, archive->first[archive->manifest.segment_count], 4096, cosine_range, &job);
+    merge_top_k(job.best, job.kept, workers, top_k, best, kept);
+    free(job.best);
+    free(job.kept);
+    return 0;
+}
+
+typedef struct {
+    const Archive *archive;
+    const MinHashSignature *sig;
+    size_t top_k;
+    ArchiveMatch *best;    // 每段一组，每组 top_k 项
+    size_t *kept;
+    size_t *candidates;
+    int failed;
+} MinHashJob;
+
+static void minhash_range(size_t begin, size_t end, void *ctx) {
+    MinHashJob *job = (MinHashJob*)ctx;
+    const Archive *archive = job->archive;
+    for (size_t s = begin; s < end; s++) {
+        const Corpus *corpus = &archive->segments[s];
+        uint32_t *ids;
+        size_t count;
+        if (corpus_lsh_candidates(corpus, job->sig, &ids, &count) != 0) {
+            job->failed = 1;
+            continue;
+        }
+        for (size_t c = 0; c < count; c++) {
+            if (archive_is_dead(archive, s, ids[c])) continue;
+            ArchiveMatch m = { archive->first[s] + ids[c], minhash_jaccard(job->sig, &corpus->signatures[ids[c]]) };
+            keep_top_k(job->best + s * job->top_k, &job->kept[s], job->top_k, m);
+            job->candidates[s]++;
+        }
+        free(ids);
+    }
+}
+
+int archive_query_minhash(ThreadPool *pool, const Archive *archive, const MinHashSignature *sig,
+                          size_t top_k, ArchiveMatch *best, size_t *kept, size_t *candidates) {
+    *kept = 0;
+    *candidates = 0;
+    size_t n = archive->manifest.segment_count;
+    for (size_t s = 0; s < n; s++) {
+        if (!archive->segments[s].lsh_keys) {
+            fprintf(stderr, "错误：归档的段 %s 没有 MinHash 索引，请用 --archive-add ... --minhash 追加\n",
+                    archive->manifest.segments[s].file);
+            return -1;
+        }
+    }
+    size_t slots = n ? n : 1;
+    MinHashJob job = { archive, sig, top_k, (ArchiveMatch*)malloc(slots * (top_k ? top_k : 1) * sizeof(ArchiveMatch)),
+                       (size_t*)calloc(slots, sizeof(size_t)), (size_t*)calloc(slots, sizeof(size_t)), 0 };
+    if (!job.best || !job.kept || !job.candidates) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(job.best);
+        free(job.kept);
+        free(job.candidates);
+        return -1;
+    }
+    // 每段查一次 LSH 桶，一段一个任务
+    threadpool_parallel_for(pool, 0, n, 1, minhash_range, &job);
+    if (job.failed) {
+        fprintf(stderr, "错误：内存分配失败\n");
+    } else {
+        merge_top_k(job.best, job.kept, n, top_k, best, kept);
+        for (size_t s = 0; s < n; s++) *candidates += job.candidates[s];
+    }
+    free(job.best);
+    free(job.kept);
+    free(job.candidates);
+    return job.failed ? -1 : 0;
+}
+
+// ---------- 压缩 ----------
+
+// 选出要合并的段 [*lo, *hi)：从最新的段往前，前一段不超过已合并部分的 ARCHIVE_SIZE_RATIO 倍就并进来，
+// 凑够 min_run 段才合并
+static void pick_run(const ArchiveManifest *m, int full, size_t min_run, size_t *lo, size_t *hi) {
+    size_t n = m->segment_count;
+    *lo = *hi = n;
+    if (n == 0) return;
+    if (full) {
+        // 只剩一个段时，有删除标记才值得重写
+        if (n > 1 || m->tombstone_count > 0) *lo = 0;
+        return;
+    }
+    uint64_t merged = m->segments[n - 1].count;
+    size_t start = n - 1;
+    while (start > 0 && m->segments[start - 1].count <= ARCHIVE_SIZE_RATIO * merged) {
+        merged += m->segments[--start].count;
+    }
+    if (n - start >= min_run) *lo = start;
+}
+
+// 把 run 里没被删除的文件按原顺序收集成一个 CorpusInput；可选段只有每个段都有才保留
+typedef struct {
+    CorpusInput input;
+    int *vectors;
+    const char **paths;
+    MinHashSignature *signatures;
+    uint64_t *token_offsets;
+    unsigned char *token_data;
+    uint64_t *content_hashes;
+} MergedSegment;
+
+static void merged_free(MergedSegment *merged) {
+    free(merged->vectors);
+    free(merged->paths);
+    free(merged->signatures);
+    free(merged->token_offsets);
+    free(merged->token_data);
+    free(merged->content_hashes);
+    memset(merged, 0, sizeof(*merged));
+}
+
+static int merge_segments(const Archive *run, size_t n, MergedSegment *merged) {
+    memset(merged, 0, sizeof(*merged));
+    int all_signatures = 1, all_tokens = 1, all_hashes = 1;
+    uint64_t token_bytes = 0;
+    for (size_t s = 0; s < n; s++) {
+        const Corpus *corpus = &run->segments[s];
+        all_signatures &= corpus->signatures != NULL;
+        all_tokens &= corpus->token_offsets != NULL;
+        all_hashes &= corpus->content_hashes != NULL;
+        for (uint64_t i = 0; corpus->token_offsets && i < corpus->count; i++) {
+            if (!archive_is_dead(run, s, i)) token_bytes += corpus->token_offsets[i + 1] - corpus->token_offsets[i];
+        }
+    }
+
+    size_t live = (size_t)run->live;
+    size_t slots = live ? live : 1;
+    merged->vectors = (int*)malloc(slots * VECTOR_DIMENSION * sizeof(int));
+    merged->paths = (const char**)malloc(slots * sizeof(char*));
+    if (all_signatures) merged->signatures = (MinHashSignature*)malloc(slots * sizeof(MinHashSignature));
+    if (all_tokens) {
+        merged->token_offsets = (uint64_t*)malloc((live + 1) * sizeof(uint64_t));
+        merged->token_data = (unsigned char*)malloc(token_bytes ? (size_t)token_bytes : 1);
+    }
+    if (all_hashes) merged->content_hashes = (uint64_t*)malloc(slots * sizeof(uint64_t));
+    if (!merged->vectors || !merged->paths || (all_signatures && !merged->signatures) ||
+        (all_tokens && (!merged->token_offsets || !merged->token_data)) ||
+        (all_hashes && !merged->content_hashes)) {
+        merged_free(merged);
+        return -1;
+    }
+
+    size_t k = 0;
+    uint64_t bytes = 0;
+    for (size_t s = 0; s < n; s++) {
+        const Corpus *corpus = &run->segments[s];
+        for (uint64_t i = 0; i < corpus->count; i++) {
+            if (archive_is_dead(run, s, i)) continue;
+            memcpy(merged->vectors + k * VECTOR_DIMENSION, corpus_vector(corpus, (size_t)i),
+                   VECTOR_DIMENSION * sizeof(int));
+            merged->paths[k] = corpus_path(corpus, (size_t)i);
+            if (all_signatures) merged->signatures[k] = corpus->signatures[i];
+            if (all_hashes) merged->content_hashes[k] = corpus->content_hashes[i];
+            if (all_tokens) {
+                uint64_t size = corpus->token_offsets[i + 1] - corpus->token_offsets[i];
+                merged->token_offsets[k] = bytes;
+                memcpy(merged->token_data + bytes, corpus->token_data + corpus->token_offsets[i], (size_t)size);
+                bytes += size;
+            }
+            k++;
+        }
+    }
+    if (all_tokens) merged->token_offsets[live] = bytes;
+
+    CorpusInput input = { merged->paths, merged->vectors, live, VECTOR_DIMENSION, merged->signatures,
+                          merged->token_offsets, merged->token_data, NULL, NULL, merged->content_hashes };
+    merged->input = input;
+    return 0;
+}
+
+// 拿到 LOCK 后把新的 MANIFEST 换上：[lo, hi) 这几段换成合并出的段 (file 为 NULL 表示全删光了)，
+// 合并包含最老的段时，快照里序号不超过新段的删除标记都已经用掉，一并清除
+static int commit_compaction(const char *dir, const ArchiveManifest *snapshot, size_t lo, size_t hi,
+                             uint32_t seq, uint64_t count, const char *file) {
+    int lock = lock_dir(dir, "LOCK", 0);
+    if (lock < 0) {
+        fprintf(stderr, "错误：无法锁定归档 %s\n", dir);
+        return -1;
+    }
+    ArchiveManifest now, next;
+    memset(&next, 0, sizeof(next));
+    int rc = read_manifest(dir, &now, 0);
+
+    // 压缩期间别人只会在末尾追加段、追加删除标记，快照里的段和删除标记都还在原来的位置
+    for (size_t s = lo; rc == 0 && s < hi; s++) {
+        if (s >= now.segment_count || strcmp(now.segments[s].file, snapshot->segments[s].file) != 0) {
+            fprintf(stderr, "错误：归档 %s 在压缩期间被改动过，放弃本次压缩\n", dir);
+            rc = -1;
+        }
+    }
+    if (rc == 0) {
+        // 新段的文档频率是被合并各段的和；要用现在的值，压缩期间的删除已经从这些段里减掉了
+        DfTable merged;
+        df_table_init(&merged);
+        for (size_t s = lo; s < hi; s++) {
+            merged.docs += now.segments[s].df.docs;
+            for (int i = 0; i < VECTOR_DIMENSION; i++) merged.df[i] += now.segments[s].df.df[i];
+        }
+        next.next = now.next;
+        next.frozen = now.frozen;
+        for (size_t s = 0; rc == 0 && s < now.segment_count; s++) {
+            if (s == lo && file) rc = manifest_push_segment(&next, seq, count, file, &merged);
+            if (rc == 0 && (s < lo || s >= hi)) {
+                rc = manifest_push_segment(&next, now.segments[s].seq, now.segments[s].count, now.segments[s].file,
+                                           &now.segments[s].df);
+            }
+        }
+        for (size_t t = 0; rc == 0 && t < now.tombstone_count; t++) {
+            if (lo == 0 && t < snapshot->tombstone_count && now.tombstones[t].seq <= seq) continue;
+            rc = manifest_push_tombstone(&next, now.tombstones[t].seq, now.tombstones[t].path);
+        }
+        if (rc != 0) fprintf(stderr, "错误：内存分配失败\n");
+    }
+    if (rc == 0) rc = write_manifest(dir, &next);
+    manifest_free(&next);
+    manifest_free(&now);
+    unlock_dir(lock);
+    return rc;
+}
+
+// auto_run 为 0 时是手动压缩；否则是追加后的自动压缩，凑够 auto_run 段才合并，别人正在压缩就跳过
+static int compact(ThreadPool *pool, const char *dir, int full, size_t auto_run, ArchiveCompaction *stats) {
+    memset(stats, 0, sizeof(*stats));
+    int compact_lock = lock_dir(dir, "COMPACT", 1);
+    if (compact_lock < 0) {
+        if (auto_run) return 0;
+        fprintf(stderr, "错误：归档 %s 正在被另一个进程压缩\n", dir);
+        return -1;
+    }
+
+    ArchiveManifest snapshot;
+    if (read_manifest(dir, &snapshot, 0) != 0) {
+        unlock_dir(compact_lock);
+        return -1;
+    }
+    size_t lo, hi;
+    pick_run(&snapshot, full, auto_run ? auto_run : 2, &lo, &hi);
+    if (lo == hi) {
+        manifest_free(&snapshot);
+        unlock_dir(compact_lock);
+        return 0;
+    }
+
+    // 1. 不加 LOCK：映射要合并的段、按快照里的删除标记去掉作废文件、写出新段
+    Archive run;
+    memset(&run, 0, sizeof(run));
+    MergedSegment merged;
+    memset(&merged, 0, sizeof(merged));
+    int missing;
+    char name[32];
+    char *path = NULL;
+    uint32_t seq = snapshot.segments[hi - 1].seq;
+    int rc = open_segments(pool, dir, snapshot.segments + lo, hi - lo, snapshot.tombstones,
+                           snapshot.tombstone_count, &run, &missing);
+    if (missing) fprintf(stderr, "错误：归档 %s 的段文件缺失\n", dir);
+    if (rc == 0 && merge_segments(&run, hi - lo, &merged) != 0) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        rc = -1;
+    }
+    if (rc == 0 && run.live > 0) {
+        // 新段要一个没用过的文件编号，序号则沿用被合并段里最大的，删除标记的作用范围不变
+        int lock = lock_dir(dir, "LOCK", 0);
+        ArchiveManifest now;
+        rc = lock < 0 ? -1 : read_manifest(dir, &now, 0);
+        if (rc == 0) {
+            segment_name(name, sizeof(name), now.next++);
+            rc = write_manifest(dir, &now);
+            manifest_free(&now);
+        }
+        if (lock >= 0) unlock_dir(lock);
+        path = rc == 0 ? join_path(dir, name) : NULL;
+        // 合并出的段按快照时冻结的权重存模长，顺带把旧段过期的模长换成新的
+        rc = path ? write_segment(path, &merged.input, &snapshot.frozen) : -1;
+    }
+    if (rc == 0) {
+        stats->merged_segments = hi - lo;
+        stats->kept = run.live;
+        stats->dropped = run.first[hi - lo] - run.live;
+    }
+    merged_free(&merged);
+    close_segments(&run, hi - lo);
+
+    // 2. 加 LOCK 换 MANIFEST，成功后旧段文件就没人引用了 (已经映射着的读者不受影响)
+    if (rc == 0) {
+        rc = commit_compaction(dir, &snapshot, lo, hi, seq, stats->kept, stats->kept ? name : NULL);
+        if (rc != 0 && path) remove(path);
+    }
+    for (size_t s = lo; rc == 0 && s < hi; s++) {
+        char *old = join_path(dir, snapshot.segments[s].file);
+        if (old) remove(old);
+        free(old);
+    }
+    if (rc != 0) memset(stats, 0, sizeof(*stats));
+    free(path);
+    manifest_free(&snapshot);
+    unlock_dir(compact_lock);
+    return rc;
+}
+
+int archive_compact(ThreadPool *pool, const char *dir, int full, ArchiveCompaction *stats) {
+    return compact(pool, dir, full, 0, stats);
+}
+
+int archive_compact_auto(ThreadPool *pool, const char *dir, ArchiveCompaction *stats) {
+    return compact(pool, dir, 0, ARCHIVE_COMPACT_TRIGGER, stats);
+}
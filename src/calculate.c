@@ -6,7 +6,7 @@ double calculate_cosine_similarity(const int *vecA,const int *vecB,int size){
     double norm_a=0.0;
     double norm_b=0.0;
     for(int i=0;i<size;i++){
-        dot_product+=vecA[i]*vecB[i];
+        dot_product+=(double)vecA[i]*vecB[i];   //大文件的计数相乘会超出 int
         norm_a+=(double)vecA[i]*vecA[i];
         norm_b+=(double)vecB[i]*vecB[i];
     }
@@ -17,4 +17,26 @@ double calculate_cosine_similarity(const int *vecA,const int *vecB,int size){
         return 0.0;
     }
     return dot_product/denominator;
-}
\ No newline at end of file
+}
+
+double calculate_vector_norm(const int *vec,int size){
+    double norm=0.0;
+    for(int i=0;i<size;i++){
+        norm+=(double)vec[i]*vec[i];
+    }
+    return sqrt(norm);
+}
+
+double calculate_cosine_similarity_normed(const int *vecA,double normA,
+                                          const int *vecB,double normB,int size){
+    //模长已经算好，这里只需要点积
+    double dot_product=0.0;
+    for(int i=0;i<size;i++){
+        dot_product+=(double)vecA[i]*vecB[i];   //大文件的计数相乘会超出 int
+    }
+    double denominator=normA*normB;
+    if(denominator==0.0){
+        return 0.0;
+    }
+    return dot_product/denominator;
+}
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "codesim.h"
+#include "preprocess.h"
+#include "vectorization.h"
+#include "calculate.h"
+
+// 头文件里的维度是写死的常量，这里确保它和特征表保持一致
+_Static_assert(CODESIM_DIMENSION == VECTOR_DIMENSION, "CODESIM_DIMENSION 与 VECTOR_DIMENSION 不一致");
+
+// 上下文创建后不再修改，所以多个线程共用一个上下文时不需要任何锁
+struct CodeSimContext {
+    CodeSimAllocator allocator;
+    int weighted;                           // 0 = 普通余弦，与命令行工具结果相同
+    double weights[CODESIM_DIMENSION];
+};
+
+static void *default_alloc(size_t size, void *user) {
+    (void)user;
+    return malloc(size);
+}
+
+static void default_release(void *ptr, void *user) {
+    (void)user;
+    free(ptr);
+}
+
+void codesim_config_init(CodeSimConfig *config) {
+    if (config == NULL) return;
+    memset(config, 0, sizeof(*config));
+    config->version = CODESIM_CONFIG_VERSION;
+}
+
+int codesim_context_create(const CodeSimConfig *config, CodeSimContext **out) {
+    if (out == NULL) return CODESIM_ERR_INVALID_ARG;
+    *out = NULL;
+
+    CodeSimConfig defaults;
+    if (config == NULL) {
+        codesim_config_init(&defaults);
+        config = &defaults;
+    }
+    if (config->version != CODESIM_CONFIG_VERSION) return CODESIM_ERR_VERSION;
+
+    // 分配函数和释放函数必须成对提供
+    CodeSimAllocator allocator = config->allocator;
+    if ((allocator.alloc == NULL) != (allocator.release == NULL)) return CODESIM_ERR_INVALID_ARG;
+    if (allocator.alloc == NULL) {
+        allocator.alloc = default_alloc;
+        allocator.release = default_release;
+        allocator.user = NULL;
+    }
+
+    if (config->feature_weights != NULL) {
+        for (int i = 0; i < CODESIM_DIMENSION; i++) {
+            double w = config->feature_weights[i];
+            if (!(w >= 0.0) || isinf(w)) return CODESIM_ERR_INVALID_ARG;
+        }
+    }
+
+    CodeSimContext *ctx = allocator.alloc(sizeof(*ctx), allocator.user);
+    if (ctx == NULL) return CODESIM_ERR_NO_MEMORY;
+
+    ctx->allocator = allocator;
+    ctx->weighted = config->feature_weights != NULL;
+    for (int i = 0; i < CODESIM_DIMENSION; i++) {
+        ctx->weights[i] = ctx->weighted ? config->feature_weights[i] : 1.0;
+    }
+
+    *out = ctx;
+    return CODESIM_OK;
+}
+
+void codesim_context_destroy(CodeSimContext *ctx) {
+    if (ctx == NULL) return;
+    CodeSimAllocator allocator = ctx->allocator;
+    allocator.release(ctx, allocator.user);
+}
+
+// 加权模长 sqrt(sum w * x^2)；不加权时直接复用 calculate_vector_norm，保证结果逐位一致
+static double vector_norm(const CodeSimContext *ctx, const int *counts) {
+    if (!ctx->weighted) return calculate_vector_norm(counts, CODESIM_DIMENSION);
+
+    double norm = 0.0;
+    for (int i = 0; i < CODESIM_DIMENSION; i++) {
+        norm += ctx->weights[i] * (double)counts[i] * counts[i];
+    }
+    return sqrt(norm);
+}
+
+static double score_vectors(const CodeSimContext *ctx, const CodeSimVector *a, const CodeSimVector *b) {
+    if (!ctx->weighted) {
+        return calculate_cosine_similarity_normed(a->counts, a->norm, b->counts, b->norm, CODESIM_DIMENSION);
+    }
+
+    double dot_product = 0.0;
+    for (int i = 0; i < CODESIM_DIMENSION; i++) {
+        dot_product += ctx->weights[i] * (double)a->counts[i] * b->counts[i];
+    }
+    double denominator = a->norm * b->norm;
+    if (denominator == 0.0) return 0.0;
+    return dot_product / denominator;
+}
+
+int codesim_vectorize_buffer(const CodeSimContext *ctx, const char *source, size_t length,
+                             CodeSimVector *out) {
+    if (ctx == NULL || out == NULL || (source == NULL && length > 0)) return CODESIM_ERR_INVALID_ARG;
+    if (length == 0) return CODESIM_ERR_EMPTY_INPUT;
+    if (length > (size_t)-1 / 2 - 1) return CODESIM_ERR_INVALID_ARG;
+
+    // 一块缓冲区同时放 "补了 '\0' 的源代码" 和预处理结果，预处理结果不会比源代码长
+    char *buffer = ctx->allocator.alloc(2 * (length + 1), ctx->allocator.user);
+    if (buffer == NULL) return CODESIM_ERR_NO_MEMORY;
+
+    char *text = buffer;
+    char *clean = buffer + length + 1;
+    memcpy(text, source, length);
+    text[length] = '\0';
+
+    preprocess_source_into(text, length, clean);
+    generate_vector(clean, out->counts);
+    out->norm = vector_norm(ctx, out->counts);
+
+    ctx->allocator.release(buffer, ctx->allocator.user);
+    return CODESIM_OK;
+}
+
+int codesim_score_pair(const CodeSimContext *ctx, const CodeSimVector *a,
+                       const CodeSimVector *b, double *score) {
+    if (ctx == NULL || a == NULL || b == NULL || score == NULL) return CODESIM_ERR_INVALID_ARG;
+    *score = score_vectors(ctx, a, b);
+    return CODESIM_OK;
+}
+
+int codesim_score_batch(const CodeSimContext *ctx, const CodeSimVector *query,
+                        const CodeSimVector *candidates, size_t count, double *scores) {
+    if (ctx == NULL || query == NULL) return CODESIM_ERR_INVALID_ARG;
+    if (count > 0 && (candidates == NULL || scores == NULL)) return CODESIM_ERR_INVALID_ARG;
+
+    for (size_t i = 0; i < count; i++) {
+        scores[i] = score_vectors(ctx, query, &candidates[i]);
+    }
+    return CODESIM_OK;
+}
+
+const char *codesim_strerror(int status) {
+    switch (status) {
+        case CODESIM_OK:              return "成功";
+        case CODESIM_ERR_INVALID_ARG: return "参数不合法";
+        case CODESIM_ERR_NO_MEMORY:   return "内存分配失败";
+        case CODESIM_ERR_EMPTY_INPUT: return "输入为空";
+        case CODESIM_ERR_VERSION:     return "配置版本不支持";
+        default:                      return "未知错误";
+    }
+}
@@ -0,0 +1,1297 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commands.h"
+#include "preprocess.h"
+#include "vectorization.h"
+#include "calculate.h"
+#include "corpus.h"
+#include "threadpool.h"
+#include "pipeline.h"
+#include "allpairs.h"
+#include "minhash.h"
+#include "sink.h"
+#include "tokenstream.h"
+#include "tfidf.h"
+#include "gst.h"
+#include "locate.h"
+#include "dedup.h"
+#include "archive.h"
+
+// 从参数里摘掉 "name value" 这一对并返回 value，没有这个选项就返回 NULL
+static const char *take_option(int *argc, char *argv[], const char *name) {
+    for (int i = 0; i + 1 < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char *value = argv[i + 1];
+            memmove(argv + i, argv + i + 2, (size_t)(*argc - i - 2) * sizeof(char*));
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// 摘掉一个不带值的开关，存在返回 1
+static int take_flag(int *argc, char *argv[], const char *name) {
+    for (int i = 0; i < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            memmove(argv + i, argv + i + 1, (size_t)(*argc - i - 1) * sizeof(char*));
+            *argc -= 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 所有子命令都认 --threads N，不写就用全部 CPU 核
+static ThreadPool *create_pool(int *argc, char *argv[]) {
+    const char *threads = take_option(argc, argv, "--threads");
+    ThreadPool *pool = threadpool_create(threads ? atoi(threads) : 0);
+    if (!pool) fprintf(stderr, "错误：无法创建线程池\n");
+    return pool;
+}
+
+// --tfidf 开关：加载语料库的 TF-IDF 模型，没开时 *out 为 NULL
+static int load_weighting(ThreadPool *pool, const Corpus *corpus, int enabled,
+                          TfIdfModel *model, const TfIdfModel **out) {
+    *out = NULL;
+    if (!enabled) return 0;
+    if (tfidf_model_load(pool, corpus, model) != 0) return -1;
+    *out = model;
+    return 0;
+}
+
+// 可以自动扩容的路径列表
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+static int path_list_push(PathList *list, const char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **items = (char**)realloc(list->items, capacity * sizeof(char*));
+        if (!items) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    list->items[list->count++] = copy;
+    return 0;
+}
+
+static void path_list_free(PathList *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->items[i]);
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+// 收集命令行里的路径；"-" 表示从标准输入每行读一个路径(文件多到命令行放不下时用)
+static int collect_paths(int argc, char *argv[], PathList *list) {
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-") != 0) {
+            if (path_list_push(list, argv[i]) != 0) return -1;
+            continue;
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin)) {
+            size_t len = strlen(line);
+            while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+            if (len == 0) continue;
+            if (path_list_push(list, line) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+// 把各文件的 token 流首尾相接成一块，offsets 返回 count + 1 个偏移
+static unsigned char *concat_token_streams(const TokenStream *streams, size_t count, uint64_t **offsets) {
+    *offsets = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
+    if (!*offsets) return NULL;
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        (*offsets)[i] = total;
+        total += streams[i].size;
+    }
+    (*offsets)[count] = total;
+
+    unsigned char *data = (unsigned char*)malloc(total ? (size_t)total : 1);
+    if (!data) {
+        free(*offsets);
+        *offsets = NULL;
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (streams[i].size) memcpy(data + (*offsets)[i], streams[i].data, streams[i].size);
+    }
+    return data;
+}
+
+// 统计文档频率、算好加权模长，挂到要写出的语料库上 (*norms 由调用者 free)
+static int attach_tfidf(ThreadPool *pool, const int *vectors, size_t count,
+                        DfTable *df, double **norms, CorpusInput *input) {
+    *norms = (double*)malloc((count ? count : 1) * sizeof(double));
+    if (!*norms) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    TfIdfWeights weights;
+    df_table_build(pool, vectors, count, df);
+    tfidf_weights(df, &weights);
+    tfidf_norms_build(pool, &weights, vectors, count, *norms);
+    input->df_table = (const uint64_t*)df;
+    input->tfidf_norms = *norms;
+    return 0;
+}
+
+// 一批源文件的向量化结果：处理失败的文件已经跳过，保留输入顺序
+typedef struct {
+    int *vectors;
+    const char **kept;                 // 指向 PathList 里的路径
+    size_t count;
+    MinHashSignature *signatures;      // --minhash 时非 NULL
+    TokenStream *tokens;               // --tokens 时非 NULL
+    uint64_t *content_hashes;
+} VectorBatch;
+
+static void vector_batch_free(VectorBatch *batch) {
+    for (size_t i = 0; batch->tokens && i < batch->count; i++) free(batch->tokens[i].data);
+    free(batch->vectors);
+    free(batch->kept);
+    free(batch->signatures);
+    free(batch->tokens);
+    free(batch->content_hashes);
+    memset(batch, 0, sizeof(*batch));
+}
+
+static int vectorize_batch(ThreadPool *pool, const PathList *inputs, int in_flight,
+                           int with_minhash, int with_tokens, VectorBatch *batch) {
+    memset(batch, 0, sizeof(*batch));
+    size_t slots = inputs->count ? inputs->count : 1;
+    batch->vectors = (int*)malloc(slots * VECTOR_DIMENSION * sizeof(int));
+    int *ok = (int*)malloc(slots * sizeof(int));
+    batch->kept = (const char**)malloc(slots * sizeof(char*));
+    batch->signatures = with_minhash
+        ? (MinHashSignature*)malloc(slots * sizeof(MinHashSignature))
+        : NULL;
+    batch->tokens = with_tokens ? (TokenStream*)calloc(slots, sizeof(TokenStream)) : NULL;
+    batch->content_hashes = (uint64_t*)malloc(slots * sizeof(uint64_t));
+    if (!batch->vectors || !ok || !batch->kept || !batch->content_hashes ||
+        (with_minhash && !batch->signatures) || (with_tokens && !batch->tokens)) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(ok);
+        vector_batch_free(batch);
+        return -1;
+    }
+
+    PipelineOutput out = { batch->vectors, ok, batch->signatures, batch->tokens, batch->content_hashes };
+    pipeline_vectorize_files(pool, (const char *const *)inputs->items, inputs->count, in_flight, &out);
+
+    // 处理失败的文件(打不开、空文件)跳过，不影响其他文件；保留输入顺序
+    size_t count = 0;
+    for (size_t i = 0; i < inputs->count; i++) {
+        if (!ok[i]) {
+            fprintf(stderr, "警告：跳过文件 '%s'\n", inputs->items[i]);
+            if (batch->tokens) free(batch->tokens[i].data);
+            continue;
+        }
+        if (count != i) {
+            memcpy(batch->vectors + count * VECTOR_DIMENSION, batch->vectors + i * VECTOR_DIMENSION,
+                   VECTOR_DIMENSION * sizeof(int));
+            if (batch->signatures) batch->signatures[count] = batch->signatures[i];
+            if (batch->tokens) batch->tokens[count] = batch->tokens[i];
+            batch->content_hashes[count] = batch->content_hashes[i];
+        }
+        batch->kept[count++] = inputs->items[i];
+    }
+    batch->count = count;
+    free(ok);
+    return 0;
+}
+
+// 把一批向量化结果挂到要写出的语料库上；有 token 流时拼成一块 (*token_offsets / *token_data 由调用者 free)
+static int batch_corpus_input(const VectorBatch *batch, CorpusInput *input,
+                              uint64_t **token_offsets, unsigned char **token_data) {
+    CorpusInput in = { batch->kept, batch->vectors, batch->count, VECTOR_DIMENSION, batch->signatures,
+                       NULL, NULL, NULL, NULL, batch->content_hashes };
+    *input = in;
+    *token_offsets = NULL;
+    *token_data = NULL;
+    if (!batch->tokens) return 0;
+    *token_data = concat_token_streams(batch->tokens, batch->count, token_offsets);
+    if (!*token_data) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    input->token_offsets = *token_offsets;
+    input->token_data = *token_data;
+    return 0;
+}
+
+int cmd_build_corpus(int argc, char *argv[]) {
+    const char *in_flight = take_option(&argc, argv, "--in-flight");
+    int with_minhash = take_flag(&argc, argv, "--minhash");
+    int with_tokens = take_flag(&argc, argv, "--tokens");
+    int with_tfidf = take_flag(&argc, argv, "--tfidf");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc < 2) {
+        fprintf(stderr, "用法: --build-corpus <输出文件> <源文件...> [--minhash] [--tokens] [--tfidf] [--threads N] [--in-flight N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    const char *out_path = argv[0];
+
+    PathList inputs = {0};
+    if (collect_paths(argc - 1, argv + 1, &inputs) != 0) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        path_list_free(&inputs);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    VectorBatch batch;
+    if (vectorize_batch(pool, &inputs, in_flight ? atoi(in_flight) : 0, with_minhash, with_tokens, &batch) != 0) {
+        path_list_free(&inputs);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    CorpusInput input;
+    uint64_t *token_offsets = NULL;
+    unsigned char *token_data = NULL;
+    DfTable df;
+    double *tfidf_norms = NULL;
+    int rc = batch_corpus_input(&batch, &input, &token_offsets, &token_data);
+    if (rc == 0 && with_tfidf) rc = attach_tfidf(pool, batch.vectors, batch.count, &df, &tfidf_norms, &input);
+    if (rc == 0) rc = corpus_write(out_path, &input);
+    if (rc == 0) {
+        printf("已写入语料库 %s：%zu 个文件\n", out_path, batch.count);
+    }
+
+    free(tfidf_norms);
+    free(token_offsets);
+    free(token_data);
+    vector_batch_free(&batch);
+    path_list_free(&inputs);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+// 从 token 流缓存重算的共享参数
+typedef struct {
+    const Corpus *corpus;
+    const int *feature_map;
+    int *vectors;
+    MinHashSignature *signatures;   // 可选
+    int *failed;                    // 每个文件一项，解码失败置 1
+} RescoreJob;
+
+static void rescore_range(size_t begin, size_t end, void *ctx) {
+    RescoreJob *job = (RescoreJob*)ctx;
+    const Corpus *corpus = job->corpus;
+    for (size_t i = begin; i < end; i++) {
+        uint16_t *ids;
+        size_t count;
+        uint64_t start = corpus->token_offsets[i];
+        if (token_stream_decode(corpus->token_data + start, (size_t)(corpus->token_offsets[i + 1] - start),
+                                &ids, &count) != 0) {
+            job->failed[i] = 1;
+            continue;
+        }
+        generate_vector_from_ids(ids, count, job->feature_map, job->vectors + i * VECTOR_DIMENSION);
+        if (job->signatures) minhash_compute_ids(ids, count, &job->signatures[i]);
+        free(ids);
+    }
+}
+
+int cmd_rescore_corpus(int argc, char *argv[]) {
+    int with_minhash = take_flag(&argc, argv, "--minhash");
+    int with_tfidf = take_flag(&argc, argv, "--tfidf");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc != 2) {
+        fprintf(stderr, "用法: --rescore-corpus <旧语料库文件> <新语料库文件> [--minhash] [--tfidf] [--threads N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    // 旧文件是映射进来的，直接覆盖它会把正在读的内存截断
+    if (strcmp(argv[0], argv[1]) == 0) {
+        fprintf(stderr, "错误：新语料库文件不能与旧文件相同\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    Corpus corpus;
+    if (corpus_open_flags(argv[0], &corpus, CORPUS_OPEN_STALE) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    int feature_map[TOKEN_ID_COUNT];
+    int missing = build_feature_id_map(feature_map);
+    if (!corpus.token_offsets) {
+        fprintf(stderr, "错误：语料库没有可用的 token 流缓存，请用 --build-corpus ... --tokens 重新生成\n");
+    } else if (missing > 0) {
+        fprintf(stderr, "错误：特征表里有 %d 个特征无法由 token 编号得到，只能从源文件重新生成\n", missing);
+    }
+    if (!corpus.token_offsets || missing > 0) {
+        corpus_close(&corpus);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    size_t count = (size_t)corpus.count;
+    size_t slots = count ? count : 1;
+    int *vectors = (int*)malloc(slots * VECTOR_DIMENSION * sizeof(int));
+    int *failed = (int*)calloc(slots, sizeof(int));
+    const char **paths = (const char**)malloc(slots * sizeof(char*));
+    MinHashSignature *signatures = with_minhash
+        ? (MinHashSignature*)malloc(slots * sizeof(MinHashSignature))
+        : NULL;
+    double *tfidf_norms = NULL;
+    int rc = -1;
+    if (!vectors || !failed || !paths || (with_minhash && !signatures)) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto cleanup;
+    }
+
+    // 1. 并行解码 + 重算，不碰源文件
+    RescoreJob job = { &corpus, feature_map, vectors, signatures, failed };
+    threadpool_parallel_for(pool, 0, count, 256, rescore_range, &job);
+    for (size_t i = 0; i < count; i++) {
+        if (failed[i]) {
+            fprintf(stderr, "错误：'%s' 的 token 流缓存已损坏\n", corpus_path(&corpus, i));
+            goto cleanup;
+        }
+        paths[i] = corpus_path(&corpus, i);
+    }
+
+    // 2. 写新语料库，token 流原样带过去，下次改配置还能再用
+    CorpusInput input = { paths, vectors, count, VECTOR_DIMENSION, signatures,
+                          corpus.token_offsets, corpus.token_data, NULL, NULL, corpus.content_hashes };
+    DfTable df;
+    if (with_tfidf && attach_tfidf(pool, vectors, count, &df, &tfidf_norms, &input) != 0) goto cleanup;
+    rc = corpus_write(argv[1], &input);
+    if (rc == 0) {
+        printf("已从 token 流缓存重新生成语料库 %s：%zu 个文件\n", argv[1], count);
+    }
+
+cleanup:
+    free(tfidf_norms);
+    free(vectors);
+    free(failed);
+    free(paths);
+    free(signatures);
+    corpus_close(&corpus);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+// 查询结果：语料库下标 + 得分
+typedef struct {
+    size_t index;
+    double score;
+} Match;
+
+// 得分高的排前面，同分按下标排，保证输出稳定
+static int compare_match(const void *a, const void *b) {
+    const Match *x = (const Match*)a;
+    const Match *y = (const Match*)b;
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// 把 m 插进按得分排好序、最多 top_k 项的数组 best
+static void keep_top_k(Match *best, size_t *kept, size_t top_k, Match m) {
+    if (top_k == 0) return;
+    if (*kept == top_k && compare_match(&m, &best[*kept - 1]) >= 0) return;
+    size_t j = *kept < top_k ? (*kept)++ : *kept - 1;
+    while (j > 0 && compare_match(&m, &best[j - 1]) < 0) {
+        best[j] = best[j - 1];
+        j--;
+    }
+    best[j] = m;
+}
+
+// 查询文件与语料库第 idx 个文件的余弦得分；tfidf 不为 NULL 时 norm 是加权模长
+static double score_against(const Corpus *corpus, const TfIdfModel *tfidf,
+                            const int vector[], double norm, size_t idx) {
+    if (tfidf) {
+        return tfidf_cosine(&tfidf->weights, vector, norm, corpus_vector(corpus, idx), tfidf->norms[idx]);
+    }
+    return calculate_cosine_similarity_normed(vector, norm, corpus_vector(corpus, idx),
+                                              corpus->norms[idx], VECTOR_DIMENSION);
+}
+
+static double query_norm(const TfIdfModel *tfidf, const int vector[]) {
+    return tfidf ? tfidf_norm(&tfidf->weights, vector) : calculate_vector_norm(vector, VECTOR_DIMENSION);
+}
+
+// 语料库第 idx 个文件的 token 编号序列：优先用 token 流缓存，没有缓存就重新读源文件
+static int corpus_file_tokens(const Corpus *corpus, size_t idx, uint16_t **ids, size_t *count) {
+    if (corpus->token_offsets) {
+        uint64_t start = corpus->token_offsets[idx];
+        return token_stream_decode(corpus->token_data + start,
+                                   (size_t)(corpus->token_offsets[idx + 1] - start), ids, count);
+    }
+    char *clean_code = preprocess_file(corpus_path(corpus, idx));
+    if (!clean_code) return -1;
+    int rc = token_stream_collect(clean_code, ids, count);
+    free(clean_code);
+    return rc;
+}
+
+// --gst：对排名靠前的每个文件和查询文件做贪心串覆盖；--locate 另外给出每段匹配的行号
+typedef struct {
+    double *coverage;           // 每个名次一项，-1 表示这个文件取不到 token 序列
+    MatchRegion **regions;      // --locate 时每个名次的匹配片段，否则为 NULL
+    size_t *region_counts;
+} GstReport;
+
+typedef struct {
+    const Corpus *corpus;
+    const uint16_t *query_ids;
+    size_t query_count;
+    const LocatedTokens *query_loc;   // --locate 时非 NULL，这时要重新读源文件拿位置
+    const Match *best;
+    GstReport *report;
+} GstJob;
+
+static void gst_locate_one(GstJob *job, size_t i) {
+    LocatedTokens loc;
+    GstResult result;
+    if (located_tokens_load(corpus_path(job->corpus, job->best[i].index), &loc) != 0) return;
+    if (gst_compare(job->query_loc->ids, job->query_loc->count, loc.ids, loc.count, GST_MIN_MATCH, &result) == 0) {
+        if (locate_matches(job->query_loc, &loc, &result,
+                           &job->report->regions[i], &job->report->region_counts[i]) == 0) {
+            job->report->coverage[i] = result.coverage;
+        }
+        gst_result_free(&result);
+    }
+    located_tokens_free(&loc);
+}
+
+static void gst_range(size_t begin, size_t end, void *ctx) {
+    GstJob *job = (GstJob*)ctx;
+    for (size_t i = begin; i < end; i++) {
+        job->report->coverage[i] = -1.0;
+        if (job->query_loc) {
+            gst_locate_one(job, i);
+            continue;
+        }
+        uint16_t *ids;
+        size_t count;
+        GstResult result;
+        if (corpus_file_tokens(job->corpus, job->best[i].index, &ids, &count) != 0) continue;
+        if (gst_compare(job->query_ids, job->query_count, ids, count, GST_MIN_MATCH, &result) == 0) {
+            job->report->coverage[i] = result.coverage;
+            gst_result_free(&result);
+        }
+        free(ids);
+    }
+}
+
+static void gst_report_free(GstReport *report, size_t kept) {
+    for (size_t i = 0; report->regions && i < kept; i++) free(report->regions[i]);
+    free(report->regions);
+    free(report->region_counts);
+    free(report->coverage);
+    memset(report, 0, sizeof(*report));
+}
+
+// 对前 kept 名做贪心串覆盖。查询文件本身处理失败时返回 -1，report 保持为空 (不输出覆盖率)
+static int gst_report_build(ThreadPool *pool, const Corpus *corpus, const char *query_path, int locate,
+                            const Match *best, size_t kept, GstReport *report) {
+    memset(report, 0, sizeof(*report));
+    size_t n = kept ? kept : 1;
+    report->coverage = (double*)malloc(n * sizeof(double));
+    if (locate) {
+        report->regions = (MatchRegion**)calloc(n, sizeof(MatchRegion*));
+        report->region_counts = (size_t*)calloc(n, sizeof(size_t));
+    }
+    if (!report->coverage || (locate && (!report->regions || !report->region_counts))) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        gst_report_free(report, kept);
+        return -1;
+    }
+
+    GstJob job = { corpus, NULL, 0, NULL, best, report };
+    LocatedTokens query_loc;
+    uint16_t *ids = NULL;
+    if (locate) {
+        if (located_tokens_load(query_path, &query_loc) != 0) {
+            gst_report_free(report, kept);
+            return -1;
+        }
+        job.query_loc = &query_loc;
+    } else {
+        char *clean_code = preprocess_file(query_path);
+        if (!clean_code || token_stream_collect(clean_code, &ids, &job.query_count) != 0) {
+            free(clean_code);
+            gst_report_free(report, kept);
+            return -1;
+        }
+        free(clean_code);
+        job.query_ids = ids;
+    }
+
+    // 每一对的开销差别很大，一对一个任务
+    threadpool_parallel_for(pool, 0, kept, 1, gst_range, &job);
+
+    if (locate) located_tokens_free(&query_loc);
+    free(ids);
+    return 0;
+}
+
+static void print_coverage(const GstReport *report, size_t i) {
+    if (!report->coverage) return;
+    if (report->coverage[i] < 0) printf("  %7s", "-");
+    else printf("  %6.2f%%", report->coverage[i] * 100.0);
+}
+
+// 匹配片段单独成行，缩进在结果行下面：左边是查询文件的行号，右边是语料库文件的行号
+static void print_regions(const GstReport *report, size_t i) {
+    if (!report->regions) return;
+    for (size_t r = 0; r < report->region_counts[i]; r++) {
+        const MatchRegion *m = &report->regions[i][r];
+        printf("        %zu-%zu  <->  %zu-%zu  (%zu 个 token)\n",
+               m->a_first, m->a_last, m->b_first, m->b_last, m->tokens);
+    }
+}
+
+// MinHash 查询：先用 LSH 桶取候选，只对候选计算 Jaccard 估计，按 Jaccard 排名。
+// gst_query 不为 NULL 时再对前 k 名做贪心串覆盖 (locate 为 1 时同时定位匹配片段)
+static int query_minhash(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf, const int vector[],
+                         const MinHashSignature *sig, size_t top_k, const char *gst_query, int locate) {
+    uint32_t *candidates = NULL;
+    size_t count = 0;
+    if (corpus_lsh_candidates(corpus, sig, &candidates, &count) != 0) {
+        fprintf(stderr, "错误：语料库没有 MinHash 索引，请用 --build-corpus ... --minhash 重新生成\n");
+        return 1;
+    }
+    Match *best = (Match*)malloc((top_k ? top_k : 1) * sizeof(Match));
+    if (!best) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(candidates);
+        return 1;
+    }
+    size_t kept = 0;
+    for (size_t c = 0; c < count; c++) {
+        Match m = { candidates[c], minhash_jaccard(sig, &corpus->signatures[candidates[c]]) };
+        keep_top_k(best, &kept, top_k, m);
+    }
+
+    double norm = query_norm(tfidf, vector);
+    GstReport report = { NULL, NULL, NULL };
+    if (gst_query) gst_report_build(pool, corpus, gst_query, locate, best, kept, &report);
+    printf("LSH 候选 %zu / %llu 个文件，Jaccard 最高的 %zu 个：\n", count,
+           (unsigned long long)corpus->count, kept);
+    printf(report.coverage ? "  Jaccard  余弦    GST 覆盖  文件\n" : "  Jaccard  余弦    文件\n");
+    for (size_t i = 0; i < kept; i++) {
+        size_t idx = best[i].index;
+        double cosine = score_against(corpus, tfidf, vector, norm, idx);
+        printf("  %.4f   %.4f", best[i].score, cosine);
+        print_coverage(&report, i);
+        printf("  %s\n", corpus_path(corpus, idx));
+        print_regions(&report, i);
+    }
+    gst_report_free(&report, kept);
+    free(best);
+    free(candidates);
+    return 0;
+}
+
+// 一对多打分的共享参数
+typedef struct {
+    const Corpus *corpus;
+    const TfIdfModel *tfidf;
+    const int *vector;
+    double norm;
+    double *scores;
+} QueryJob;
+
+static void score_query_range(size_t begin, size_t end, void *ctx) {
+    QueryJob *job = (QueryJob*)ctx;
+    for (size_t i = begin; i < end; i++) {
+        job->scores[i] = score_against(job->corpus, job->tfidf, job->vector, job->norm, i);
+    }
+}
+
+int cmd_query(int argc, char *argv[]) {
+    int with_minhash = take_flag(&argc, argv, "--minhash");
+    int with_tfidf = take_flag(&argc, argv, "--tfidf");
+    int with_gst = take_flag(&argc, argv, "--gst");
+    int with_locate = take_flag(&argc, argv, "--locate");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "用法: --query <语料库文件> <源文件> [前 k 名] [--minhash] [--tfidf] [--gst] [--locate] [--threads N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    size_t top_k = argc == 3 ? (size_t)strtoul(argv[2], NULL, 10) : 10;
+
+    int vector[VECTOR_DIMENSION];
+    MinHashSignature sig;
+    if (pipeline_vectorize_file(pool, argv[1], vector, with_minhash ? &sig : NULL) != 0) {
+        fprintf(stderr, "错误: 无法预处理文件 '%s'。\n", argv[1]);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    Corpus corpus;
+    TfIdfModel model;
+    const TfIdfModel *tfidf;
+    if (corpus_open(argv[0], &corpus) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    if (load_weighting(pool, &corpus, with_tfidf, &model, &tfidf) != 0) {
+        corpus_close(&corpus);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    if (with_minhash) {
+        int rc = query_minhash(pool, &corpus, tfidf, vector, &sig, top_k,
+                               with_gst || with_locate ? argv[1] : NULL, with_locate);
+        if (tfidf) tfidf_model_free(&model);
+        corpus_close(&corpus);
+        threadpool_destroy(pool);
+        return rc;
+    }
+
+    Match *best = (Match*)malloc((top_k ? top_k : 1) * sizeof(Match));
+    double *scores = (double*)malloc((corpus.count ? corpus.count : 1) * sizeof(double));
+    if (!best || !scores) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(best);
+        free(scores);
+        if (tfidf) tfidf_model_free(&model);
+        corpus_close(&corpus);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    // 1. 并行打分
+    QueryJob job = { &corpus, tfidf, vector, query_norm(tfidf, vector), scores };
+    threadpool_parallel_for(pool, 0, corpus.count, 4096, score_query_range, &job);
+
+    // 2. 只保留前 k 名：用一个按得分排好序的小数组做插入
+    size_t kept = 0;
+    for (size_t i = 0; i < corpus.count && top_k > 0; i++) {
+        Match m = { i, scores[i] };
+        keep_top_k(best, &kept, top_k, m);
+    }
+
+    // 3. 可选：对前 k 名做贪心串覆盖，找出成段相同的代码 (--locate 还给出行号)
+    GstReport report = { NULL, NULL, NULL };
+    if (with_gst || with_locate) gst_report_build(pool, &corpus, argv[1], with_locate, best, kept, &report);
+
+    printf("与 %s 最相似的 %zu 个文件：\n", argv[1], kept);
+    if (report.coverage) printf("  余弦    GST 覆盖  文件\n");
+    for (size_t i = 0; i < kept; i++) {
+        printf("  %.4f", best[i].score);
+        print_coverage(&report, i);
+        printf("  %s\n", corpus_path(&corpus, best[i].index));
+        print_regions(&report, i);
+    }
+
+    gst_report_free(&report, kept);
+    free(best);
+    free(scores);
+    if (tfidf) tfidf_model_free(&model);
+    corpus_close(&corpus);
+    threadpool_destroy(pool);
+    return 0;
+}
+
+// 输出选项：--format text|csv|jsonl|binary、--output 文件 (默认标准输出)
+typedef struct {
+    SinkFormat format;
+    const char *path;
+} OutputOptions;
+
+static int take_output_options(int *argc, char *argv[], OutputOptions *options) {
+    const char *format = take_option(argc, argv, "--format");
+    options->path = take_option(argc, argv, "--output");
+    options->format = SINK_FORMAT_TEXT;
+    return format ? sink_parse_format(format, &options->format) : 0;
+}
+
+// 分片合并按 (a, b) 顺序逐条交给输出器；与 --all-pairs 走同一个格式化，保证输出逐字节相同
+static void emit_pair(const PairResult *pair, void *ctx) {
+    result_sink_emit((ResultSink*)ctx, -1, pair->a, pair->b, pair->score);
+}
+
+int cmd_all_pairs(int argc, char *argv[]) {
+    OutputOptions output;
+    int bad_format = take_output_options(&argc, argv, &output) != 0;
+    int stream = take_flag(&argc, argv, "--stream");
+    int with_tfidf = take_flag(&argc, argv, "--tfidf");
+    int dedup = take_flag(&argc, argv, "--dedup");
+    int with_locate = take_flag(&argc, argv, "--locate");
+    const char *memory = take_option(&argc, argv, "--memory");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (bad_format || argc < 1 || argc > 2 || (memory && (stream || atoll(memory) <= 0)) ||
+        (dedup && (stream || memory)) || (with_locate && (memory || output.format == SINK_FORMAT_BINARY))) {
+        // 定位要把每个文件的 token 位置缓存到结束，这部分内存不在预算之内
+        if (with_locate && memory) fprintf(stderr, "错误：--locate 的位置缓存不受内存预算限制，不能和 --memory 一起用\n");
+        fprintf(stderr, "用法: --all-pairs <语料库文件> [阈值] [--format text|csv|jsonl|binary] [--output 文件] [--stream | --memory MB | --dedup] [--tfidf] [--locate] [--threads N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    double threshold = argc == 2 ? atof(argv[1]) : 0.9;
+
+    Corpus corpus;
+    if (corpus_open(argv[0], &corpus) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    TfIdfModel model;
+    const TfIdfModel *tfidf;
+    if (load_weighting(pool, &corpus, with_tfidf, &model, &tfidf) != 0) {
+        corpus_close(&corpus);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    ResultSink *sink = result_sink_open(output.path, output.format, &corpus, threshold, threadpool_size(pool));
+    if (sink && with_locate && result_sink_enable_locate(sink, pool) != 0) {
+        result_sink_close(sink);
+        sink = NULL;
+    }
+    if (!sink) {
+        if (tfidf) tfidf_model_free(&model);
+        corpus_close(&corpus);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    int rc;
+    if (stream) {
+        // 各线程边算边写，不排序
+        rc = allpairs_stream(pool, &corpus, tfidf, 0, corpus.count, 0, corpus.count, threshold, sink);
+    } else if (memory) {
+        // 按内存预算分块计算，结果溢写到临时文件再归并
+        size_t budget = (size_t)atoll(memory) * 1024 * 1024;
+        rc = allpairs_bounded(pool, &corpus, tfidf, threshold, budget, sink);
+    } else if (dedup) {
+        // 向量相同的文件归成一类，只比较各类代表，再展开成文件对
+        DedupClasses classes;
+        PairList pairs;
+        rc = dedup_build(pool, &corpus, &classes);
+        if (rc == 0) {
+            fprintf(stderr, "去重：%llu 个文件归为 %zu 类", (unsigned long long)corpus.count, classes.class_count);
+            if (corpus.content_hashes) fprintf(stderr, " (其中 %zu 个文件预处理后完全相同)", classes.exact_duplicates);
+            fprintf(stderr, "\n");
+            rc = allpairs_dedup(pool, &corpus, tfidf, &classes, threshold, &pairs);
+            dedup_free(&classes);
+        }
+        if (rc == 0) {
+            for (size_t i = 0; i < pairs.count; i++) emit_pair(&pairs.items[i], sink);
+            pair_list_free(&pairs);
+        }
+    } else {
+        PairList pairs;
+        rc = allpairs_score(pool, &corpus, tfidf, 0, corpus.count, 0, corpus.count, threshold, &pairs);
+        if (rc == 0) {
+            for (size_t i = 0; i < pairs.count; i++) emit_pair(&pairs.items[i], sink);
+            pair_list_free(&pairs);
+        }
+    }
+    if (result_sink_close(sink) != 0) rc = -1;
+
+    if (tfidf) tfidf_model_free(&model);
+    corpus_close(&corpus);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+int cmd_shard_plan(int argc, char *argv[]) {
+    if (argc != 2 || atoll(argv[1]) <= 0) {
+        fprintf(stderr, "用法: --shard-plan <语料库文件> <块大小>\n");
+        return 1;
+    }
+    Corpus corpus;
+    if (corpus_open(argv[0], &corpus) != 0) return 1;
+
+    // 每行一个分片：行块:列块:块大小，只列出上三角 (行块 <= 列块)
+    unsigned long long block_size = (unsigned long long)atoll(argv[1]);
+    unsigned long long blocks = (corpus.count + block_size - 1) / block_size;
+    for (unsigned long long r = 0; r < blocks; r++) {
+        for (unsigned long long c = r; c < blocks; c++) {
+            printf("%llu:%llu:%llu\n", r, c, block_size);
+        }
+    }
+    corpus_close(&corpus);
+    return 0;
+}
+
+int cmd_run_shard(int argc, char *argv[]) {
+    int with_tfidf = take_flag(&argc, argv, "--tfidf");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    ShardSpec spec;
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "用法: --run-shard <语料库文件> <行块:列块:块大小> <部分结果文件> [阈值] [--tfidf] [--threads N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    if (shard_parse(argv[1], &spec) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    double threshold = argc == 4 ? atof(argv[3]) : 0.9;
+
+    Corpus corpus;
+    if (corpus_open(argv[0], &corpus) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    TfIdfModel model;
+    const TfIdfModel *tfidf;
+    int rc = load_weighting(pool, &corpus, with_tfidf, &model, &tfidf);
+    if (rc == 0) rc = shard_run(pool, &corpus, tfidf, &spec, threshold, argv[2]);
+    if (tfidf) tfidf_model_free(&model);
+    corpus_close(&corpus);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+int cmd_merge_shards(int argc, char *argv[]) {
+    OutputOptions output;
+    int bad_format = take_output_options(&argc, argv, &output) != 0;
+    const char *min_score = take_option(&argc, argv, "--min-score");
+    if (bad_format || argc < 2) {
+        fprintf(stderr, "用法: --merge-shards <语料库文件> <部分结果文件...> [--min-score 阈值] [--format 格式] [--output 文件]\n");
+        return 1;
+    }
+    Corpus corpus;
+    if (corpus_open(argv[0], &corpus) != 0) return 1;
+    // 合并时还可以用 --min-score 把阈值再调高
+    ResultSink *sink = result_sink_open(output.path, output.format, &corpus,
+                                        min_score ? atof(min_score) : -1.0, 0);
+    if (!sink) {
+        corpus_close(&corpus);
+        return 1;
+    }
+    int rc = shard_merge(&corpus, (const char *const *)(argv + 1), (size_t)(argc - 1), emit_pair, sink);
+    if (result_sink_close(sink) != 0) rc = -1;
+    corpus_close(&corpus);
+    return rc == 0 ? 0 : 1;
+}
+
+// 文件对列表里的一个端点：路径 + 在列表里第几次出现 (pair * 2 + 0/1)
+typedef struct {
+    const char *path;
+    size_t index;
+} PairEndpoint;
+
+static int compare_endpoint(const void *a, const void *b) {
+    const PairEndpoint *x = (const PairEndpoint*)a;
+    const PairEndpoint *y = (const PairEndpoint*)b;
+    int c = strcmp(x->path, y->path);
+    if (c != 0) return c;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// 读文件对列表：每行两个路径，有制表符时按制表符分开 (路径里可以有空格)，否则按空白分开。
+// 空行和 # 开头的行跳过。端点依次放进 endpoints (第 k 对是第 2k、2k + 1 项)
+static int read_pair_list(FILE *file, const char *name, PathList *endpoints) {
+    char *line = NULL;
+    size_t size = 0;
+    size_t line_no = 0;
+    int rc = 0;
+    while (rc == 0 && getline(&line, &size, file) != -1) {
+        line_no++;
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+
+        char *a = line, *b = NULL;
+        char *tab = strchr(line, '\t');
+        if (tab) {
+            *tab = '\0';
+            b = tab + 1;
+        } else {
+            a = strtok(line, " ");
+            b = a ? strtok(NULL, " ") : NULL;
+            if (b && strtok(NULL, " ")) b = NULL;
+        }
+        if (!a || !b || !*a || !*b || strchr(b, '\t')) {
+            fprintf(stderr, "错误：%s 第 %zu 行不是两个路径\n", name, line_no);
+            rc = -1;
+        } else if (path_list_push(endpoints, a) != 0 || path_list_push(endpoints, b) != 0) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        }
+    }
+    free(line);
+    return rc;
+}
+
+// 文件对按输入顺序分块打分，每块打完就输出，结果不用全部攒在内存里
+#define PAIRS_EMIT_BLOCK 65536
+
+typedef struct {
+    const int *vectors;
+    const double *norms;
+    const int *ok;
+    const size_t *file_of;          // 端点 -> 文件编号
+    size_t base;                    // 这一块第一对的编号
+    double *scores;                 // 这一块每对一项
+} PairJob;
+
+static void score_pair_range(size_t begin, size_t end, void *ctx) {
+    PairJob *job = (PairJob*)ctx;
+    for (size_t i = begin; i < end; i++) {
+        size_t a = job->file_of[2 * i], b = job->file_of[2 * i + 1];
+        if (!job->ok[a] || !job->ok[b]) continue;   // 输出时同样按 ok 跳过
+        job->scores[i - job->base] = calculate_cosine_similarity_normed(
+            job->vectors + a * VECTOR_DIMENSION, job->norms[a],
+            job->vectors + b * VECTOR_DIMENSION, job->norms[b], VECTOR_DIMENSION);
+    }
+}
+
+int cmd_pairs(int argc, char *argv[]) {
+    OutputOptions output;
+    int bad_format = take_output_options(&argc, argv, &output) != 0;
+    const char *min_score = take_option(&argc, argv, "--min-score");
+    const char *in_flight = take_option(&argc, argv, "--in-flight");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (bad_format || argc > 1 || output.format == SINK_FORMAT_BINARY) {
+        fprintf(stderr, "用法: --pairs [文件对列表|-] [--min-score 阈值] [--format text|csv|jsonl] [--output 文件] [--threads N] [--in-flight N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    // 1. 读入全部文件对
+    const char *list_path = argc == 1 ? argv[0] : "-";
+    FILE *file = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (!file) {
+        fprintf(stderr, "错误：无法打开文件对列表 %s\n", list_path);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    PathList endpoints = {0};
+    int rc = read_pair_list(file, file == stdin ? "标准输入" : list_path, &endpoints);
+    if (file != stdin) fclose(file);
+    size_t pair_count = endpoints.count / 2;
+
+    // 2. 路径去重：排序后相同的路径挨在一起，按第一次出现的先后编号
+    PairEndpoint *sorted = (PairEndpoint*)malloc((endpoints.count ? endpoints.count : 1) * sizeof(PairEndpoint));
+    size_t *file_of = (size_t*)malloc((endpoints.count ? endpoints.count : 1) * sizeof(size_t));
+    const char **files = (const char**)malloc((endpoints.count ? endpoints.count : 1) * sizeof(char*));
+    size_t file_count = 0;
+    if (rc == 0 && (!sorted || !file_of || !files)) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        rc = -1;
+    }
+    if (rc == 0) {
+        for (size_t i = 0; i < endpoints.count; i++) {
+            sorted[i].path = endpoints.items[i];
+            sorted[i].index = i;
+        }
+        qsort(sorted, endpoints.count, sizeof(PairEndpoint), compare_endpoint);
+        // file_of 先记每个端点所在组的第一次出现，再按出现顺序换成文件编号
+        for (size_t i = 0, first = 0; i < endpoints.count; i++) {
+            if (i == 0 || strcmp(sorted[i].path, sorted[i - 1].path) != 0) first = sorted[i].index;
+            file_of[sorted[i].index] = first;
+        }
+        for (size_t i = 0; i < endpoints.count; i++) {
+            if (file_of[i] == i) {
+                files[file_count] = endpoints.items[i];
+                file_of[i] = file_count++;
+            } else {
+                file_of[i] = file_of[file_of[i]];
+            }
+        }
+    }
+    free(sorted);
+
+    // 3. 每个不同的文件只预处理、向量化一次
+    int *vectors = NULL, *ok = NULL;
+    double *norms = NULL, *scores = NULL;
+    if (rc == 0) {
+        size_t slots = file_count ? file_count : 1;
+        vectors = (int*)malloc(slots * VECTOR_DIMENSION * sizeof(int));
+        ok = (int*)malloc(slots * sizeof(int));
+        norms = (double*)malloc(slots * sizeof(double));
+        scores = (double*)malloc(PAIRS_EMIT_BLOCK * sizeof(double));
+        if (!vectors || !ok || !norms || !scores) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        }
+    }
+    if (rc == 0) {
+        PipelineOutput out = { vectors, ok, NULL, NULL, NULL };
+        pipeline_vectorize_files(pool, files, file_count, in_flight ? atoi(in_flight) : 0, &out);
+        size_t failed = 0;
+        for (size_t i = 0; i < file_count; i++) {
+            if (!ok[i]) {
+                fprintf(stderr, "警告：跳过文件 '%s'\n", files[i]);
+                failed++;
+                continue;
+            }
+            norms[i] = calculate_vector_norm(vectors + i * VECTOR_DIMENSION, VECTOR_DIMENSION);
+        }
+        fprintf(stderr, "文件对：%zu 对，涉及 %zu 个不同的文件", pair_count, file_count);
+        if (failed) fprintf(stderr, " (%zu 个处理失败，相关的文件对不输出)", failed);
+        fprintf(stderr, "\n");
+    }
+
+    if (rc == 0) {
+        // 输出器按 "语料库" 取路径，这里只需要路径两段
+        uint64_t *path_offsets = (uint64_t*)malloc((file_count + 1) * sizeof(uint64_t));
+        size_t total = 0;
+        for (size_t i = 0; i < file_count; i++) total += strlen(files[i]) + 1;
+        char *path_data = (char*)malloc(total ? total : 1);
+        ResultSink *sink = NULL;
+        if (!path_offsets || !path_data) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        } else {
+            for (size_t i = 0, at = 0; i < file_count; i++) {
+                path_offsets[i] = at;
+                memcpy(path_data + at, files[i], strlen(files[i]) + 1);
+                at += strlen(files[i]) + 1;
+            }
+            Corpus paths;
+            memset(&paths, 0, sizeof(paths));
+            paths.count = file_count;
+            paths.path_offsets = path_offsets;
+            paths.path_data = path_data;
+            sink = result_sink_open(output.path, output.format, &paths, min_score ? atof(min_score) : -1.0, 0);
+            if (!sink) rc = -1;
+
+            // 4. 按输入顺序一块一块地并行打分、输出
+            PairJob job = { vectors, norms, ok, file_of, 0, scores };
+            for (size_t base = 0; sink && base < pair_count; base += PAIRS_EMIT_BLOCK) {
+                size_t end = pair_count - base < PAIRS_EMIT_BLOCK ? pair_count : base + PAIRS_EMIT_BLOCK;
+                job.base = base;
+                threadpool_parallel_for(pool, base, end, 4096, score_pair_range, &job);
+                for (size_t i = base; i < end; i++) {
+                    size_t a = file_of[2 * i], b = file_of[2 * i + 1];
+                    if (!ok[a] || !ok[b]) continue;
+                    result_sink_emit(sink, -1, (uint32_t)a, (uint32_t)b, scores[i - base]);
+                }
+            }
+            if (sink && result_sink_close(sink) != 0) rc = -1;
+        }
+        free(path_offsets);
+        free(path_data);
+    }
+
+    free(vectors);
+    free(ok);
+    free(norms);
+    free(scores);
+    free(files);
+    free(file_of);
+    path_list_free(&endpoints);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+int cmd_archive_add(int argc, char *argv[]) {
+    const char *in_flight = take_option(&argc, argv, "--in-flight");
+    int with_minhash = take_flag(&argc, argv, "--minhash");
+    int with_tokens = take_flag(&argc, argv, "--tokens");
+    int no_compact = take_flag(&argc, argv, "--no-compact");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc < 2) {
+        fprintf(stderr, "用法: --archive-add <归档目录> <源文件...> [--minhash] [--tokens] [--no-compact] [--threads N] [--in-flight N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    PathList inputs = {0};
+    if (collect_paths(argc - 1, argv + 1, &inputs) != 0) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        path_list_free(&inputs);
+        threadpool_destroy(pool);
+        return 1;
+    }
+
+    // 只处理这一批文件，已有的段一个字节也不碰
+    VectorBatch batch;
+    if (vectorize_batch(pool, &inputs, in_flight ? atoi(in_flight) : 0, with_minhash, with_tokens, &batch) != 0) {
+        path_list_free(&inputs);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    CorpusInput input;
+    uint64_t *token_offsets = NULL;
+    unsigned char *token_data = NULL;
+    uint32_t seq = 0;
+    int rc = batch_corpus_input(&batch, &input, &token_offsets, &token_data);
+    if (rc == 0) rc = archive_add(pool, argv[0], &input, &seq);
+    if (rc == 0) {
+        printf("已向归档 %s 追加段 %u：%zu 个文件\n", argv[0], seq, batch.count);
+    }
+    // 新段已经提交，自动压缩失败不影响这次追加，下次追加或手动压缩时会再试
+    ArchiveCompaction stats;
+    if (rc == 0 && !no_compact && archive_compact_auto(pool, argv[0], &stats) == 0 && stats.merged_segments) {
+        printf("自动压缩：合并 %zu 个段，保留 %llu 个文件，丢弃 %llu 个已删除的文件\n", stats.merged_segments,
+               (unsigned long long)stats.kept, (unsigned long long)stats.dropped);
+    }
+
+    free(token_offsets);
+    free(token_data);
+    vector_batch_free(&batch);
+    path_list_free(&inputs);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+int cmd_archive_delete(int argc, char *argv[]) {
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc < 2) {
+        fprintf(stderr, "用法: --archive-delete <归档目录> <路径...> [--threads N]   (\"-\" 表示从标准输入读取路径)\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    PathList paths = {0};
+    if (collect_paths(argc - 1, argv + 1, &paths) != 0) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        path_list_free(&paths);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    int rc = archive_delete(pool, argv[0], (const char *const *)paths.items, paths.count);
+    if (rc == 0) {
+        printf("已在归档 %s 里标记删除 %zu 个路径\n", argv[0], paths.count);
+    }
+    path_list_free(&paths);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+static const char *archive_path(const Archive *archive, uint64_t index) {
+    size_t s = archive_segment_of(archive, index);
+    return corpus_path(&archive->segments[s], (size_t)(index - archive->first[s]));
+}
+
+int cmd_archive_query(int argc, char *argv[]) {
+    int with_minhash = take_flag(&argc, argv, "--minhash");
+    int with_tfidf = take_flag(&argc, argv, "--tfidf");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "用法: --archive-query <归档目录> <源文件> [前 k 名] [--minhash] [--tfidf] [--threads N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    size_t top_k = argc == 3 ? (size_t)strtoul(argv[2], NULL, 10) : 10;
+
+    int vector[VECTOR_DIMENSION];
+    MinHashSignature sig;
+    if (pipeline_vectorize_file(pool, argv[1], vector, with_minhash ? &sig : NULL) != 0) {
+        fprintf(stderr, "错误: 无法预处理文件 '%s'。\n", argv[1]);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    Archive archive;
+    if (archive_open(pool, argv[0], &archive) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    if (with_tfidf && archive_load_tfidf(pool, &archive) != 0) {
+        archive_close(&archive);
+        threadpool_destroy(pool);
+        return 1;
+    }
+    ArchiveMatch *best = (ArchiveMatch*)malloc((top_k ? top_k : 1) * sizeof(ArchiveMatch));
+    size_t kept = 0, candidates = 0;
+    int rc = -1;
+    if (!best) {
+        fprintf(stderr, "错误：内存分配失败\n");
+    } else if (with_minhash) {
+        rc = archive_query_minhash(pool, &archive, &sig, top_k, best, &kept, &candidates);
+    } else {
+        rc = archive_query_cosine(pool, &archive, vector, with_tfidf, top_k, best, &kept);
+        if (rc != 0) fprintf(stderr, "错误：内存分配失败\n");
+    }
+
+    if (rc == 0 && with_minhash) {
+        printf("LSH 候选 %zu / %llu 个文件 (%zu 段)，Jaccard 最高的 %zu 个：\n", candidates,
+               (unsigned long long)archive.live, archive.manifest.segment_count, kept);
+        printf("  Jaccard  余弦    文件\n");
+        for (size_t i = 0; i < kept; i++) {
+            printf("  %.4f   %.4f  %s\n", best[i].score, archive_score(&archive, vector, with_tfidf, best[i].index),
+                   archive_path(&archive, best[i].index));
+        }
+    } else if (rc == 0) {
+        printf("与 %s 最相似的 %zu 个文件 (归档共 %llu 个文件，%zu 段)：\n", argv[1], kept,
+               (unsigned long long)archive.live, archive.manifest.segment_count);
+        for (size_t i = 0; i < kept; i++) {
+            printf("  %.4f  %s\n", best[i].score, archive_path(&archive, best[i].index));
+        }
+    }
+
+    free(best);
+    archive_close(&archive);
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+int cmd_archive_compact(int argc, char *argv[]) {
+    int full = take_flag(&argc, argv, "--full");
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc != 1) {
+        fprintf(stderr, "用法: --archive-compact <归档目录> [--full] [--threads N]\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    ArchiveCompaction stats;
+    int rc = archive_compact(pool, argv[0], full, &stats);
+    if (rc == 0 && stats.merged_segments == 0) {
+        printf("归档 %s 无需压缩\n", argv[0]);
+    } else if (rc == 0) {
+        printf("已合并 %zu 个段：保留 %llu 个文件，丢弃 %llu 个已删除的文件\n", stats.merged_segments,
+               (unsigned long long)stats.kept, (unsigned long long)stats.dropped);
+    }
+    threadpool_destroy(pool);
+    return rc == 0 ? 0 : 1;
+}
+
+int cmd_archive_info(int argc, char *argv[]) {
+    ThreadPool *pool = create_pool(&argc, argv);
+    if (!pool) return 1;
+    if (argc != 1) {
+        fprintf(stderr, "用法: --archive-info <归档目录>\n");
+        threadpool_destroy(pool);
+        return 1;
+    }
+    Archive archive;
+    if (archive_open(pool, argv[0], &archive) != 0) {
+        threadpool_destroy(pool);
+        return 1;
+    }
+    printf("归档 %s：%zu 段，%llu 个文件 (%llu 个已删除)，%zu 条删除标记\n", argv[0],
+           archive.manifest.segment_count, (unsigned long long)archive.live,
+           (unsigned long long)(archive.first[archive.manifest.segment_count] - archive.live),
+           archive.manifest.tombstone_count);
+    printf("TF-IDF 权重按 %llu 个文件时的文档频率冻结 (idf 偏离超过 %.0f%% 时重新冻结)\n",
+           (unsigned long long)archive.manifest.frozen.docs, ARCHIVE_REWEIGHT_TOLERANCE * 100);
+    printf("  序号  文件数      MinHash  加权模长  段文件\n");
+    for (size_t s = 0; s < archive.manifest.segment_count; s++) {
+        const Corpus *segment = &archive.segments[s];
+        int fresh = segment->df_table && segment->tfidf_norms &&
+                    memcmp(segment->df_table, &archive.manifest.frozen, sizeof(DfTable)) == 0;
+        printf("  %-4u  %-10llu  %-7s  %-8s  %s\n", archive.manifest.segments[s].seq,
+               (unsigned long long)segment->count, segment->lsh_keys ? "有" : "无",
+               fresh ? "最新" : "待压缩", archive.manifest.segments[s].file);
+    }
+    archive_close(&archive);
+    threadpool_destroy(pool);
+    return 0;
+}
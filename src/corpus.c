@@ -0,0 +1,531 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE   // madvise
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "calculate.h"
+#include "vectorization.h"
+#include "tokenization.h"
+
+#ifdef _WIN32
+#define CORPUS_NO_MMAP
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// 向量块按 int 直接映射，要求 int 正好 4 字节
+_Static_assert(sizeof(int) == 4, "corpus format requires 32-bit int");
+
+// 待写出的一个段
+typedef struct {
+    uint32_t id;
+    const void *data;
+    uint64_t size;
+} PendingSection;
+
+static uint64_t align_up(uint64_t value) {
+    return (value + CORPUS_ALIGNMENT - 1) & ~(uint64_t)(CORPUS_ALIGNMENT - 1);
+}
+
+// 写 n 个 0 字节作为对齐填充
+static int write_padding(FILE *file, uint64_t n) {
+    static const unsigned char zeros[CORPUS_ALIGNMENT] = {0};
+    while (n > 0) {
+        size_t chunk = n > CORPUS_ALIGNMENT ? CORPUS_ALIGNMENT : (size_t)n;
+        if (fwrite(zeros, 1, chunk, file) != chunk) return -1;
+        n -= chunk;
+    }
+    return 0;
+}
+
+// 按顺序把所有段写出去：先算好每段的对齐偏移，再依次写头部、目录和数据
+static int write_sections(const char *out_path, uint64_t count, int dimension,
+                          const PendingSection *pending, uint32_t n) {
+    CorpusHeader header;
+    CorpusSection *dir = (CorpusSection*)calloc(n, sizeof(CorpusSection));
+    if (!dir) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+
+    uint64_t offset = align_up(sizeof(CorpusHeader) + (uint64_t)n * sizeof(CorpusSection));
+    for (uint32_t s = 0; s < n; s++) {
+        dir[s].id = pending[s].id;
+        dir[s].offset = offset;
+        dir[s].size = pending[s].size;
+        offset = align_up(offset + pending[s].size);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CORPUS_MAGIC, sizeof(header.magic));
+    header.format_version = CORPUS_FORMAT_VERSION;
+    header.feature_version = feature_table_version();
+    header.dimension = (uint32_t)dimension;
+    header.section_count = n;
+    header.entry_count = count;
+    header.file_size = offset;
+
+    FILE *file = fopen(out_path, "wb");
+    if (!file) {
+        fprintf(stderr, "错误：无法创建语料库文件 %s\n", out_path);
+        free(dir);
+        return -1;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(dir, sizeof(CorpusSection), n, file) == n;
+    uint64_t written = sizeof(header) + (uint64_t)n * sizeof(CorpusSection);
+    for (uint32_t s = 0; ok && s < n; s++) {
+        ok = write_padding(file, dir[s].offset - written) == 0 &&
+             fwrite(pending[s].data, 1, (size_t)pending[s].size, file) == pending[s].size;
+        written = dir[s].offset + pending[s].size;
+    }
+    if (ok) ok = write_padding(file, offset - written) == 0;
+    if (fclose(file) != 0) ok = 0;
+    free(dir);
+
+    if (!ok) {
+        fprintf(stderr, "错误：写入语料库文件 %s 失败\n", out_path);
+        remove(out_path);
+        return -1;
+    }
+    return 0;
+}
+
+// LSH 索引里的一项：桶键 + 文件下标
+typedef struct {
+    uint64_t key;
+    uint32_t id;
+} LshEntry;
+
+static int compare_lsh_entry(const void *a, const void *b) {
+    const LshEntry *x = (const LshEntry*)a;
+    const LshEntry *y = (const LshEntry*)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// 每一段各自按桶键排序，查询时在对应段里二分查找
+static int build_lsh(const MinHashSignature *signatures, size_t count,
+                     uint64_t **keys_out, uint32_t **ids_out) {
+    size_t total = (size_t)MINHASH_BANDS * count;
+    uint64_t *keys = (uint64_t*)malloc((total ? total : 1) * sizeof(uint64_t));
+    uint32_t *ids = (uint32_t*)malloc((total ? total : 1) * sizeof(uint32_t));
+    LshEntry *entries = (LshEntry*)malloc((count ? count : 1) * sizeof(LshEntry));
+    if (!keys || !ids || !entries) {
+        free(keys);
+        free(ids);
+        free(entries);
+        return -1;
+    }
+    for (int band = 0; band < MINHASH_BANDS; band++) {
+        for (size_t i = 0; i < count; i++) {
+            entries[i].key = minhash_band_key(&signatures[i], band);
+            entries[i].id = (uint32_t)i;
+        }
+        qsort(entries, count, sizeof(LshEntry), compare_lsh_entry);
+        for (size_t i = 0; i < count; i++) {
+            keys[(size_t)band * count + i] = entries[i].key;
+            ids[(size_t)band * count + i] = entries[i].id;
+        }
+    }
+    free(entries);
+    *keys_out = keys;
+    *ids_out = ids;
+    return 0;
+}
+
+int corpus_write(const char *out_path, const CorpusInput *input) {
+    size_t count = input->count;
+    int dimension = input->dimension;
+    const int *vectors = input->vectors;
+
+    if (input->signatures && count > UINT32_MAX) {
+        fprintf(stderr, "错误：语料库文件过多，无法建立 LSH 索引\n");
+        return -1;
+    }
+
+    double *norms = (double*)malloc((count ? count : 1) * sizeof(double));
+    uint64_t *path_offsets = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
+    if (!norms || !path_offsets) {
+        free(norms);
+        free(path_offsets);
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+
+    // 路径字符串表：所有路径首尾相接，每个都带 '\0'
+    uint64_t data_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        path_offsets[i] = data_size;
+        data_size += strlen(input->paths[i]) + 1;
+    }
+    path_offsets[count] = data_size;
+
+    char *path_data = (char*)malloc(data_size ? data_size : 1);
+    if (!path_data) {
+        free(norms);
+        free(path_offsets);
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy(path_data + path_offsets[i], input->paths[i], path_offsets[i + 1] - path_offsets[i]);
+        norms[i] = calculate_vector_norm(vectors + i * dimension, dimension);
+    }
+
+    PendingSection pending[12] = {
+        { CORPUS_SECTION_VECTORS,    vectors,      (uint64_t)count * dimension * sizeof(int) },
+        { CORPUS_SECTION_NORMS,      norms,        (uint64_t)count * sizeof(double) },
+        { CORPUS_SECTION_PATH_INDEX, path_offsets, (uint64_t)(count + 1) * sizeof(uint64_t) },
+        { CORPUS_SECTION_PATH_DATA,  path_data,    data_size },
+    };
+    uint32_t n = 4;
+
+    // 可选的 MinHash 签名和 LSH 索引
+    unsigned char *minhash = NULL;
+    uint64_t *lsh_keys = NULL;
+    uint32_t *lsh_ids = NULL;
+    int rc = 0;
+    if (input->signatures) {
+        uint64_t sig_size = (uint64_t)count * sizeof(MinHashSignature);
+        minhash = (unsigned char*)malloc(sizeof(CorpusMinHashHeader) + sig_size);
+        if (!minhash || build_lsh(input->signatures, count, &lsh_keys, &lsh_ids) != 0) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        } else {
+            CorpusMinHashHeader mh = { MINHASH_VERSION, MINHASH_K, MINHASH_BANDS, MINHASH_SHINGLE };
+            memcpy(minhash, &mh, sizeof(mh));
+            memcpy(minhash + sizeof(mh), input->signatures, (size_t)sig_size);
+            pending[n++] = (PendingSection){ CORPUS_SECTION_MINHASH, minhash, sizeof(mh) + sig_size };
+            pending[n++] = (PendingSection){ CORPUS_SECTION_LSH_KEYS, lsh_keys,
+                                             (uint64_t)MINHASH_BANDS * count * sizeof(uint64_t) };
+            pending[n++] = (PendingSection){ CORPUS_SECTION_LSH_IDS, lsh_ids,
+                                             (uint64_t)MINHASH_BANDS * count * sizeof(uint32_t) };
+        }
+    }
+
+    // 可选的 token 流缓存
+    unsigned char *token_index = NULL;
+    if (rc == 0 && input->token_offsets && input->token_data) {
+        uint64_t index_size = sizeof(CorpusTokenHeader) + (uint64_t)(count + 1) * sizeof(uint64_t);
+        token_index = (unsigned char*)malloc((size_t)index_size);
+        if (!token_index) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            rc = -1;
+        } else {
+            CorpusTokenHeader th = { TOKEN_ID_VERSION, TOKEN_ID_COUNT };
+            memcpy(token_index, &th, sizeof(th));
+            memcpy(token_index + sizeof(th), input->token_offsets, (count + 1) * sizeof(uint64_t));
+            pending[n++] = (PendingSection){ CORPUS_SECTION_TOKEN_INDEX, token_index, index_size };
+            pending[n++] = (PendingSection){ CORPUS_SECTION_TOKEN_DATA, input->token_data,
+                                             input->token_offsets[count] };
+        }
+    }
+
+    // 可选的 TF-IDF 模型
+    if (rc == 0 && input->df_table && input->tfidf_norms) {
+        pending[n++] = (PendingSection){ CORPUS_SECTION_TFIDF_DF, input->df_table,
+                                         (uint64_t)(dimension + 1) * sizeof(uint64_t) };
+        pending[n++] = (PendingSection){ CORPUS_SECTION_TFIDF_NORMS, input->tfidf_norms,
+                                         (uint64_t)count * sizeof(double) };
+    }
+
+    // 可选的内容哈希
+    if (rc == 0 && input->content_hashes) {
+        pending[n++] = (PendingSection){ CORPUS_SECTION_CONTENT_HASH, input->content_hashes,
+                                         (uint64_t)count * sizeof(uint64_t) };
+    }
+
+    if (rc == 0) rc = write_sections(out_path, count, dimension, pending, n);
+
+    free(token_index);
+    free(norms);
+    free(path_offsets);
+    free(path_data);
+    free(minhash);
+    free(lsh_keys);
+    free(lsh_ids);
+    return rc;
+}
+
+// 把文件内容弄进内存：能 mmap 就 mmap，否则整个读进来
+static int map_file(const char *path, Corpus *corpus) {
+#ifndef CORPUS_NO_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);   // 映射建立后文件描述符就可以关掉了
+    if (base == MAP_FAILED) return -1;
+
+    corpus->base = (const unsigned char*)base;
+    corpus->size = (size_t)st.st_size;
+    corpus->mapped = 1;
+    return 0;
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (file_size <= 0) {
+        fclose(file);
+        return -1;
+    }
+    unsigned char *base = (unsigned char*)malloc((size_t)file_size);
+    if (!base || fread(base, 1, (size_t)file_size, file) != (size_t)file_size) {
+        free(base);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    corpus->base = base;
+    corpus->size = (size_t)file_size;
+    corpus->mapped = 0;
+    return 0;
+#endif
+}
+
+const void *corpus_find_section(const Corpus *corpus, uint32_t id, uint64_t *size) {
+    const CorpusHeader *header = (const CorpusHeader*)corpus->base;
+    const CorpusSection *dir = (const CorpusSection*)(corpus->base + sizeof(CorpusHeader));
+
+    for (uint32_t s = 0; s < header->section_count; s++) {
+        if (dir[s].id == id) {
+            if (size) *size = dir[s].size;
+            return corpus->base + dir[s].offset;
+        }
+    }
+    return NULL;
+}
+
+int corpus_open(const char *path, Corpus *corpus) {
+    return corpus_open_flags(path, corpus, 0);
+}
+
+int corpus_open_flags(const char *path, Corpus *corpus, unsigned int flags) {
+    memset(corpus, 0, sizeof(*corpus));
+    if (map_file(path, corpus) != 0) {
+        fprintf(stderr, "错误：无法打开语料库文件 %s\n", path);
+        return -1;
+    }
+
+    // 1. 校验头部
+    const CorpusHeader *header = (const CorpusHeader*)corpus->base;
+    const char *problem = NULL;
+    if (corpus->size < sizeof(CorpusHeader) ||
+        memcmp(header->magic, CORPUS_MAGIC, sizeof(header->magic)) != 0) {
+        problem = "不是语料库文件";
+    } else if (header->format_version != CORPUS_FORMAT_VERSION) {
+        problem = "文件格式版本不匹配";
+    } else if ((header->feature_version != feature_table_version() ||
+                header->dimension != VECTOR_DIMENSION) && !(flags & CORPUS_OPEN_STALE)) {
+        problem = "特征表已变化，请重新生成语料库";
+    } else if (header->file_size != corpus->size ||
+               sizeof(CorpusHeader) + (uint64_t)header->section_count * sizeof(CorpusSection) > corpus->size) {
+        problem = "文件不完整";
+    }
+
+    // 2. 校验段目录，每个段都必须落在文件内
+    if (!problem) {
+        const CorpusSection *dir = (const CorpusSection*)(corpus->base + sizeof(CorpusHeader));
+        for (uint32_t s = 0; s < header->section_count; s++) {
+            if (dir[s].offset > corpus->size || dir[s].size > corpus->size - dir[s].offset) {
+                problem = "段目录损坏";
+                break;
+            }
+        }
+    }
+
+    // 3. 找到必需的段并检查大小。先用文件大小限住条目数和维数，后面的乘法才不会溢出
+    if (!problem && (header->entry_count > corpus->size / sizeof(double) ||
+                     (header->entry_count &&
+                      header->dimension > corpus->size / sizeof(int) / header->entry_count))) {
+        problem = "文件不完整";
+    }
+    if (!problem) {
+        uint64_t n = header->entry_count;
+        uint64_t vec_size = 0, norm_size = 0, index_size = 0, data_size = 0;
+        corpus->stale = header->feature_version != feature_table_version() ||
+                        header->dimension != VECTOR_DIMENSION;
+        corpus->count = n;
+        corpus->dimension = header->dimension;
+        corpus->vectors = (const int*)corpus_find_section(corpus, CORPUS_SECTION_VECTORS, &vec_size);
+        corpus->norms = (const double*)corpus_find_section(corpus, CORPUS_SECTION_NORMS, &norm_size);
+        corpus->path_offsets = (const uint64_t*)corpus_find_section(corpus, CORPUS_SECTION_PATH_INDEX, &index_size);
+        corpus->path_data = (const char*)corpus_find_section(corpus, CORPUS_SECTION_PATH_DATA, &data_size);
+
+        if (!corpus->vectors || !corpus->norms || !corpus->path_offsets || !corpus->path_data ||
+            vec_size != n * header->dimension * sizeof(int) ||
+            norm_size != n * sizeof(double) ||
+            index_size != (n + 1) * sizeof(uint64_t) ||
+            corpus->path_offsets[n] != data_size) {
+            problem = "缺少必需的段";
+        }
+        // 路径表：偏移单调递增且不超出字符串表，每条路径都在下一条开始之前以 '\0' 结尾
+        for (uint64_t i = 0; !problem && i < n; i++) {
+            uint64_t begin = corpus->path_offsets[i], end = corpus->path_offsets[i + 1];
+            if (begin >= end || end > data_size || corpus->path_data[end - 1] != '\0') problem = "路径表损坏";
+        }
+    }
+
+    if (problem) {
+        fprintf(stderr, "错误：语料库文件 %s %s\n", path, problem);
+        corpus_close(corpus);
+        return -1;
+    }
+
+    // 4. 可选段：MinHash 参数或大小对不上就当作没有；LSH 表的键每段要有序，文件编号不能越界
+    uint64_t mh_size = 0, key_size = 0, id_size = 0;
+    const unsigned char *mh = (const unsigned char*)corpus_find_section(corpus, CORPUS_SECTION_MINHASH, &mh_size);
+    const uint64_t *keys = (const uint64_t*)corpus_find_section(corpus, CORPUS_SECTION_LSH_KEYS, &key_size);
+    const uint32_t *ids = (const uint32_t*)corpus_find_section(corpus, CORPUS_SECTION_LSH_IDS, &id_size);
+    if (mh && mh_size == sizeof(CorpusMinHashHeader) + corpus->count * sizeof(MinHashSignature)) {
+        const CorpusMinHashHeader *params = (const CorpusMinHashHeader*)mh;
+        if (params->version == MINHASH_VERSION && params->k == MINHASH_K &&
+            params->bands == MINHASH_BANDS && params->shingle == MINHASH_SHINGLE) {
+            corpus->signatures = (const MinHashSignature*)(mh + sizeof(CorpusMinHashHeader));
+            if (keys && ids && key_size == MINHASH_BANDS * corpus->count * sizeof(uint64_t) &&
+                id_size == MINHASH_BANDS * corpus->count * sizeof(uint32_t)) {
+                int valid = 1;
+                for (uint64_t i = 0; valid && i < MINHASH_BANDS * corpus->count; i++) {
+                    valid = ids[i] < corpus->count &&
+                            (i % corpus->count == 0 || keys[i - 1] <= keys[i]);
+                }
+                if (valid) {
+                    corpus->lsh_keys = keys;
+                    corpus->lsh_ids = ids;
+                }
+            }
+        }
+    }
+
+    // token 流缓存：编号方案变了或者偏移越界都当作没有
+    uint64_t tindex_size = 0, tdata_size = 0;
+    const unsigned char *tindex = (const unsigned char*)corpus_find_section(corpus, CORPUS_SECTION_TOKEN_INDEX, &tindex_size);
+    const unsigned char *tdata = (const unsigned char*)corpus_find_section(corpus, CORPUS_SECTION_TOKEN_DATA, &tdata_size);
+    if (tindex && tdata &&
+        tindex_size == sizeof(CorpusTokenHeader) + (corpus->count + 1) * sizeof(uint64_t)) {
+        const CorpusTokenHeader *th = (const CorpusTokenHeader*)tindex;
+        const uint64_t *offsets = (const uint64_t*)(tindex + sizeof(CorpusTokenHeader));
+        int valid = th->version == TOKEN_ID_VERSION && th->id_count == TOKEN_ID_COUNT &&
+                    offsets[corpus->count] == tdata_size;
+        for (uint64_t i = 0; valid && i < corpus->count; i++) valid = offsets[i] <= offsets[i + 1];
+        if (valid) {
+            corpus->token_offsets = offsets;
+            corpus->token_data = tdata;
+        }
+    }
+
+    // TF-IDF 模型：向量已经过期时也一起作废。
+    // df[0] 一般就是本文件的文件数；归档的段里存的是整个归档冻结时的文档频率，所以只检查 df[i] <= df[0]
+    uint64_t df_size = 0, tnorm_size = 0;
+    const uint64_t *df = (const uint64_t*)corpus_find_section(corpus, CORPUS_SECTION_TFIDF_DF, &df_size);
+    const double *tnorms = (const double*)corpus_find_section(corpus, CORPUS_SECTION_TFIDF_NORMS, &tnorm_size);
+    int df_ok = !corpus->stale && df && tnorms && df_size == (corpus->dimension + 1) * sizeof(uint64_t) &&
+                tnorm_size == corpus->count * sizeof(double);
+    for (uint32_t i = 1; df_ok && i <= corpus->dimension; i++) df_ok = df[i] <= df[0];
+    if (df_ok) {
+        corpus->df_table = df;
+        corpus->tfidf_norms = tnorms;
+    }
+
+    // 内容哈希只和预处理有关，特征表变了也照样有效
+    uint64_t hash_size = 0;
+    const uint64_t *hashes = (const uint64_t*)corpus_find_section(corpus, CORPUS_SECTION_CONTENT_HASH, &hash_size);
+    if (hashes && hash_size == corpus->count * sizeof(uint64_t)) corpus->content_hashes = hashes;
+    return 0;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+int corpus_lsh_candidates(const Corpus *corpus, const MinHashSignature *sig,
+                          uint32_t **ids, size_t *count) {
+    *ids = NULL;
+    *count = 0;
+    if (!corpus->lsh_keys) return -1;
+
+    size_t n = (size_t)corpus->count;
+    size_t used = 0, capacity = 0;
+    uint32_t *found = NULL;
+    for (int band = 0; band < MINHASH_BANDS; band++) {
+        const uint64_t *keys = corpus->lsh_keys + (size_t)band * n;
+        const uint32_t *band_ids = corpus->lsh_ids + (size_t)band * n;
+        uint64_t key = minhash_band_key(sig, band);
+
+        // 二分查找第一个 >= key 的位置
+        size_t lo = 0, hi = n;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (keys[mid] < key) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < n && keys[lo] == key; lo++) {
+            if (used == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                uint32_t *grown = (uint32_t*)realloc(found, capacity * sizeof(uint32_t));
+                if (!grown) {
+                    free(found);
+                    return -1;
+                }
+                found = grown;
+            }
+            found[used++] = band_ids[lo];
+        }
+    }
+
+    // 同一个文件可能在多个段里都撞上，排序去重
+    qsort(found, used, sizeof(uint32_t), compare_u32);
+    size_t unique = 0;
+    for (size_t i = 0; i < used; i++) {
+        if (unique == 0 || found[unique - 1] != found[i]) found[unique++] = found[i];
+    }
+    *ids = found;
+    *count = unique;
+    return 0;
+}
+
+void corpus_release(const Corpus *corpus, const void *data, size_t bytes) {
+#ifndef CORPUS_NO_MMAP
+    if (!corpus->mapped) return;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = data ? (uintptr_t)data : (uintptr_t)corpus->base;
+    uintptr_t end = data ? begin + bytes : (uintptr_t)corpus->base + corpus->size;
+    // 向外取整到整页；顺带丢掉的相邻页以后用到时会重新从页缓存映射进来
+    begin &= ~(page - 1);
+    end = (end + page - 1) & ~(page - 1);
+    if (end > begin) madvise((void*)begin, end - begin, MADV_DONTNEED);
+#else
+    (void)corpus;
+    (void)data;
+    (void)bytes;
+#endif
+}
+
+void corpus_close(Corpus *corpus) {
+    if (corpus->base) {
+#ifndef CORPUS_NO_MMAP
+        if (corpus->mapped) {
+            munmap((void*)corpus->base, corpus->size);
+        } else
+#endif
+        {
+            free((void*)corpus->base);
+        }
+    }
+    memset(corpus, 0, sizeof(*corpus));
+}
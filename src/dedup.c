@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+#include "calculate.h"
+#include "vectorization.h"
+
+// 向量的哈希和文件下标，排序后哈希相同的文件挨在一起
+typedef struct {
+    uint64_t hash;
+    uint32_t index;
+} HashedFile;
+
+typedef struct {
+    const Corpus *corpus;
+    HashedFile *files;
+} HashJob;
+
+static uint64_t hash_vector(const int *vector, uint32_t dimension) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t i = 0; i < dimension; i++) {
+        hash ^= (uint32_t)vector[i];
+        hash *= 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+static void hash_range(size_t begin, size_t end, void *ctx) {
+    HashJob *job = (HashJob*)ctx;
+    for (size_t i = begin; i < end; i++) {
+        job->files[i].hash = hash_vector(corpus_vector(job->corpus, i), job->corpus->dimension);
+        job->files[i].index = (uint32_t)i;
+    }
+}
+
+static int compare_hashed(const void *a, const void *b) {
+    const HashedFile *x = (const HashedFile*)a;
+    const HashedFile *y = (const HashedFile*)b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int same_vector(const Corpus *corpus, size_t a, size_t b) {
+    return memcmp(corpus_vector(corpus, a), corpus_vector(corpus, b), corpus->dimension * sizeof(int)) == 0;
+}
+
+// 每类里预处理结果与更早的成员完全相同的文件数
+static size_t count_exact(const Corpus *corpus, const DedupClasses *classes, uint64_t *scratch) {
+    size_t exact = 0;
+    for (size_t c = 0; c < classes->class_count; c++) {
+        uint32_t begin = classes->class_begin[c], end = classes->class_begin[c + 1];
+        if (end - begin < 2) continue;
+        for (uint32_t k = begin; k < end; k++) scratch[k - begin] = corpus->content_hashes[classes->members[k]];
+        qsort(scratch, end - begin, sizeof(uint64_t), compare_u64);
+        for (uint32_t k = 1; k < end - begin; k++) exact += scratch[k] == scratch[k - 1];
+    }
+    return exact;
+}
+
+int dedup_build(ThreadPool *pool, const Corpus *corpus, DedupClasses *out) {
+    memset(out, 0, sizeof(*out));
+    if (corpus->count > UINT32_MAX) {
+        fprintf(stderr, "错误：语料库文件过多\n");
+        return -1;
+    }
+    size_t n = (size_t)corpus->count;
+    size_t slots = n ? n : 1;
+    HashedFile *files = (HashedFile*)malloc(slots * sizeof(HashedFile));
+    uint32_t *class_of = (uint32_t*)malloc(slots * sizeof(uint32_t));
+    uint32_t *renumber = (uint32_t*)malloc(slots * sizeof(uint32_t));
+    out->class_begin = (uint32_t*)calloc(n + 1, sizeof(uint32_t));
+    out->members = (uint32_t*)malloc(slots * sizeof(uint32_t));
+    int rc = -1;
+    if (!files || !class_of || !renumber || !out->class_begin || !out->members) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        goto done;
+    }
+
+    // 1. 并行算向量哈希，排序后哈希相同的挨在一起
+    HashJob job = { corpus, files };
+    threadpool_parallel_for(pool, 0, n, 4096, hash_range, &job);
+    qsort(files, n, sizeof(HashedFile), compare_hashed);
+
+    // 2. 哈希相同的一段里再逐个比较向量，防止碰撞；每类先用组内第一个成员的下标当临时编号
+    for (size_t s = 0; s < n;) {
+        size_t e = s + 1;
+        while (e < n && files[e].hash == files[s].hash) e++;
+        for (size_t k = s; k < e; k++) {
+            uint32_t i = files[k].index;
+            class_of[i] = i;
+            for (size_t r = s; r < k; r++) {
+                uint32_t j = files[r].index;
+                if (class_of[j] == j && same_vector(corpus, i, j)) {
+                    class_of[i] = j;
+                    break;
+                }
+            }
+        }
+        s = e;
+    }
+
+    // 3. 按代表的下标重新编号，再按类计数排序出成员表 (类内自然是升序)
+    size_t classes = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (class_of[i] == i) renumber[i] = (uint32_t)classes++;
+        class_of[i] = renumber[class_of[i]];
+        out->class_begin[class_of[i] + 1]++;
+    }
+    for (size_t c = 0; c < classes; c++) out->class_begin[c + 1] += out->class_begin[c];
+    memcpy(renumber, out->class_begin, classes * sizeof(uint32_t));   // 借来当各类的写入位置
+    for (size_t i = 0; i < n; i++) out->members[renumber[class_of[i]]++] = (uint32_t)i;
+    out->class_count = classes;
+
+    if (corpus->content_hashes) {
+        uint64_t *scratch = (uint64_t*)malloc(slots * sizeof(uint64_t));
+        if (!scratch) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            goto done;
+        }
+        out->exact_duplicates = count_exact(corpus, out, scratch);
+        free(scratch);
+    }
+    rc = 0;
+
+done:
+    free(files);
+    free(class_of);
+    free(renumber);
+    if (rc != 0) dedup_free(out);
+    return rc;
+}
+
+void dedup_free(DedupClasses *classes) {
+    free(classes->class_begin);
+    free(classes->members);
+    memset(classes, 0, sizeof(*classes));
+}
+
+// 与 allpairs 打分完全相同的算式：同一类的两个文件向量和模长都相同，得分就是代表和自己的得分
+static double self_score(const Corpus *corpus, const TfIdfModel *tfidf, size_t i) {
+    const int *v = corpus_vector(corpus, i);
+    return tfidf
+        ? tfidf_cosine(&tfidf->weights, v, tfidf->norms[i], v, tfidf->norms[i])
+        : calculate_cosine_similarity_normed(v, corpus->norms[i], v, corpus->norms[i], VECTOR_DIMENSION);
+}
+
+static int compare_pair_result(const void *a, const void *b) {
+    const PairResult *x = (const PairResult*)a;
+    const PairResult *y = (const PairResult*)b;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    return (x->b > y->b) - (x->b < y->b);
+}
+
+static size_t class_size(const DedupClasses *classes, size_t c) {
+    return classes->class_begin[c + 1] - classes->class_begin[c];
+}
+
+int allpairs_dedup(ThreadPool *pool, const Corpus *corpus, const TfIdfModel *tfidf,
+                   const DedupClasses *classes, double threshold, PairList *out) {
+    out->items = NULL;
+    out->count = 0;
+    size_t k = classes->class_count;
+    size_t dim = corpus->dimension;
+    size_t slots = k ? k : 1;
+
+    // 1. 把各类代表的向量和模长抄成一个小语料库 (只有打分用到的字段)
+    int *vectors = (int*)malloc(slots * dim * sizeof(int));
+    double *norms = (double*)malloc(slots * sizeof(double));
+    double *tfidf_norms = tfidf ? (double*)malloc(slots * sizeof(double)) : NULL;
+    if (!vectors || !norms || (tfidf && !tfidf_norms)) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(vectors);
+        free(norms);
+        free(tfidf_norms);
+        return -1;
+    }
+    for (size_t c = 0; c < k; c++) {
+        uint32_t rep = classes->members[classes->class_begin[c]];
+        memcpy(vectors + c * dim, corpus_vector(corpus, rep), dim * sizeof(int));
+        norms[c] = corpus->norms[rep];
+        if (tfidf) tfidf_norms[c] = tfidf->norms[rep];
+    }
+    Corpus reduced;
+    memset(&reduced, 0, sizeof(reduced));
+    reduced.count = k;
+    reduced.dimension = corpus->dimension;
+    reduced.vectors = vectors;
+    reduced.norms = norms;
+    TfIdfModel reduced_model;
+    if (tfidf) {
+        reduced_model = *tfidf;
+        reduced_model.norms = tfidf_norms;
+        reduced_model.owned_norms = NULL;
+    }
+
+    // 2. 只在代表之间两两比较
+    PairList reps;
+    int rc = allpairs_score(pool, &reduced, tfidf ? &reduced_model : NULL, 0, k, 0, k, threshold, &reps);
+    free(vectors);
+    free(norms);
+    free(tfidf_norms);
+    if (rc != 0) return -1;
+
+    // 3. 展开：两类之间是成员的笛卡尔积，同一类里面是所有成员两两组合 (得分就是代表和自己的得分)
+    size_t total = 0;
+    for (size_t p = 0; p < reps.count; p++) {
+        total += class_size(classes, reps.items[p].a) * class_size(classes, reps.items[p].b);
+    }
+    double *self = (double*)malloc(slots * sizeof(double));
+    if (!self) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        pair_list_free(&reps);
+        return -1;
+    }
+    for (size_t c = 0; c < k; c++) {
+        size_t s = class_size(classes, c);
+        self[c] = s > 1 ? self_score(corpus, tfidf, classes->members[classes->class_begin[c]]) : 0.0;
+        if (s > 1 && self[c] >= threshold) total += s * (s - 1) / 2;
+    }
+
+    PairResult *all = (PairResult*)malloc((total ? total : 1) * sizeof(PairResult));
+    if (!all) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(self);
+        pair_list_free(&reps);
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t p = 0; p < reps.count; p++) {
+        const PairResult *r = &reps.items[p];
+        for (uint32_t x = classes->class_begin[r->a]; x < classes->class_begin[r->a + 1]; x++) {
+            for (uint32_t y = classes->class_begin[r->b]; y < classes->class_begin[r->b + 1]; y++) {
+                uint32_t a = classes->members[x], b = classes->members[y];
+                PairResult e = { a < b ? a : b, a < b ? b : a, r->score };
+                all[n++] = e;
+            }
+        }
+    }
+    for (size_t c = 0; c < k; c++) {
+        if (class_size(classes, c) < 2 || self[c] < threshold) continue;
+        for (uint32_t x = classes->class_begin[c]; x < classes->class_begin[c + 1]; x++) {
+            for (uint32_t y = x + 1; y < classes->class_begin[c + 1]; y++) {
+                PairResult e = { classes->members[x], classes->members[y], self[c] };
+                all[n++] = e;
+            }
+        }
+    }
+    free(self);
+    pair_list_free(&reps);
+
+    qsort(all, n, sizeof(PairResult), compare_pair_result);
+    out->items = all;
+    out->count = n;
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gst.h"
+
+#define GST_HASH_BASE    1000003ull   // 前缀哈希的基数，按 2^64 取模
+#define GST_INITIAL_SIZE 32           // 第一轮的搜索长度
+
+// 一个序列的全部中间数据
+typedef struct {
+    const uint16_t *ids;
+    size_t length;
+    uint64_t *prefix;     // prefix[i] = ids[0..i) 的哈希
+    unsigned char *mark;  // 1 = 已经被某块 tile 占用
+    uint32_t *run;        // run[i] = 从 i 开始连续多少个 token 没被占用
+} GstSide;
+
+// 文本一侧的窗口：哈希 + 起点
+typedef struct {
+    uint64_t hash;
+    uint32_t pos;
+} GstWindow;
+
+typedef struct {
+    GstTile *items;
+    size_t count;
+    size_t capacity;
+} GstTileList;
+
+static int tile_list_push(GstTileList *list, GstTile tile) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        GstTile *items = (GstTile*)realloc(list->items, capacity * sizeof(GstTile));
+        if (!items) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = tile;
+    return 0;
+}
+
+static int side_init(GstSide *side, const uint16_t *ids, size_t length) {
+    side->ids = ids;
+    side->length = length;
+    side->prefix = (uint64_t*)malloc((length + 1) * sizeof(uint64_t));
+    side->mark = (unsigned char*)calloc(length ? length : 1, 1);
+    side->run = (uint32_t*)malloc((length + 1) * sizeof(uint32_t));
+    if (!side->prefix || !side->mark || !side->run) return -1;
+
+    side->prefix[0] = 0;
+    for (size_t i = 0; i < length; i++) {
+        // 加 1 避免编号 0 对哈希没有贡献
+        side->prefix[i + 1] = side->prefix[i] * GST_HASH_BASE + (uint64_t)ids[i] + 1;
+    }
+    return 0;
+}
+
+static void side_free(GstSide *side) {
+    free(side->prefix);
+    free(side->mark);
+    free(side->run);
+}
+
+// 标记变化之后重新计算每个位置往后的空闲长度
+static void side_update_runs(GstSide *side) {
+    side->run[side->length] = 0;
+    for (size_t i = side->length; i-- > 0;) {
+        side->run[i] = side->mark[i] ? 0 : side->run[i + 1] + 1;
+    }
+}
+
+static uint64_t window_hash(const GstSide *side, size_t pos, size_t s, uint64_t power) {
+    return side->prefix[pos + s] - side->prefix[pos] * power;
+}
+
+static int compare_window(const void *x, const void *y) {
+    const GstWindow *a = (const GstWindow*)x;
+    const GstWindow *b = (const GstWindow*)y;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    return (a->pos > b->pos) - (a->pos < b->pos);
+}
+
+// 长的在前；一样长时按位置排，保证结果确定
+static int compare_tile(const void *x, const void *y) {
+    const GstTile *a = (const GstTile*)x;
+    const GstTile *b = (const GstTile*)y;
+    if (a->length != b->length) return a->length > b->length ? -1 : 1;
+    if (a->a != b->a) return a->a < b->a ? -1 : 1;
+    return (a->b > b->b) - (a->b < b->b);
+}
+
+// 找出所有长度 >= s、两边都没被占用的最长匹配，放进 matches。
+// 某个匹配长到超过 2s 时提前返回它的长度，让调用者用更大的 s 重来 (大块匹配优先，避免大量重叠的短匹配)
+static int scan_pattern(const GstSide *pa, const GstSide *pb, size_t s, uint64_t power,
+                        GstWindow *windows, GstTileList *matches, size_t *longest) {
+    matches->count = 0;
+    *longest = 0;
+
+    size_t nw = 0;
+    for (size_t t = 0; t + s <= pb->length; t++) {
+        if (pb->run[t] >= s) {
+            windows[nw].hash = window_hash(pb, t, s, power);
+            windows[nw].pos = (uint32_t)t;
+            nw++;
+        }
+    }
+    if (nw == 0) return 0;
+    qsort(windows, nw, sizeof(GstWindow), compare_window);
+
+    for (size_t p = 0; p + s <= pa->length; p++) {
+        if (pa->run[p] < s) continue;
+        uint64_t h = window_hash(pa, p, s, power);
+
+        size_t lo = 0, hi = nw;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (windows[mid].hash < h) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < nw && windows[lo].hash == h; lo++) {
+            size_t t = windows[lo].pos;
+            // 哈希相同还要逐个比较，排除碰撞
+            if (memcmp(pa->ids + p, pb->ids + t, s * sizeof(uint16_t)) != 0) continue;
+
+            size_t k = s;
+            while (p + k < pa->length && t + k < pb->length &&
+                   !pa->mark[p + k] && !pb->mark[t + k] && pa->ids[p + k] == pb->ids[t + k]) {
+                k++;
+            }
+            if (k > 2 * s) {
+                *longest = k;
+                return 0;
+            }
+            GstTile m = { (uint32_t)p, (uint32_t)t, (uint32_t)k };
+            if (tile_list_push(matches, m) != 0) return -1;
+            if (k > *longest) *longest = k;
+        }
+    }
+    return 0;
+}
+
+// 从长到短把互不重叠的匹配铺成 tile
+static int mark_tiles(GstSide *pa, GstSide *pb, GstTileList *matches, GstTileList *tiles, size_t *covered) {
+    if (matches->count > 1) qsort(matches->items, matches->count, sizeof(GstTile), compare_tile);
+    for (size_t i = 0; i < matches->count; i++) {
+        GstTile m = matches->items[i];
+        int occluded = 0;
+        for (uint32_t k = 0; k < m.length && !occluded; k++) {
+            occluded = pa->mark[m.a + k] || pb->mark[m.b + k];
+        }
+        if (occluded) continue;
+
+        memset(pa->mark + m.a, 1, m.length);
+        memset(pb->mark + m.b, 1, m.length);
+        if (tile_list_push(tiles, m) != 0) return -1;
+        *covered += m.length;
+    }
+    side_update_runs(pa);
+    side_update_runs(pb);
+    return 0;
+}
+
+int gst_compare(const uint16_t *a, size_t len_a, const uint16_t *b, size_t len_b,
+                int min_match, GstResult *out) {
+    memset(out, 0, sizeof(*out));
+    if (len_a > UINT32_MAX || len_b > UINT32_MAX) return -1;
+    size_t mml = min_match > 0 ? (size_t)min_match : GST_MIN_MATCH;
+
+    GstSide pa, pb;
+    memset(&pa, 0, sizeof(pa));
+    memset(&pb, 0, sizeof(pb));
+    GstTileList matches = {0}, tiles = {0};
+    GstWindow *windows = NULL;
+    int rc = -1;
+
+    // 窗口哈希只建在较长的一边，较短的一边逐个去查
+    int swapped = len_a > len_b;
+    if (swapped) {
+        const uint16_t *ids = a; a = b; b = ids;
+        size_t len = len_a; len_a = len_b; len_b = len;
+    }
+    if (side_init(&pa, a, len_a) != 0 || side_init(&pb, b, len_b) != 0) goto done;
+    windows = (GstWindow*)malloc((len_b ? len_b : 1) * sizeof(GstWindow));
+    if (!windows) goto done;
+    side_update_runs(&pa);
+    side_update_runs(&pb);
+
+    size_t s = GST_INITIAL_SIZE > mml ? GST_INITIAL_SIZE : mml;
+    if (s > len_a && len_a >= mml) s = len_a;
+    size_t covered = 0;
+    while (len_a >= mml && s >= mml) {
+        uint64_t power = 1;
+        for (size_t i = 0; i < s; i++) power *= GST_HASH_BASE;
+
+        size_t longest;
+        if (scan_pattern(&pa, &pb, s, power, windows, &matches, &longest) != 0) goto done;
+        if (longest > 2 * s) {
+            s = longest;
+            continue;
+        }
+        if (mark_tiles(&pa, &pb, &matches, &tiles, &covered) != 0) goto done;
+
+        if (s > 2 * mml) s /= 2;
+        else if (s > mml) s = mml;
+        else break;
+    }
+
+    // 交换过两边时把 tile 的坐标换回来
+    for (size_t i = 0; swapped && i < tiles.count; i++) {
+        uint32_t pos = tiles.items[i].a;
+        tiles.items[i].a = tiles.items[i].b;
+        tiles.items[i].b = pos;
+    }
+    out->tiles = tiles.items;
+    out->count = tiles.count;
+    out->covered = covered;
+    out->coverage = len_a + len_b ? 2.0 * (double)covered / (double)(len_a + len_b) : 0.0;
+    tiles.items = NULL;
+    rc = 0;
+
+done:
+    free(tiles.items);
+    free(matches.items);
+    free(windows);
+    side_free(&pa);
+    side_free(&pb);
+    return rc;
+}
+
+void gst_result_free(GstResult *result) {
+    free(result->tiles);
+    memset(result, 0, sizeof(*result));
+}
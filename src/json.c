@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <string.h>
+#include "json.h"
+
+// s 开头是一个合法 UTF-8 多字节序列时返回它的长度 (2 ~ 4)，否则返回 0。
+// 按 RFC 3629 拒绝过长编码、代理区 (U+D800 ~ U+DFFF) 和超过 U+10FFFF 的码点
+static int utf8_sequence_length(const unsigned char *s) {
+    int length;
+    unsigned char low = 0x80, high = 0xBF;     // 第二个字节的范围
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) length = 2;
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) length = 3;
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) length = 4;
+    else return 0;
+    if (s[0] == 0xE0) low = 0xA0;
+    else if (s[0] == 0xED) high = 0x9F;
+    else if (s[0] == 0xF0) low = 0x90;
+    else if (s[0] == 0xF4) high = 0x8F;
+    if (s[1] < low || s[1] > high) return 0;
+    for (int i = 2; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;    // 结尾的 '\0' 也在这里挡住
+    }
+    return length;
+}
+
+char *json_put_string(char *p, const char *s) {
+    const unsigned char *c = (const unsigned char*)s;
+    *p++ = '"';
+    while (*c) {
+        if (*c < 0x80) {
+            if (*c == '"' || *c == '\\') {
+                *p++ = '\\';
+                *p++ = (char)*c;
+            } else if (*c < 0x20) {
+                p += sprintf(p, "\\u%04x", *c);
+            } else {
+                *p++ = (char)*c;
+            }
+            c++;
+            continue;
+        }
+        int length = utf8_sequence_length(c);
+        if (length) {
+            memcpy(p, c, (size_t)length);
+            p += length;
+            c += length;
+        } else {
+            memcpy(p, "\\ufffd", 6);
+            p += 6;
+            c++;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "locate.h"
+#include "preprocess.h"
+#include "tokenization.h"
+
+int line_index_build(const char *source, size_t length, LineIndex *index) {
+    size_t lines = 1;
+    for (const char *p = source; (p = memchr(p, '\n', length - (size_t)(p - source))) != NULL; p++) {
+        lines++;
+    }
+
+    index->starts = (uint32_t*)malloc(lines * sizeof(uint32_t));
+    index->count = 0;
+    if (!index->starts) return -1;
+
+    index->starts[index->count++] = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (source[i] == '\n') index->starts[index->count++] = (uint32_t)(i + 1);
+    }
+    return 0;
+}
+
+size_t line_index_lookup(const LineIndex *index, uint32_t offset) {
+    // 最后一个行首 <= offset 的行
+    size_t lo = 0, hi = index->count;
+    while (lo + 1 < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->starts[mid] <= offset) lo = mid;
+        else hi = mid;
+    }
+    return lo + 1;
+}
+
+void line_index_free(LineIndex *index) {
+    free(index->starts);
+    memset(index, 0, sizeof(*index));
+}
+
+// 对预处理后的代码分词，同时把每个 token 在 code 里的位置换算成原文件的字节范围
+static int collect_spans(const char *code, const uint32_t *offsets, LocatedTokens *out) {
+    size_t capacity = 0;
+    int pos = 0;
+    Token token;
+    for (;;) {
+        // get_next_token 会先跳过空白，这里先跳一次才能拿到 token 的起点
+        while (isspace((unsigned char)code[pos])) pos++;
+        int start = pos;
+        get_next_token(code, &pos, &token);
+        if (token.type == TOKEN_END) break;
+
+        if (out->count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 256;
+            uint16_t *ids = (uint16_t*)realloc(out->ids, grown * sizeof(uint16_t));
+            if (ids) out->ids = ids;
+            uint32_t *begin = (uint32_t*)realloc(out->begin, grown * sizeof(uint32_t));
+            if (begin) out->begin = begin;
+            uint32_t *end = (uint32_t*)realloc(out->end, grown * sizeof(uint32_t));
+            if (end) out->end = end;
+            if (!ids || !begin || !end) return -1;
+            capacity = grown;
+        }
+        out->ids[out->count] = (uint16_t)token_canonical_id(&token);
+        out->begin[out->count] = offsets[start];
+        out->end[out->count] = offsets[pos - 1] + 1;
+        out->count++;
+    }
+    return 0;
+}
+
+int located_tokens_load(const char *path, LocatedTokens *out) {
+    memset(out, 0, sizeof(*out));
+    size_t length = 0;
+    char *source = read_source_file(path, &length);
+    if (!source) return -1;
+    if (length > UINT32_MAX) {
+        fprintf(stderr, "错误：文件 %s 超过 4 GB，无法定位匹配\n", path);
+        free(source);
+        return -1;
+    }
+
+    char *code = (char*)malloc(length + 1);
+    uint32_t *offsets = (uint32_t*)malloc((length ? length : 1) * sizeof(uint32_t));
+    int rc = -1;
+    if (code && offsets) {
+        preprocess_source_mapped(source, length, code, offsets);
+        rc = collect_spans(code, offsets, out);
+        if (rc == 0) rc = line_index_build(source, length, &out->lines);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        located_tokens_free(out);
+    }
+    free(offsets);
+    free(code);
+    free(source);
+    return rc;
+}
+
+void located_tokens_free(LocatedTokens *tokens) {
+    free(tokens->ids);
+    free(tokens->begin);
+    free(tokens->end);
+    line_index_free(&tokens->lines);
+    memset(tokens, 0, sizeof(*tokens));
+}
+
+static int compare_region(const void *x, const void *y) {
+    const MatchRegion *a = (const MatchRegion*)x;
+    const MatchRegion *b = (const MatchRegion*)y;
+    if (a->a_first != b->a_first) return a->a_first < b->a_first ? -1 : 1;
+    return (a->b_first > b->b_first) - (a->b_first < b->b_first);
+}
+
+int locate_matches(const LocatedTokens *a, const LocatedTokens *b, const GstResult *gst,
+                   MatchRegion **regions, size_t *count) {
+    *count = 0;
+    *regions = (MatchRegion*)malloc((gst->count ? gst->count : 1) * sizeof(MatchRegion));
+    if (!*regions) return -1;
+
+    for (size_t i = 0; i < gst->count; i++) {
+        const GstTile *tile = &gst->tiles[i];
+        size_t a_last = tile->a + tile->length - 1;
+        size_t b_last = tile->b + tile->length - 1;
+        MatchRegion *r = &(*regions)[i];
+        r->a_first = line_index_lookup(&a->lines, a->begin[tile->a]);
+        r->a_last = line_index_lookup(&a->lines, a->end[a_last] - 1);
+        r->b_first = line_index_lookup(&b->lines, b->begin[tile->b]);
+        r->b_last = line_index_lookup(&b->lines, b->end[b_last] - 1);
+        r->tokens = tile->length;
+    }
+    *count = gst->count;
+    qsort(*regions, *count, sizeof(MatchRegion), compare_region);
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <math.h>
 
 // 引入各模块头文件
@@ -8,11 +9,41 @@
 #include "tokenization.h"
 #include "vectorization.h"
 #include "calculate.h"
+#include "commands.h"
+#include "minhash.h"
+#include "tokenstream.h"
+#include "gst.h"
+#include "locate.h"
+#include "window.h"
+#include "trace.h"
+#include "threadpool.h"
 
 // 打印使用说明
 void print_usage(const char *program_name) {
-    fprintf(stderr, "用法: %s <文件1路径> <文件2路径>\n", program_name);
+    fprintf(stderr, "用法: %s <文件1路径> <文件2路径> [--minhash] [--gst] [--locate] [--window[=N]]\n", program_name);
     fprintf(stderr, "例如: %s test/test1.c test/test2.c\n", program_name);
+    fprintf(stderr, "  --minhash  同时输出基于 token shingle 的 MinHash Jaccard 估计\n");
+    fprintf(stderr, "  --gst      同时输出贪心串覆盖率 (成段相同的 token 占比)\n");
+    fprintf(stderr, "  --locate   在 --gst 的基础上列出每段匹配在两个文件里的行号范围\n");
+    fprintf(stderr, "  --window   滑动窗口比较，列出最相似的几段代码 (窗口默认 %d 个 token，--window=N 指定)\n",
+            WINDOW_DEFAULT_TOKENS);
+    fprintf(stderr, "\n语料库模式:\n");
+    fprintf(stderr, "  %s --build-corpus <语料库文件> <源文件...> [--minhash] [--tokens]   (\"-\" 表示从标准输入读取路径)\n", program_name);
+    fprintf(stderr, "  %s --rescore-corpus <旧语料库文件> <新语料库文件> [--minhash]\n", program_name);
+    fprintf(stderr, "  %s --query <语料库文件> <源文件> [前 k 名] [--minhash] [--gst] [--locate]\n", program_name);
+    fprintf(stderr, "  %s --all-pairs <语料库文件> [阈值] [--format text|csv|jsonl|binary] [--output 文件] [--stream | --memory MB | --dedup] [--locate]\n", program_name);
+    fprintf(stderr, "  %s --shard-plan <语料库文件> <块大小>\n", program_name);
+    fprintf(stderr, "  %s --run-shard <语料库文件> <行块:列块:块大小> <部分结果文件> [阈值]\n", program_name);
+    fprintf(stderr, "  %s --merge-shards <语料库文件> <部分结果文件...> [--min-score 阈值] [--format 格式] [--output 文件]\n", program_name);
+    fprintf(stderr, "  %s --pairs [文件对列表|-] [--min-score 阈值] [--format text|csv|jsonl] [--output 文件]   (每行两个路径)\n", program_name);
+    fprintf(stderr, "\n分段归档:\n");
+    fprintf(stderr, "  %s --archive-add <归档目录> <源文件...> [--minhash] [--tokens] [--no-compact]\n", program_name);
+    fprintf(stderr, "  %s --archive-delete <归档目录> <路径...>\n", program_name);
+    fprintf(stderr, "  %s --archive-query <归档目录> <源文件> [前 k 名] [--minhash] [--tfidf]\n", program_name);
+    fprintf(stderr, "  %s --archive-compact <归档目录> [--full]\n", program_name);
+    fprintf(stderr, "  %s --archive-info <归档目录>\n", program_name);
+    fprintf(stderr, "  以上命令均可追加 --threads N 指定线程数；建库、查询、两两比较可追加 --tfidf 使用 TF-IDF 加权\n");
+    fprintf(stderr, "  任何模式都可以追加 --trace 文件，记录各线程的时间线 (Chrome trace-event JSON，用 Perfetto 打开)\n");
 }
 
 // 评估相似度得分并输出结论
@@ -20,26 +51,203 @@ void evaluate_similarity(double score) {
     printf("\n--- 评估结果 ---\n");
     printf("代码相似度得分: %.4f (%.2f%%)\n", score, score * 100.0);
 
-    if (score >= 0.9) {
+    if (score >= SIMILARITY_THRESHOLD_VERY_HIGH) {
         printf("结论: [极高] 两份代码高度相似，极有可能存在直接抄袭。\n");
-    } else if (score >= 0.75) {
+    } else if (score >= SIMILARITY_THRESHOLD_HIGH) {
         printf("结论: [高] 两份代码非常相似，结构和逻辑基本一致。\n");
-    } else if (score >= 0.5) {
+    } else if (score >= SIMILARITY_THRESHOLD_MEDIUM) {
         printf("结论: [中] 两份代码有一定相似性，可能复用了部分逻辑或结构。\n");
     } else {
         printf("结论: [低] 两份代码差异较大，相似度较低。\n");
     }
 }
 
+static void print_gst(const GstResult *gst) {
+    printf("GST 覆盖率: %.2f%% (%zu 块 tile，共 %zu 个 token，最短匹配 %d 个 token)\n",
+           gst->coverage * 100.0, gst->count, gst->covered, GST_MIN_MATCH);
+}
+
+// 贪心串覆盖 + 行号定位：列出 A 的哪几行和 B 的哪几行是同一段代码
+static int report_matches(const char *path_A, const char *path_B) {
+    LocatedTokens loc_A, loc_B;
+    if (located_tokens_load(path_A, &loc_A) != 0) return -1;
+    if (located_tokens_load(path_B, &loc_B) != 0) {
+        located_tokens_free(&loc_A);
+        return -1;
+    }
+
+    int rc = -1;
+    GstResult gst;
+    MatchRegion *regions = NULL;
+    size_t count = 0;
+    if (gst_compare(loc_A.ids, loc_A.count, loc_B.ids, loc_B.count, GST_MIN_MATCH, &gst) == 0) {
+        if (locate_matches(&loc_A, &loc_B, &gst, &regions, &count) == 0) {
+            print_gst(&gst);
+            printf("匹配片段 (行号):\n");
+            for (size_t i = 0; i < count; i++) {
+                printf("  A %zu-%zu  <->  B %zu-%zu  (%zu 个 token)\n", regions[i].a_first, regions[i].a_last,
+                       regions[i].b_first, regions[i].b_last, regions[i].tokens);
+            }
+            free(regions);
+            rc = 0;
+        }
+        gst_result_free(&gst);
+    }
+    if (rc != 0) fprintf(stderr, "错误：内存分配失败\n");
+    located_tokens_free(&loc_A);
+    located_tokens_free(&loc_B);
+    return rc;
+}
+
+// 滑动窗口：整个文件的分数被大量无关代码稀释时，找出局部最像的几段
+static int report_windows(const char *path_A, const char *path_B, size_t window) {
+    int map[TOKEN_ID_COUNT];
+    int missing = build_feature_id_map(map);
+    if (missing > 0) {
+        fprintf(stderr, "错误：特征表里有 %d 个特征无法由 token 编号得到，不能用窗口前缀和\n", missing);
+        return -1;
+    }
+
+    LocatedTokens loc_A, loc_B;
+    if (located_tokens_load(path_A, &loc_A) != 0) return -1;
+    if (located_tokens_load(path_B, &loc_B) != 0) {
+        located_tokens_free(&loc_A);
+        return -1;
+    }
+
+    int rc = -1;
+    FeaturePrefix prefix_A = {0}, prefix_B = {0};
+    WindowMatch matches[WINDOW_TOP_REGIONS];
+    size_t count = 0;
+    if (feature_prefix_build(loc_A.ids, loc_A.count, map, window, &prefix_A) == 0 &&
+        feature_prefix_build(loc_B.ids, loc_B.count, map, window, &prefix_B) == 0 &&
+        window_best_matches(&prefix_A, &prefix_B, WINDOW_TOP_REGIONS, matches, &count) == 0) {
+        printf("局部相似度 (窗口 %zu 个 token):\n", window);
+        if (count == 0) printf("  (至少有一个文件没有 token)\n");
+        for (size_t i = 0; i < count; i++) {
+            const WindowMatch *m = &matches[i];
+            printf("  %.4f  A %zu-%zu  <->  B %zu-%zu\n", m->score,
+                   line_index_lookup(&loc_A.lines, loc_A.begin[m->a_begin]),
+                   line_index_lookup(&loc_A.lines, loc_A.end[m->a_end - 1] - 1),
+                   line_index_lookup(&loc_B.lines, loc_B.begin[m->b_begin]),
+                   line_index_lookup(&loc_B.lines, loc_B.end[m->b_end - 1] - 1));
+        }
+        rc = 0;
+    } else {
+        fprintf(stderr, "错误：内存分配失败\n");
+    }
+    feature_prefix_free(&prefix_A);
+    feature_prefix_free(&prefix_B);
+    located_tokens_free(&loc_A);
+    located_tokens_free(&loc_B);
+    return rc;
+}
+
+// 读取并预处理一个文件。大文件第一次出现时才创建线程池，分块并行处理；普通大小的文件不值得启动线程
+static char *load_clean_code(const char *path, ThreadPool **pool, size_t *clean_length) {
+    size_t length;
+    char *source = read_source_file(path, &length);
+    if (!source) return NULL;
+    if (length >= PREPROCESS_PARALLEL_MIN && !*pool) *pool = threadpool_create(0);
+    char *clean_code = (char*)malloc(length + 1);
+    if (clean_code) *clean_length = preprocess_source_parallel(*pool, source, length, clean_code);
+    free(source);
+    return clean_code;
+}
+
 int main(int argc, char *argv[]) {
-    // 1. 检查参数
-    if (argc != 3) {
+    // 0. --trace 文件 对所有模式都有效，先摘掉再分派
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--trace") != 0) continue;
+        if (trace_start(argv[i + 1]) != 0) {
+            fprintf(stderr, "错误：无法开启追踪\n");
+            return 1;
+        }
+        trace_thread_name("main");
+        memmove(argv + i, argv + i + 2, (size_t)(argc - i - 2) * sizeof(char*));
+        argc -= 2;
+        break;
+    }
+
+    // 子命令分派
+    if (argc >= 2 && strcmp(argv[1], "--build-corpus") == 0) {
+        return cmd_build_corpus(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--rescore-corpus") == 0) {
+        return cmd_rescore_corpus(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--query") == 0) {
+        return cmd_query(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--all-pairs") == 0) {
+        return cmd_all_pairs(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--shard-plan") == 0) {
+        return cmd_shard_plan(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--run-shard") == 0) {
+        return cmd_run_shard(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--merge-shards") == 0) {
+        return cmd_merge_shards(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--pairs") == 0) {
+        return cmd_pairs(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--archive-add") == 0) {
+        return cmd_archive_add(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--archive-delete") == 0) {
+        return cmd_archive_delete(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--archive-query") == 0) {
+        return cmd_archive_query(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--archive-compact") == 0) {
+        return cmd_archive_compact(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--archive-info") == 0) {
+        return cmd_archive_info(argc - 2, argv + 2);
+    }
+
+    // 1. 检查参数：两个文件路径，外加可选的开关
+    const char *paths[2] = { NULL, NULL };
+    int path_count = 0;
+    int use_minhash = 0;
+    int use_gst = 0;
+    int use_locate = 0;
+    long window = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--minhash") == 0) {
+            use_minhash = 1;
+        } else if (strcmp(argv[i], "--gst") == 0) {
+            use_gst = 1;
+        } else if (strcmp(argv[i], "--locate") == 0) {
+            use_locate = 1;
+        } else if (strcmp(argv[i], "--window") == 0) {
+            window = WINDOW_DEFAULT_TOKENS;
+        } else if (strncmp(argv[i], "--window=", 9) == 0) {
+            char *end;
+            errno = 0;
+            window = strtol(argv[i] + 9, &end, 10);
+            if (end == argv[i] + 9 || *end != '\0' || errno == ERANGE || window <= 0) {
+                fprintf(stderr, "错误：窗口长度必须是正整数\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--", 2) != 0 && path_count < 2) {
+            paths[path_count++] = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path_count != 2) {
         print_usage(argv[0]);
         return 1;
     }
 
-    const char *file1_path = argv[1];
-    const char *file2_path = argv[2];
+    const char *file1_path = paths[0];
+    const char *file2_path = paths[1];
 
     printf("--- C语言代码相似度检测系统 ---\n");
     printf("正在比较:\n  文件 A: %s\n  文件 B: %s\n\n", file1_path, file2_path);
@@ -47,6 +255,9 @@ int main(int argc, char *argv[]) {
     // 变量声明
     char *clean_code_A = NULL;
     char *clean_code_B = NULL;
+    size_t clean_length_A = 0;
+    size_t clean_length_B = 0;
+    ThreadPool *pool = NULL;      // 只有遇到大文件才创建
     int vector_A[VECTOR_DIMENSION];
     int vector_B[VECTOR_DIMENSION];
     double similarity = 0.0;
@@ -54,14 +265,14 @@ int main(int argc, char *argv[]) {
 
     // 2. 预处理 (Preprocess)
     printf("[1/3] 正在预处理代码...\n");
-    clean_code_A = preprocess_file(file1_path);
+    clean_code_A = load_clean_code(file1_path, &pool, &clean_length_A);
     if (!clean_code_A) {
         fprintf(stderr, "错误: 无法预处理文件 '%s'。\n", file1_path);
         exit_code = 1;
         goto cleanup;
     }
     
-    clean_code_B = preprocess_file(file2_path);
+    clean_code_B = load_clean_code(file2_path, &pool, &clean_length_B);
     if (!clean_code_B) {
         fprintf(stderr, "错误: 无法预处理文件 '%s'。\n", file2_path);
         exit_code = 1;
@@ -72,8 +283,8 @@ int main(int argc, char *argv[]) {
     // 3. 向量化 (Vectorization)
     // 注意：generate_vector 内部会调用分词器 (tokenization)
     printf("[2/3] 正在生成特征向量...\n");
-    generate_vector(clean_code_A, vector_A);
-    generate_vector(clean_code_B, vector_B);
+    generate_vector_parallel(pool, clean_code_A, clean_length_A, vector_A);
+    generate_vector_parallel(pool, clean_code_B, clean_length_B, vector_B);
     printf("      向量生成完成。\n");
 
     // 4. 计算相似度 (Calculation)
@@ -83,10 +294,48 @@ int main(int argc, char *argv[]) {
     // 5. 输出结果
     evaluate_similarity(similarity);
 
+    // 6. 可选：MinHash Jaccard 估计 (看 token 顺序，比计数向量更细)
+    if (use_minhash) {
+        MinHashSignature sig_A, sig_B;
+        minhash_compute(clean_code_A, &sig_A);
+        minhash_compute(clean_code_B, &sig_B);
+        printf("MinHash Jaccard 估计: %.4f (%d-token shingle, %d 个排列)\n",
+               minhash_jaccard(&sig_A, &sig_B), MINHASH_SHINGLE, MINHASH_K);
+    }
+
+    // 7. 可选：贪心串覆盖 (代码块调换了顺序也能逐块找出来)
+    if (use_gst && !use_locate) {
+        uint16_t *ids_A = NULL, *ids_B = NULL;
+        size_t count_A = 0, count_B = 0;
+        GstResult gst;
+        if (token_stream_collect(clean_code_A, &ids_A, &count_A) != 0 ||
+            token_stream_collect(clean_code_B, &ids_B, &count_B) != 0 ||
+            gst_compare(ids_A, count_A, ids_B, count_B, GST_MIN_MATCH, &gst) != 0) {
+            fprintf(stderr, "错误：内存分配失败\n");
+            exit_code = 1;
+        } else {
+            print_gst(&gst);
+            gst_result_free(&gst);
+        }
+        free(ids_A);
+        free(ids_B);
+    }
+
+    // 8. 可选：匹配定位，需要带着原文件的位置重新预处理一遍
+    if (use_locate && report_matches(file1_path, file2_path) != 0) {
+        exit_code = 1;
+    }
+
+    // 9. 可选：滑动窗口局部相似度
+    if (window > 0 && report_windows(file1_path, file2_path, (size_t)window) != 0) {
+        exit_code = 1;
+    }
+
 cleanup:
     // 内存清理
     if (clean_code_A) free(clean_code_A);
     if (clean_code_B) free(clean_code_B);
+    if (pool) threadpool_destroy(pool);
 
     return exit_code;
 }
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include "minhash.h"
+#include "tokenization.h"
+
+// 把一个 shingle (若干个 token 编号) 压成 32 位哈希 (FNV-1a)
+static uint32_t hash_shingle(const int *ids, int n) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        hash ^= (uint32_t)ids[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 用第 k 个 "排列" 处理 shingle 哈希 h，并更新最小值。
+// 排列 k 取 fmix32(h ^ seed_k)，fmix32 是双射，seed_k 由 k 直接算出。
+// 循环体只有 32 位乘法、移位和异或，编译器可以把 K 个排列一起向量化 (SSE4.1/AVX2 下一次 4~8 个)
+static void update_mins(uint32_t mins[MINHASH_K], uint32_t h) {
+    for (uint32_t k = 0; k < MINHASH_K; k++) {
+        uint32_t x = h ^ (k * 0x9E3779B9u + 0x7F4A7C15u);
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+        mins[k] = x < mins[k] ? x : mins[k];
+    }
+}
+
+// 计算签名的中间状态：window 里始终是最近的 MINHASH_SHINGLE 个 token 编号
+typedef struct {
+    uint32_t mins[MINHASH_K];
+    int window[MINHASH_SHINGLE];
+    int filled;
+} ShingleState;
+
+static void shingle_begin(ShingleState *st) {
+    for (int k = 0; k < MINHASH_K; k++) st->mins[k] = UINT32_MAX;
+    st->filled = 0;
+}
+
+// 滑动窗口：每进来一个 token，窗口满了就算一个 shingle
+static void shingle_push(ShingleState *st, int id) {
+    if (st->filled == MINHASH_SHINGLE) {
+        memmove(st->window, st->window + 1, (MINHASH_SHINGLE - 1) * sizeof(int));
+        st->filled--;
+    }
+    st->window[st->filled++] = id;
+    if (st->filled == MINHASH_SHINGLE) {
+        update_mins(st->mins, hash_shingle(st->window, st->filled));
+    }
+}
+
+static void shingle_finish(ShingleState *st, MinHashSignature *sig) {
+    // token 太少、凑不满一个 shingle 时，把仅有的几个当作一个 shingle
+    if (st->filled > 0 && st->filled < MINHASH_SHINGLE) {
+        update_mins(st->mins, hash_shingle(st->window, st->filled));
+    }
+    for (int k = 0; k < MINHASH_K; k++) sig->v[k] = (uint16_t)st->mins[k];
+}
+
+void minhash_compute(const char *code, MinHashSignature *sig) {
+    ShingleState st;
+    shingle_begin(&st);
+    int pos = 0;
+    Token token;
+    for (;;) {
+        get_next_token(code, &pos, &token);
+        if (token.type == TOKEN_END) break;
+        shingle_push(&st, token_canonical_id(&token));
+    }
+    shingle_finish(&st, sig);
+}
+
+void minhash_compute_ids(const uint16_t *ids, size_t count, MinHashSignature *sig) {
+    ShingleState st;
+    shingle_begin(&st);
+    for (size_t i = 0; i < count; i++) shingle_push(&st, ids[i]);
+    shingle_finish(&st, sig);
+}
+
+// 没有任何 shingle 时所有最小值都停留在 UINT32_MAX，低 16 位全是 0xFFFF
+static int signature_empty(const MinHashSignature *sig) {
+    for (int k = 0; k < MINHASH_K; k++) {
+        if (sig->v[k] != 0xFFFF) return 0;
+    }
+    return 1;
+}
+
+double minhash_jaccard(const MinHashSignature *a, const MinHashSignature *b) {
+    if (signature_empty(a) || signature_empty(b)) return 0.0;
+    int equal = 0;
+    for (int k = 0; k < MINHASH_K; k++) {
+        equal += a->v[k] == b->v[k];
+    }
+    return (double)equal / MINHASH_K;
+}
+
+uint64_t minhash_band_key(const MinHashSignature *sig, int band) {
+    uint64_t key = 14695981039346656037ull;   // FNV-1a 64 位
+    for (int r = 0; r < MINHASH_ROWS; r++) {
+        uint16_t v = sig->v[band * MINHASH_ROWS + r];
+        key ^= v & 0xFF;
+        key *= 1099511628211ull;
+        key ^= v >> 8;
+        key *= 1099511628211ull;
+    }
+    return key;
+}
@@ -0,0 +1,210 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "pipeline.h"
+#include "prefetch.h"
+#include "preprocess.h"
+#include "vectorization.h"
+#include "tokenstream.h"
+#include "trace.h"
+
+// 预处理结果的 FNV-1a 哈希：两个文件去掉注释、空白、大小写之后完全相同，哈希就相同
+static uint64_t hash_clean_code(const char *clean_code) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const unsigned char *p = (const unsigned char*)clean_code; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// 预处理之后的各项计算都在这里，单文件和批量两条路径共用。
+// 需要 token 流时只分词一次：向量和签名都从编号序列算，顺便编码成缓存；
+// 不需要时大文件的向量交给 pool 分块统计
+static int analyze_clean_code(ThreadPool *pool, const char *clean_code, size_t clean_length, int vector[],
+                              MinHashSignature *sig, TokenStream *tokens, uint64_t *content_hash,
+                              const int *feature_map) {
+    if (content_hash) *content_hash = hash_clean_code(clean_code);
+    if (!tokens) {
+        generate_vector_parallel(pool, clean_code, clean_length, vector);
+        if (sig) minhash_compute(clean_code, sig);
+        return 0;
+    }
+
+    uint16_t *ids;
+    size_t count;
+    if (token_stream_collect(clean_code, &ids, &count) != 0) return -1;
+    generate_vector_from_ids(ids, count, feature_map, vector);
+    if (sig) minhash_compute_ids(ids, count, sig);
+    int rc = token_stream_encode(ids, count, tokens);
+    free(ids);
+    return rc;
+}
+
+int pipeline_vectorize_file(ThreadPool *pool, const char *path, int vector[], MinHashSignature *sig) {
+    size_t length;
+    uint64_t t = TRACE_BEGIN();
+    char *source = read_source_file(path, &length);
+    TRACE_END("read", path, t);
+    if (!source) return -1;
+    char *clean_code = (char*)malloc(length + 1);
+    if (!clean_code) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(source);
+        return -1;
+    }
+    t = TRACE_BEGIN();
+    size_t clean_length = preprocess_source_parallel(pool, source, length, clean_code);
+    TRACE_END("preprocess", path, t);
+    free(source);
+
+    t = TRACE_BEGIN();
+    generate_vector_parallel(pool, clean_code, clean_length, vector);
+    if (sig) minhash_compute(clean_code, sig);
+    TRACE_END("vectorize", path, t);
+    free(clean_code);
+    return 0;
+}
+
+// 对已经读进内存的源代码做预处理 + 向量化 (path 只用于追踪)。
+// 在线程池的任务里调用：不小于 PREPROCESS_PARALLEL_MIN 的大文件再拆成子任务，
+// 一个巨大的文件不会让其他线程在批处理的最后干等
+static int vectorize_source(ThreadPool *pool, const char *path, const char *source, size_t length, int vector[],
+                            MinHashSignature *sig, TokenStream *tokens, uint64_t *content_hash,
+                            const int *feature_map) {
+    char *clean_code = (char*)malloc(length + 1);
+    if (!clean_code) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    uint64_t t = TRACE_BEGIN();
+    size_t clean_length = preprocess_source_parallel(pool, source, length, clean_code);
+    TRACE_END("preprocess", path, t);
+    t = TRACE_BEGIN();
+    int rc = analyze_clean_code(pool, clean_code, clean_length, vector, sig, tokens, content_hash, feature_map);
+    TRACE_END("vectorize", path, t);
+    free(clean_code);
+    return rc;
+}
+
+// 同步读一个文件并处理 (没有预读时用)
+static int vectorize_path(ThreadPool *pool, const char *path, int vector[], MinHashSignature *sig,
+                          TokenStream *tokens, uint64_t *content_hash, const int *feature_map) {
+    size_t length;
+    uint64_t t = TRACE_BEGIN();
+    char *source = read_source_file(path, &length);
+    TRACE_END("read", path, t);
+    if (!source) return -1;
+    int rc = vectorize_source(pool, path, source, length, vector, sig, tokens, content_hash, feature_map);
+    free(source);
+    return rc;
+}
+
+// 调度用的文件信息
+typedef struct {
+    size_t index;    // 在输入里的下标
+    long long size;  // 文件大小，拿不到时记为 0
+} FileJob;
+
+typedef struct {
+    ThreadPool *pool;         // 大文件再拆分时用
+    const char *const *paths;
+    const FileJob *order;
+    Prefetcher *prefetcher;   // 为 NULL 时各线程自己同步读文件
+    PipelineOutput *out;
+    const int *feature_map;   // 需要 token 流时：编号 -> 特征下标
+} VectorizeJob;
+
+// 第 i 个文件的签名位置，不需要签名时为 NULL
+static MinHashSignature *signature_at(PipelineOutput *out, size_t i) {
+    return out->signatures ? &out->signatures[i] : NULL;
+}
+
+static TokenStream *tokens_at(PipelineOutput *out, size_t i) {
+    return out->tokens ? &out->tokens[i] : NULL;
+}
+
+static uint64_t *hash_at(PipelineOutput *out, size_t i) {
+    return out->content_hashes ? &out->content_hashes[i] : NULL;
+}
+
+// 大文件排前面：先把最耗时的任务派出去，小文件留在最后填空档，
+// 避免某个大文件最后才开始、其他线程全在等它 (最长处理时间优先)
+static int compare_file_job(const void *a, const void *b) {
+    const FileJob *x = (const FileJob*)a;
+    const FileJob *y = (const FileJob*)b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static void vectorize_range(size_t begin, size_t end, void *ctx) {
+    VectorizeJob *job = (VectorizeJob*)ctx;
+    for (size_t k = begin; k < end; k++) {
+        PipelineOutput *out = job->out;
+        if (!job->prefetcher) {
+            size_t i = job->order[k].index;
+            out->ok[i] = vectorize_path(job->pool, job->paths[i], out->vectors + i * VECTOR_DIMENSION,
+                                        signature_at(out, i), tokens_at(out, i), hash_at(out, i),
+                                        job->feature_map) == 0;
+            continue;
+        }
+        // 每个任务领一个已经读好的文件，不管是哪一个
+        PrefetchItem item;
+        uint64_t t = TRACE_BEGIN();
+        int got = prefetch_next(job->prefetcher, &item);
+        TRACE_END("wait_io", NULL, t);
+        if (!got) break;
+        out->ok[item.index] = item.data &&
+                              vectorize_source(job->pool, job->paths[item.index], item.data, item.size,
+                                               out->vectors + item.index * VECTOR_DIMENSION,
+                                               signature_at(out, item.index), tokens_at(out, item.index),
+                                               hash_at(out, item.index), job->feature_map) == 0;
+        free(item.data);
+    }
+}
+
+void pipeline_vectorize_files(ThreadPool *pool, const char *const *paths, size_t count,
+                              int in_flight, PipelineOutput *out) {
+    int feature_map[TOKEN_ID_COUNT];
+    if (out->tokens) {
+        build_feature_id_map(feature_map);
+        memset(out->tokens, 0, count * sizeof(TokenStream));
+    }
+
+    FileJob *order = (FileJob*)malloc((count ? count : 1) * sizeof(FileJob));
+    if (!order) {
+        // 内存紧张时退回串行处理
+        for (size_t i = 0; i < count; i++) {
+            out->ok[i] = vectorize_path(NULL, paths[i], out->vectors + i * VECTOR_DIMENSION,
+                                        signature_at(out, i), tokens_at(out, i), hash_at(out, i),
+                                        feature_map) == 0;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        order[i].index = i;
+        order[i].size = stat(paths[i], &st) == 0 ? (long long)st.st_size : 0;
+    }
+    qsort(order, count, sizeof(FileJob), compare_file_job);
+
+    // 预读线程按同样的顺序读文件，始终保持 in_flight 个文件在读或读好待处理
+    if (in_flight <= 0) in_flight = PIPELINE_DEFAULT_IN_FLIGHT;
+    size_t *read_order = (size_t*)malloc((count ? count : 1) * sizeof(size_t));
+    Prefetcher *prefetcher = NULL;
+    if (read_order) {
+        for (size_t k = 0; k < count; k++) read_order[k] = order[k].index;
+        prefetcher = prefetch_start(paths, read_order, count, in_flight);
+    }
+
+    // 每个文件单独成一个任务 (grain = 1)，工作窃取负责把它们摊匀；大文件在任务里再拆成块
+    VectorizeJob job = { pool, paths, order, prefetcher, out, feature_map };
+    threadpool_parallel_for(pool, 0, count, 1, vectorize_range, &job);
+
+    prefetch_stop(prefetcher);
+    free(read_order);
+    free(order);
+}
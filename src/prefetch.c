@@ -0,0 +1,459 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "prefetch.h"
+#include "preprocess.h"
+#include "trace.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PREFETCH_HAVE_IO_URING
+#endif
+#endif
+
+#ifdef PREFETCH_HAVE_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+struct Prefetcher {
+    const char *const *paths;
+    const size_t *order;
+    size_t count;
+    int in_flight;
+    const char *backend;
+
+    // 有界队列 (环形数组)
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    PrefetchItem *queue;
+    size_t head, tail;       // tail - head 是队列里的元素个数
+    size_t delivered;        // 已经被 prefetch_next 取走的个数
+    int stop;
+
+    size_t next;             // 下一个要读的文件 (线程后端用，受 lock 保护)
+    pthread_t *threads;
+    int thread_count;
+};
+
+static size_t file_at(const Prefetcher *pf, size_t k) {
+    return pf->order ? pf->order[k] : k;
+}
+
+// 把读好的文件放进队列；队列满了就等消费者取走。返回 -1 表示已经被要求停止
+static int queue_push(Prefetcher *pf, PrefetchItem item) {
+    pthread_mutex_lock(&pf->lock);
+    while (pf->tail - pf->head == (size_t)pf->in_flight && !pf->stop) {
+        pthread_cond_wait(&pf->not_full, &pf->lock);
+    }
+    if (pf->stop) {
+        pthread_mutex_unlock(&pf->lock);
+        free(item.data);
+        return -1;
+    }
+    pf->queue[pf->tail % (size_t)pf->in_flight] = item;
+    pf->tail++;
+    pthread_cond_signal(&pf->not_empty);
+    pthread_mutex_unlock(&pf->lock);
+    return 0;
+}
+
+// ---------------- 线程后端：每个 I/O 线程阻塞读一个文件 ----------------
+
+static void *reader_main(void *arg) {
+    Prefetcher *pf = (Prefetcher*)arg;
+    trace_thread_name("io reader");
+    for (;;) {
+        pthread_mutex_lock(&pf->lock);
+        if (pf->stop || pf->next >= pf->count) {
+            pthread_mutex_unlock(&pf->lock);
+            break;
+        }
+        size_t k = pf->next++;
+        pthread_mutex_unlock(&pf->lock);
+
+        PrefetchItem item;
+        item.index = file_at(pf, k);
+        item.size = 0;
+        uint64_t t = TRACE_BEGIN();
+        item.data = read_source_file(pf->paths[item.index], &item.size);
+        TRACE_END("read", pf->paths[item.index], t);
+        if (queue_push(pf, item) != 0) break;
+    }
+    return NULL;
+}
+
+static int start_threads(Prefetcher *pf) {
+    int wanted = pf->count < (size_t)pf->in_flight ? (int)pf->count : pf->in_flight;
+    if (wanted < 1) wanted = 1;
+    pf->threads = (pthread_t*)malloc((size_t)wanted * sizeof(pthread_t));
+    if (!pf->threads) return -1;
+    for (int i = 0; i < wanted; i++) {
+        if (pthread_create(&pf->threads[i], NULL, reader_main, pf) != 0) break;
+        pf->thread_count++;
+    }
+    pf->backend = "threads";
+    return pf->thread_count > 0 ? 0 : -1;
+}
+
+// ---------------- io_uring 后端：一个线程挂着 in_flight 个读请求 ----------------
+
+#ifdef PREFETCH_HAVE_IO_URING
+
+// 没有 liburing，直接用系统调用操作提交队列 (SQ) 和完成队列 (CQ)
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+} Ring;
+
+// 一个正在读的文件
+typedef struct {
+    size_t index;
+    int fd;
+    char *data;
+    size_t size;
+    size_t done;
+    struct iovec iov;
+} ReadSlot;
+
+typedef struct {
+    Prefetcher *pf;
+    Ring ring;
+} UringReader;
+
+static int ring_setup(Ring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -1;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    if (single) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (!single) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return -1;
+    }
+
+    char *sq = (char*)ring->sq_ring;
+    char *cq = (char*)ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ring_teardown(Ring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// 为 slot 剩下没读的部分准备一个 READV 请求 (READV 比 READ 支持的内核更老)
+static void ring_queue_read(Ring *ring, ReadSlot *slot, size_t slot_id) {
+    unsigned tail = *ring->sq_tail;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+    slot->iov.iov_base = slot->data + slot->done;
+    slot->iov.iov_len = slot->size - slot->done;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = slot->fd;
+    sqe->addr = (unsigned long long)(uintptr_t)&slot->iov;
+    sqe->len = 1;
+    sqe->off = slot->done;
+    sqe->user_data = slot_id;
+
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// 打开文件并取得大小；失败时按 read_source_file 的格式报错
+static int open_slot(ReadSlot *slot, const char *path) {
+    slot->fd = open(path, O_RDONLY);
+    if (slot->fd < 0) {
+        printf("错误：无法打开文件 %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(slot->fd, &st) != 0 || st.st_size <= 0) {
+        close(slot->fd);
+        fprintf(stderr, "错误：文件为空或读取失败\n");
+        return -1;
+    }
+    slot->size = (size_t)st.st_size;
+    slot->done = 0;
+    slot->data = (char*)malloc(slot->size + 1);
+    if (!slot->data) {
+        close(slot->fd);
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void *uring_main(void *arg) {
+    UringReader *reader = (UringReader*)arg;
+    Prefetcher *pf = reader->pf;
+    Ring *ring = &reader->ring;
+    int depth = pf->in_flight;
+
+    ReadSlot *slots = (ReadSlot*)calloc((size_t)depth, sizeof(ReadSlot));
+    size_t *free_ids = (size_t*)malloc((size_t)depth * sizeof(size_t));
+    int free_count = depth;
+    int active = 0;
+    unsigned to_submit = 0;
+    size_t next = 0;
+    int aborted = !slots || !free_ids;
+    for (int i = 0; !aborted && i < depth; i++) free_ids[i] = (size_t)(depth - 1 - i);
+    trace_thread_name("io_uring");
+
+    while (!aborted && (next < pf->count || active > 0)) {
+        // 1. 补满在途请求
+        while (free_count > 0 && next < pf->count) {
+            size_t index = file_at(pf, next++);
+            size_t id = free_ids[free_count - 1];
+            ReadSlot *slot = &slots[id];
+            slot->index = index;
+            if (open_slot(slot, pf->paths[index]) != 0) {
+                PrefetchItem failed = { index, NULL, 0 };
+                if (queue_push(pf, failed) != 0) aborted = 1;
+                if (aborted) break;
+                continue;
+            }
+            free_count--;
+            ring_queue_read(ring, slot, id);
+            to_submit++;
+            active++;
+        }
+        if (aborted || active == 0) continue;
+
+        // 2. 提交并至少等一个完成 (在途的读请求互相重叠，追踪里只记等待完成的时间)
+        uint64_t t = TRACE_BEGIN();
+        int rc = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        TRACE_END("io_uring_enter", NULL, t);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            aborted = 1;
+            break;
+        }
+        to_submit -= (unsigned)rc < to_submit ? (unsigned)rc : to_submit;
+
+        // 3. 收割完成队列
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            size_t id = (size_t)cqe->user_data;
+            ReadSlot *slot = &slots[id];
+
+            if (cqe->res > 0) {
+                slot->done += (size_t)cqe->res;
+                if (slot->done < slot->size) {
+                    ring_queue_read(ring, slot, id);   // 读了一部分，接着读剩下的
+                    to_submit++;
+                    continue;
+                }
+            }
+
+            PrefetchItem item = { slot->index, slot->data, slot->size };
+            if (slot->done != slot->size) {
+                fprintf(stderr, "错误：文件读取不完整\n");
+                free(item.data);
+                item.data = NULL;
+                item.size = 0;
+            } else {
+                item.data[item.size] = '\0';
+            }
+            close(slot->fd);
+            slot->data = NULL;
+            free_ids[free_count++] = id;
+            active--;
+            if (queue_push(pf, item) != 0) aborted = 1;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // 中途出错或被叫停：等内核把在途请求做完，再把这些文件当作读取失败交出去
+    while (slots && active > 0) {
+        if (syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR) {
+            break;
+        }
+        to_submit = 0;
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            ReadSlot *slot = &slots[(size_t)ring->cqes[head & *ring->cq_mask].user_data];
+            PrefetchItem failed = { slot->index, NULL, 0 };
+            close(slot->fd);
+            free(slot->data);
+            slot->data = NULL;
+            active--;
+            queue_push(pf, failed);
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    // 内核不再响应时，剩下的缓冲区可能还被内核引用着，宁可泄漏也不释放
+    for (int i = 0; slots && active > 0 && i < depth; i++) {
+        if (!slots[i].data) continue;
+        PrefetchItem failed = { slots[i].index, NULL, 0 };
+        active--;
+        queue_push(pf, failed);
+    }
+
+    // 还没读的文件也要交代清楚，消费者才不会一直等下去
+    while (aborted && next < pf->count) {
+        PrefetchItem failed = { file_at(pf, next++), NULL, 0 };
+        if (queue_push(pf, failed) != 0) break;
+    }
+
+    ring_teardown(ring);
+    free(slots);
+    free(free_ids);
+    free(reader);
+    return NULL;
+}
+
+static int start_uring(Prefetcher *pf) {
+    UringReader *reader = (UringReader*)malloc(sizeof(UringReader));
+    if (!reader) return -1;
+    reader->pf = pf;
+    if (ring_setup(&reader->ring, (unsigned)pf->in_flight) != 0) {
+        free(reader);
+        return -1;
+    }
+    pf->threads = (pthread_t*)malloc(sizeof(pthread_t));
+    if (!pf->threads || pthread_create(&pf->threads[0], NULL, uring_main, reader) != 0) {
+        ring_teardown(&reader->ring);
+        free(reader);
+        free(pf->threads);
+        pf->threads = NULL;
+        return -1;
+    }
+    pf->thread_count = 1;
+    pf->backend = "io_uring";
+    return 0;
+}
+
+#endif
+
+// ---------------- 对外接口 ----------------
+
+Prefetcher *prefetch_start(const char *const *paths, const size_t *order, size_t count,
+                           int in_flight) {
+    if (in_flight < 1) in_flight = 1;
+
+    Prefetcher *pf = (Prefetcher*)calloc(1, sizeof(Prefetcher));
+    if (!pf) return NULL;
+    pf->queue = (PrefetchItem*)malloc((size_t)in_flight * sizeof(PrefetchItem));
+    if (!pf->queue) {
+        free(pf);
+        return NULL;
+    }
+    pf->paths = paths;
+    pf->order = order;
+    pf->count = count;
+    pf->in_flight = in_flight;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->not_empty, NULL);
+    pthread_cond_init(&pf->not_full, NULL);
+
+    int started = -1;
+#ifdef PREFETCH_HAVE_IO_URING
+    started = start_uring(pf);
+#endif
+    if (started != 0) started = start_threads(pf);
+    if (started != 0) {
+        prefetch_stop(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+int prefetch_next(Prefetcher *pf, PrefetchItem *item) {
+    pthread_mutex_lock(&pf->lock);
+    if (pf->delivered == pf->count) {
+        pthread_mutex_unlock(&pf->lock);
+        return 0;
+    }
+    while (pf->tail == pf->head) {
+        pthread_cond_wait(&pf->not_empty, &pf->lock);
+    }
+    *item = pf->queue[pf->head % (size_t)pf->in_flight];
+    pf->head++;
+    pf->delivered++;
+    pthread_cond_signal(&pf->not_full);
+    pthread_mutex_unlock(&pf->lock);
+    return 1;
+}
+
+void prefetch_stop(Prefetcher *pf) {
+    if (!pf) return;
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = 1;
+    pthread_cond_broadcast(&pf->not_full);
+    pthread_mutex_unlock(&pf->lock);
+
+    for (int i = 0; i < pf->thread_count; i++) pthread_join(pf->threads[i], NULL);
+    for (; pf->head != pf->tail; pf->head++) free(pf->queue[pf->head % (size_t)pf->in_flight].data);
+
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->not_empty);
+    pthread_cond_destroy(&pf->not_full);
+    free(pf->threads);
+    free(pf->queue);
+    free(pf);
+}
+
+const char *prefetch_backend(const Prefetcher *pf) {
+    return pf->backend;
+}
@@ -4,7 +4,16 @@
 #include <ctype.h>                   //字符分类/转换
 #include "preprocess.h"
 
-char* preprocess_file(const char* filepath)   //返回处理后的字符串
+// 向量化扫描：x86-64 上 SSE2 一定可用 (一次 16 字节)，用 -mavx2 或 -march=native 编译时换成 AVX2 (一次 32 字节)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PREPROCESS_SIMD_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PREPROCESS_SIMD_WIDTH 16
+#endif
+
+char* read_source_file(const char* filepath, size_t* length)   //返回以'\0'结尾的文件内容
 {
     FILE* file = fopen(filepath, "r");        //以只读的方式打开文件
     if (!file) {                              //打开失败处理
@@ -43,26 +52,259 @@ char* preprocess_file(const char* filepath)   //返回处理后的字符串
     }
     source[bytes_read] = '\0';            //添加字符串终止符  
 
+    if (length) *length = bytes_read;
+    return source;
+}
+
+char* preprocess_file(const char* filepath)   //返回处理后的字符串
+{
+    size_t length = 0;
+    char* source = read_source_file(filepath, &length);
+    if (!source) {
+        return NULL;
+    }
+
+    char* result = preprocess_source(source, length);
+    free(source);                             //释放源文件缓冲区
+    return result;
+}
+
+char* preprocess_source(const char* source, size_t length)   //source必须以'\0'结尾
+{
     // 分配结果缓冲区（处理后内容通常更短）
-    char* result = (char*)malloc(bytes_read + 1);
+    char* result = (char*)malloc(length + 1);
     if (!result) {
-        free(source);
         fprintf(stderr, "错误：内存分配失败\n");
         return NULL;
     }
 
+    preprocess_source_into(source, length, result);
+    return result;
+}
+
+// ---------------- 快速跳过：注释体、字符串内容、空白串 ----------------
+// 状态机每个字节都要检查一遍六个标志，在长注释和长字符串里很浪费。
+// 这些状态下真正要看的只有少数几个分隔符，用向量指令一次比较一整块，直接跳到下一个分隔符。
+// 三个函数都返回 [i, length) 里第一个满足条件的位置，找不到返回 length (也就是 '\0' 的位置)；
+// 遇到提前出现的 '\0' 同样停下，保证和逐字节扫描在同一个地方结束。
+
+// 第一个等于 a、b 或 '\0' 的位置 (只找一个字符时 a、b 传同一个)
+static size_t find_delimiter(const char* source, size_t i, size_t length, char a, char b)
+{
+#if PREPROCESS_SIMD_WIDTH == 32
+    const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), zero = _mm256_setzero_si256();
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                      _mm256_cmpeq_epi8(v, zero));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif PREPROCESS_SIMD_WIDTH == 16
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                   _mm_cmpeq_epi8(v, zero));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    // 标量尾部 (或者没有向量指令的平台)
+    while (i < length && source[i] != a && source[i] != b && source[i] != '\0') i++;
+    return i;
+}
+
+// 块注释的结尾：第一个后面紧跟 '/' 的 '*'，或者 '\0'。
+// 只找 '*' 的话，" * " 开头的注释每一行都要停一次；这里把错开一个字节的两次比较与起来，一次判断整块
+static size_t find_comment_end(const char* source, size_t i, size_t length)
+{
+#if PREPROCESS_SIMD_WIDTH == 32
+    const __m256i star = _mm256_set1_epi8('*'), slash = _mm256_set1_epi8('/'), zero = _mm256_setzero_si256();
+    for (; i + 32 <= length; i += 32) {   // 第二次读到 source[i + 32]，最多到 '\0' 为止
+        __m256i v = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(source + i + 1));
+        __m256i hit = _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(v, star), _mm256_cmpeq_epi8(w, slash)),
+                                      _mm256_cmpeq_epi8(v, zero));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif PREPROCESS_SIMD_WIDTH == 16
+    const __m128i star = _mm_set1_epi8('*'), slash = _mm_set1_epi8('/'), zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i w = _mm_loadu_si128((const __m128i*)(source + i + 1));
+        __m128i hit = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(v, star), _mm_cmpeq_epi8(w, slash)),
+                                   _mm_cmpeq_epi8(v, zero));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (i < length && source[i] != '\0' && !(source[i] == '*' && source[i + 1] == '/')) i++;
+    return i;
+}
+
+// 第一个不是空白的位置。空白按 C locale 的 isspace：'\t' '\n' '\v' '\f' '\r' 和空格
+static size_t skip_spaces(const char* source, size_t i, size_t length)
+{
+#if PREPROCESS_SIMD_WIDTH == 32
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), four = _mm256_set1_epi8(4);
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i t = _mm256_sub_epi8(v, tab);   // '\t'..'\r' 变成 0..4，其余字节无符号比较都大于 4
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(ws);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif PREPROCESS_SIMD_WIDTH == 16
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4);
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i t = _mm_sub_epi8(v, tab);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(_mm_min_epu8(t, four), t));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(ws) & 0xFFFFu;
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (i < length && isspace((unsigned char)source[i])) i++;
+    return i;
+}
+
+// 普通代码里第一个可能改变词法状态的字符：'/'、'"'、'#' 或 '\0'。只在分块时推算状态用，空白不用管
+static size_t find_code_delimiter(const char* source, size_t i, size_t length)
+{
+#if PREPROCESS_SIMD_WIDTH == 32
+    const __m256i slash = _mm256_set1_epi8('/'), quote = _mm256_set1_epi8('"'), hash = _mm256_set1_epi8('#');
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, slash), _mm256_cmpeq_epi8(v, quote)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, hash), _mm256_cmpeq_epi8(v, zero)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif PREPROCESS_SIMD_WIDTH == 16
+    const __m128i slash = _mm_set1_epi8('/'), quote = _mm_set1_epi8('"'), hash = _mm_set1_epi8('#');
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, quote)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, hash), _mm_cmpeq_epi8(v, zero)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (i < length && source[i] != '/' && source[i] != '"' && source[i] != '#' && source[i] != '\0') i++;
+    return i;
+}
+
+// 普通代码：把一段不会改变状态的字符 (除了 '/'、'"'、'#'、空白和 '\0' 以外的字符) 转成小写复制到 out，
+// 返回这段的终点。out 至少还有 (终点 - i) 个字节可写；向量路径会整块写入，但不会超过 source 剩余的长度
+static size_t copy_plain(const char* source, size_t i, size_t length, char* out, uint32_t* offsets)
+{
+    size_t start = i;
+#if PREPROCESS_SIMD_WIDTH == 32
+    const __m256i slash = _mm256_set1_epi8('/'), quote = _mm256_set1_epi8('"'), hash = _mm256_set1_epi8('#');
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), four = _mm256_set1_epi8(4);
+    const __m256i upper_a = _mm256_set1_epi8('A'), letters = _mm256_set1_epi8(25), case_bit = _mm256_set1_epi8(0x20);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i t = _mm256_sub_epi8(v, tab);
+        __m256i stop = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, slash), _mm256_cmpeq_epi8(v, quote)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(v, hash), _mm256_cmpeq_epi8(v, zero)));
+        stop = _mm256_or_si256(stop, _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                                     _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t)));
+        __m256i u = _mm256_sub_epi8(v, upper_a);   // 'A'..'Z' 变成 0..25
+        __m256i is_upper = _mm256_cmpeq_epi8(_mm256_min_epu8(u, letters), u);
+        _mm256_storeu_si256((__m256i*)(out + (i - start)), _mm256_add_epi8(v, _mm256_and_si256(is_upper, case_bit)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(stop);
+        if (mask) {
+            i += (size_t)__builtin_ctz(mask);
+            goto done;
+        }
+    }
+#elif PREPROCESS_SIMD_WIDTH == 16
+    const __m128i slash = _mm_set1_epi8('/'), quote = _mm_set1_epi8('"'), hash = _mm_set1_epi8('#');
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4);
+    const __m128i upper_a = _mm_set1_epi8('A'), letters = _mm_set1_epi8(25), case_bit = _mm_set1_epi8(0x20);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i t = _mm_sub_epi8(v, tab);
+        __m128i stop = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, quote)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v, hash), _mm_cmpeq_epi8(v, zero)));
+        stop = _mm_or_si128(stop, _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(_mm_min_epu8(t, four), t)));
+        __m128i u = _mm_sub_epi8(v, upper_a);
+        __m128i is_upper = _mm_cmpeq_epi8(_mm_min_epu8(u, letters), u);
+        _mm_storeu_si128((__m128i*)(out + (i - start)), _mm_add_epi8(v, _mm_and_si128(is_upper, case_bit)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(stop);
+        if (mask) {
+            i += (size_t)__builtin_ctz(mask);
+            goto done;
+        }
+    }
+#endif
+    while (i < length) {
+        unsigned char c = (unsigned char)source[i];
+        if (c == '/' || c == '"' || c == '#' || c == '\0' || isspace(c)) break;
+        out[i - start] = (char)tolower(c);
+        i++;
+    }
+#if defined(PREPROCESS_SIMD_WIDTH)
+done:
+#endif
+    if (offsets) {
+        for (size_t k = start; k < i; k++) offsets[k - start] = (uint32_t)k;
+    }
+    return i;
+}
+
+// 词法状态：分块处理时，一块的开头可能落在注释、字符串或预处理指令中间
+enum {
+    LEX_CODE,              // 普通代码
+    LEX_BLOCK_COMMENT,     // /* ... */ 里面
+    LEX_LINE_COMMENT,      // // 到行尾
+    LEX_DIRECTIVE,         // # 到行尾
+    LEX_STRING,            // 字符串里面
+    LEX_STRING_ESCAPE,     // 字符串里面，下一个字符被 \ 转义
+    LEX_STATE_COUNT
+};
+
+static size_t preprocess_range(const char* source, size_t begin, size_t end, int state, int emitted,
+                               char* result, uint32_t* offsets, int* end_state);
+
+size_t preprocess_source_into(const char* source, size_t length, char* result)   //不分配内存也不输出信息
+{
+    return preprocess_source_mapped(source, length, result, NULL);
+}
+
+size_t preprocess_source_mapped(const char* source, size_t length, char* result, uint32_t* offsets)   //offsets可以为NULL
+{
+    size_t result_length = preprocess_range(source, 0, length, LEX_CODE, 0, result, offsets, NULL);
+    result[result_length] = '\0';   //确保结果字符串正确终止
+    return result_length;
+}
+
+// 处理 [begin, end) 这一段：从状态 state 开始，*end_state 返回结束时的状态 (可以为 NULL)。
+// emitted 表示前面已经有输出 (分块处理时除第一块外都当作有)，决定开头的空白要不要输出一个空格。
+// 整个文件一次处理完就是 begin = 0、end = length、state = LEX_CODE、emitted = 0
+static size_t preprocess_range(const char* source, size_t begin, size_t end, int state, int emitted,
+                               char* result, uint32_t* offsets, int* end_state)
+{
     // 状态标志
-    int in_comment = 0;           // 是否在多行注释中(/*……*/)
-    int in_single_comment = 0;    // 是否在单行注释中(//……)
-    int in_string = 0;            // 是否在字符串中
-    int in_include = 0;           // 是否在预处理指令中(#开头的行)
+    int in_comment = state == LEX_BLOCK_COMMENT;            // 是否在多行注释中(/*……*/)
+    int in_single_comment = state == LEX_LINE_COMMENT;      // 是否在单行注释中(//……)
+    int in_string = state == LEX_STRING || state == LEX_STRING_ESCAPE;   // 是否在字符串中
+    int in_include = state == LEX_DIRECTIVE;                // 是否在预处理指令中(#开头的行)
     int last_char_was_space = 0;  // 前一个字符是空格(用于压缩空格)
-    int escape_next = 0;          // 转义下一个字符（用于字符串中的\）  
+    int escape_next = state == LEX_STRING_ESCAPE;           // 转义下一个字符（用于字符串中的\）
 
+    size_t length = end;          //快速路径只扫描到这一段的末尾
     size_t result_index = 0;      //结果缓冲区索引    
-    size_t i = 0;                 //源字符串索引      
+    size_t i = begin;             //源字符串索引      
 
-    while (source[i] != '\0') 
+    while (i < end && source[i] != '\0') 
     {
         char current = source[i];        //定义字符current               
         char next = source[i + 1];       //定义字符next
@@ -75,6 +317,32 @@ char* preprocess_file(const char* filepath)   //返回处理后的字符串
             continue;
         }
 
+        // 0. 快速路径：注释、预处理指令、字符串里面只关心下一个分隔符，整块跳过中间的内容；
+        //    普通代码里只关心可能改变状态的字符，中间的部分整块复制
+        if (in_comment || in_single_comment || in_include || in_string)
+        {
+            size_t skip_to;
+            if (in_comment)      skip_to = find_comment_end(source, i, length);            //找 "*/"
+            else if (in_string)  skip_to = find_delimiter(source, i, length, '"', '\\');  //找结束引号或转义
+            else                 skip_to = find_delimiter(source, i, length, '\n', '\n');  //找行尾
+            if (skip_to != i) {
+                i = skip_to;
+                continue;
+            }
+        }
+        else
+        {
+            // 普通代码：整段转小写复制，遇到可能改变状态的字符再交给下面的状态机
+            size_t run_end = copy_plain(source, i, length, result + result_index,
+                                        offsets ? offsets + result_index : NULL);
+            if (run_end != i) {
+                result_index += run_end - i;
+                last_char_was_space = 0;
+                i = run_end;
+                continue;
+            }
+        }
+
         // 1. 多行注释处理
         if (!in_string && !in_single_comment && !in_include) //不在其他特殊状态中
         {
@@ -152,17 +420,19 @@ char* preprocess_file(const char* filepath)   //返回处理后的字符串
         // 5. 空白字符处理
         if (isspace(current)) 
         {
-            if (!last_char_was_space && result_index > 0) {
+            if (!last_char_was_space && (result_index > 0 || emitted)) {
+                if (offsets) offsets[result_index] = (uint32_t)i;   //记录这个字符来自原文件的哪个字节
                 result[result_index++] = ' ';
                 last_char_was_space = 1;
             }
-            i++;
+            i = skip_spaces(source, i + 1, length);   //连续的空白只保留一个，剩下的整段跳过
             continue;
         }
 
         // 6. 正常字符处理：转换为小写并添加到结果
         if (!in_comment && !in_single_comment && !in_include && !in_string) 
         {
+            if (offsets) offsets[result_index] = (uint32_t)i;
             result[result_index++] = tolower(current);
             last_char_was_space = 0;
         }
@@ -170,16 +440,173 @@ char* preprocess_file(const char* filepath)   //返回处理后的字符串
         i++;
     }
 
-    // 确保结果字符串正确终止
-    result[result_index] = '\0';
+    if (end_state) {
+        if (in_comment) *end_state = LEX_BLOCK_COMMENT;
+        else if (in_single_comment) *end_state = LEX_LINE_COMMENT;
+        else if (in_include) *end_state = LEX_DIRECTIVE;
+        else if (in_string) *end_state = escape_next ? LEX_STRING_ESCAPE : LEX_STRING;
+        else *end_state = LEX_CODE;
+    }
 
-    // 释放源文件缓冲区
-    free(source);
+    return result_index;   //不写结尾的 '\0'：分块处理时这个位置属于下一块
+}
+
+// ---------------- 大文件分块并行 ----------------
+// 一个几百 MB 的文件只能由一个线程从头扫到尾。这里把它切成若干块并行处理：
+//   1. 分界只选在前一个字节不是 '/' 或 '*' 的位置，这样 "/*"、"*/"、"//" 不会被切开，
+//      块与块之间只需要传递上面六种词法状态之一
+//   2. 每块并行地从六种状态各推算一遍结束状态 (只跟踪状态，不输出，靠快速跳过几乎不花时间)
+//   3. 从第一块 (一定从普通代码开始) 依次串起来，得到每块真正的起始状态
+//   4. 每块并行地做真正的预处理，结果写在自己那一段里，最后依次挪到一起
+// 空白的压缩跨块处理：除第一块外，块开头的空白一律先输出一个空格，拼接时如果前面的结果
+// 为空或已经以空格结尾就去掉它，结果与一次处理完逐字节相同。
 
-    // 如果结果为空，返回空字符串
-    if (result_index == 0) {
-        result[0] = '\0';
+// 只跟踪状态：从 state 开始扫描 [i, end)，返回结束时的状态。转移规则与 preprocess_range 一致
+static int lex_state_after(const char* source, size_t i, size_t end, int state)
+{
+    while (i < end) {
+        switch (state) {
+            case LEX_STRING_ESCAPE:
+                state = LEX_STRING;
+                i++;
+                break;
+            case LEX_STRING:
+                i = find_delimiter(source, i, end, '"', '\\');
+                if (i >= end) return state;
+                state = source[i] == '"' ? LEX_CODE : LEX_STRING_ESCAPE;
+                i++;
+                break;
+            case LEX_BLOCK_COMMENT:
+                i = find_comment_end(source, i, end);
+                if (i >= end) return state;
+                state = LEX_CODE;
+                i += 2;
+                break;
+            case LEX_LINE_COMMENT:
+            case LEX_DIRECTIVE:
+                i = find_delimiter(source, i, end, '\n', '\n');
+                if (i >= end) return state;
+                state = LEX_CODE;
+                i++;
+                break;
+            default:
+                i = find_code_delimiter(source, i, end);
+                if (i >= end) return state;
+                if (source[i] == '"') {
+                    state = LEX_STRING;
+                    i++;
+                } else if (source[i] == '#') {
+                    state = LEX_DIRECTIVE;
+                    i++;
+                } else if (source[i + 1] == '*') {
+                    state = LEX_BLOCK_COMMENT;
+                    i += 2;
+                } else if (source[i + 1] == '/') {
+                    state = LEX_LINE_COMMENT;
+                    i += 2;
+                } else {
+                    i++;
+                }
+                break;
+        }
     }
+    return state;
+}
 
-    return result;
+typedef struct {
+    const char* source;
+    const size_t* bounds;            // 块数 + 1 个分界
+    int (*ends)[LEX_STATE_COUNT];    // ends[k][s]：第 k 块从状态 s 开始时的结束状态
+    const int* starts;               // 每块真正的起始状态 (第 4 步用)
+    char* result;
+    size_t* lengths;                 // 每块的结果长度
+} LexChunkJob;
+
+static void enumerate_chunk_states(size_t begin, size_t end, void* ctx)
+{
+    LexChunkJob* job = (LexChunkJob*)ctx;
+    for (size_t k = begin; k < end; k++) {
+        // 第一块只可能从普通代码开始
+        int states = k == 0 ? 1 : LEX_STATE_COUNT;
+        for (int s = 0; s < states; s++) {
+            job->ends[k][s] = lex_state_after(job->source, job->bounds[k], job->bounds[k + 1], s);
+        }
+    }
+}
+
+static void lex_chunks(size_t begin, size_t end, void* ctx)
+{
+    LexChunkJob* job = (LexChunkJob*)ctx;
+    for (size_t k = begin; k < end; k++) {
+        job->lengths[k] = preprocess_range(job->source, job->bounds[k], job->bounds[k + 1], job->starts[k],
+                                           k > 0, job->result + job->bounds[k], NULL, NULL);
+    }
+}
+
+// 按 chunk_size 切块并行处理；切不出两块或内存不足时退回串行
+static size_t preprocess_chunked(ThreadPool* pool, const char* source, size_t length, char* result,
+                                 size_t chunk_size)
+{
+    // 串行版本遇到 '\0' 就停，分块也只处理它之前的部分
+    const char* nul = (const char*)memchr(source, '\0', length);
+    if (nul) length = (size_t)(nul - source);
+
+    size_t max_chunks = length / chunk_size + 1;
+    size_t* bounds = (size_t*)malloc((max_chunks + 1) * sizeof(size_t));
+    int (*ends)[LEX_STATE_COUNT] = (int (*)[LEX_STATE_COUNT])malloc(max_chunks * sizeof(*ends));
+    int* starts = (int*)malloc(max_chunks * sizeof(int));
+    size_t* lengths = (size_t*)malloc(max_chunks * sizeof(size_t));
+    size_t chunk_count = 0;
+    if (bounds && ends && starts && lengths) {
+        bounds[0] = 0;
+        for (size_t k = 1; k < max_chunks; k++) {
+            size_t b = k * chunk_size;
+            if (b <= bounds[chunk_count]) continue;
+            while (b < length && (source[b - 1] == '/' || source[b - 1] == '*')) b++;
+            if (b >= length) break;
+            bounds[++chunk_count] = b;
+        }
+        bounds[++chunk_count] = length;
+    }
+    if (chunk_count < 2) {
+        free(bounds);
+        free(ends);
+        free(starts);
+        free(lengths);
+        return preprocess_source_into(source, length, result);
+    }
+
+    LexChunkJob job = { source, bounds, ends, starts, result, lengths };
+    threadpool_parallel_for(pool, 0, chunk_count, 1, enumerate_chunk_states, &job);
+    starts[0] = LEX_CODE;
+    for (size_t k = 1; k < chunk_count; k++) starts[k] = ends[k - 1][starts[k - 1]];
+    threadpool_parallel_for(pool, 0, chunk_count, 1, lex_chunks, &job);
+
+    // 每块的结果在它自己那一段的开头，依次挪到一起
+    size_t total = 0;
+    for (size_t k = 0; k < chunk_count; k++) {
+        const char* data = result + bounds[k];
+        size_t n = lengths[k];
+        if (k > 0 && n > 0 && data[0] == ' ' && (total == 0 || result[total - 1] == ' ')) {
+            data++;
+            n--;
+        }
+        memmove(result + total, data, n);
+        total += n;
+    }
+    result[total] = '\0';
+
+    free(bounds);
+    free(ends);
+    free(starts);
+    free(lengths);
+    return total;
+}
+
+size_t preprocess_source_parallel(ThreadPool* pool, const char* source, size_t length, char* result)
+{
+    if (!pool || threadpool_size(pool) < 2 || length < PREPROCESS_PARALLEL_MIN) {
+        return preprocess_source_into(source, length, result);
+    }
+    return preprocess_chunked(pool, source, length, result, PREPROCESS_CHUNK_SIZE);
 }
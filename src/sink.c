@@ -0,0 +1,385 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "sink.h"
+#include "json.h"
+#include "gst.h"
+#include "locate.h"
+
+#define SINK_LOCATE_BATCH 4096        // 非工作线程攒够这么多条结果再并行定位
+
+// 一个线程的缓冲区；超长的路径会让它临时变大
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} SinkBuffer;
+
+// 等待定位的一条结果；located 为 0 表示某个文件读不到或内存不足，不输出片段
+typedef struct {
+    uint32_t a, b;
+    double score;
+    MatchRegion *regions;
+    size_t count;
+    int located;
+} LocatedPair;
+
+struct ResultSink {
+    FILE *file;
+    int owns_file;                // 1 = 自己打开的文件，关闭时 fclose
+    SinkFormat format;
+    const Corpus *corpus;
+    double threshold;
+    int workers;
+    SinkBuffer *buffers;          // workers + 1 块，最后一块给非工作线程
+    pthread_mutex_t lock;         // 只在整块写出时加锁
+    int failed;
+    int header_written;           // CSV 表头在第一次写出时才写，--locate 会多一列
+
+    ThreadPool *pool;                      // 非 NULL 表示开启了 --locate
+    _Atomic(LocatedTokens*) *located;      // 每个文件一项，第一次用到时读取
+    LocatedPair *pending;                  // 非工作线程输出、还没定位的结果
+    size_t pending_count;
+};
+
+static LocatedTokens locate_failed;       // 读不到的文件记成它，不再重读、不重复报错
+
+int sink_parse_format(const char *name, SinkFormat *format) {
+    static const struct { const char *name; SinkFormat format; } formats[] = {
+        { "text", SINK_FORMAT_TEXT }, { "csv", SINK_FORMAT_CSV },
+        { "jsonl", SINK_FORMAT_JSONL }, { "binary", SINK_FORMAT_BINARY }
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (strcmp(name, formats[i].name) == 0) {
+            *format = formats[i].format;
+            return 0;
+        }
+    }
+    fprintf(stderr, "错误：未知的输出格式 '%s'，可选 text / csv / jsonl / binary\n", name);
+    return -1;
+}
+
+ResultSink *result_sink_open(const char *out_path, SinkFormat format, const Corpus *corpus,
+                             double threshold, int workers) {
+    if (workers < 0) workers = 0;
+    ResultSink *sink = (ResultSink*)calloc(1, sizeof(ResultSink));
+    if (!sink) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return NULL;
+    }
+    sink->format = format;
+    sink->corpus = corpus;
+    sink->threshold = threshold;
+    sink->workers = workers;
+    sink->buffers = (SinkBuffer*)calloc((size_t)workers + 1, sizeof(SinkBuffer));
+    if (!sink->buffers) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(sink);
+        return NULL;
+    }
+
+    if (out_path == NULL || strcmp(out_path, "-") == 0) {
+        sink->file = stdout;
+    } else {
+        sink->file = fopen(out_path, format == SINK_FORMAT_BINARY ? "wb" : "w");
+        if (!sink->file) {
+            fprintf(stderr, "错误：无法创建输出文件 %s\n", out_path);
+            free(sink->buffers);
+            free(sink);
+            return NULL;
+        }
+        sink->owns_file = 1;
+    }
+    pthread_mutex_init(&sink->lock, NULL);
+    return sink;
+}
+
+int result_sink_enable_locate(ResultSink *sink, ThreadPool *pool) {
+    sink->located = (_Atomic(LocatedTokens*)*)calloc(sink->corpus->count ? sink->corpus->count : 1,
+                                                     sizeof(*sink->located));
+    sink->pending = (LocatedPair*)malloc(SINK_LOCATE_BATCH * sizeof(LocatedPair));
+    if (!sink->located || !sink->pending) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        free(sink->located);
+        free(sink->pending);
+        sink->located = NULL;
+        sink->pending = NULL;
+        return -1;
+    }
+    sink->pool = pool;
+    return 0;
+}
+
+// 调用者持有 sink->lock
+static void sink_write_header(ResultSink *sink) {
+    if (sink->header_written) return;
+    sink->header_written = 1;
+    if (sink->format != SINK_FORMAT_CSV) return;
+    const char *header = sink->pool ? "file_a,file_b,score,regions\n" : "file_a,file_b,score\n";
+    if (fputs(header, sink->file) == EOF) sink->failed = 1;
+}
+
+// 把一块缓冲区整块写出去
+static void sink_flush_buffer(ResultSink *sink, SinkBuffer *buf) {
+    if (buf->length == 0) return;
+    pthread_mutex_lock(&sink->lock);
+    sink_write_header(sink);
+    if (fwrite(buf->data, 1, buf->length, sink->file) != buf->length) sink->failed = 1;
+    pthread_mutex_unlock(&sink->lock);
+    buf->length = 0;
+}
+
+static void sink_mark_failed(ResultSink *sink) {
+    pthread_mutex_lock(&sink->lock);
+    sink->failed = 1;
+    pthread_mutex_unlock(&sink->lock);
+}
+
+// 保证缓冲区还能放下 need 字节：放不下先写出，还放不下就扩容
+static int sink_reserve(ResultSink *sink, SinkBuffer *buf, size_t need) {
+    if (buf->length + need <= buf->capacity) return 0;
+    sink_flush_buffer(sink, buf);
+    if (need <= buf->capacity) return 0;
+    size_t capacity = need > SINK_BUFFER_SIZE ? need : SINK_BUFFER_SIZE;
+    char *data = (char*)realloc(buf->data, capacity);
+    if (!data) return -1;
+    buf->data = data;
+    buf->capacity = capacity;
+    return 0;
+}
+
+// 按 "%.4f" 的规则输出得分。余弦得分总在 [0, 1]，直接按整数拼数字比 sprintf 快得多；
+// 只有离 "正好进位一半" 很近 (浮点乘法可能算偏) 或超出范围时才退回 sprintf，保证与 printf 逐字节相同
+static char *put_score(char *p, double score) {
+    double scaled = score * 10000.0;
+    if (!(scaled >= 0.0 && scaled <= 10000.0)) return p + sprintf(p, "%.4f", score);
+    long whole = (long)scaled;
+    double frac = scaled - (double)whole;
+    if (frac > 0.4999 && frac < 0.5001) return p + sprintf(p, "%.4f", score);
+    if (frac > 0.5) whole++;
+
+    *p++ = (char)('0' + whole / 10000);
+    *p++ = '.';
+    *p++ = (char)('0' + whole / 1000 % 10);
+    *p++ = (char)('0' + whole / 100 % 10);
+    *p++ = (char)('0' + whole / 10 % 10);
+    *p++ = (char)('0' + whole % 10);
+    return p;
+}
+
+// CSV 字段：含逗号、引号、换行时整体加引号，内部引号写两遍
+static char *put_csv_field(char *p, const char *s) {
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+        size_t len = strlen(s);
+        memcpy(p, s, len);
+        return p + len;
+    }
+    *p++ = '"';
+    for (; *s; s++) {
+        if (*s == '"') *p++ = '"';
+        *p++ = *s;
+    }
+    *p++ = '"';
+    return p;
+}
+
+// 取文件的 token 位置，第一次用到时读取。几个线程同时读同一个文件时只留先装上的那份
+static const LocatedTokens *sink_located(ResultSink *sink, uint32_t index) {
+    LocatedTokens *loc = atomic_load_explicit(&sink->located[index], memory_order_acquire);
+    if (!loc) {
+        LocatedTokens *fresh = (LocatedTokens*)malloc(sizeof(LocatedTokens));
+        if (fresh && located_tokens_load(corpus_path(sink->corpus, index), fresh) != 0) {
+            free(fresh);
+            fresh = NULL;
+        }
+        if (!fresh) fresh = &locate_failed;
+        LocatedTokens *expected = NULL;
+        if (atomic_compare_exchange_strong_explicit(&sink->located[index], &expected, fresh,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            loc = fresh;
+        } else {
+            if (fresh != &locate_failed) {
+                located_tokens_free(fresh);
+                free(fresh);
+            }
+            loc = expected;
+        }
+    }
+    return loc == &locate_failed ? NULL : loc;
+}
+
+static void locate_pair(ResultSink *sink, LocatedPair *pair) {
+    pair->regions = NULL;
+    pair->count = 0;
+    pair->located = 0;
+    const LocatedTokens *a = sink_located(sink, pair->a);
+    const LocatedTokens *b = sink_located(sink, pair->b);
+    GstResult gst;
+    if (!a || !b || gst_compare(a->ids, a->count, b->ids, b->count, GST_MIN_MATCH, &gst) != 0) return;
+    pair->located = locate_matches(a, b, &gst, &pair->regions, &pair->count) == 0;
+    gst_result_free(&gst);
+}
+
+// CSV 的 regions 列："A起-A止:B起-B止"，多段之间用空格分开，不含需要加引号的字符
+static char *put_csv_regions(char *p, const LocatedPair *pair) {
+    for (size_t r = 0; r < pair->count; r++) {
+        const MatchRegion *m = &pair->regions[r];
+        p += sprintf(p, "%s%zu-%zu:%zu-%zu", r ? " " : "", m->a_first, m->a_last, m->b_first, m->b_last);
+    }
+    return p;
+}
+
+static char *put_json_regions(char *p, const LocatedPair *pair) {
+    if (!pair->located) return stpcpy(p, "null");
+    *p++ = '[';
+    for (size_t r = 0; r < pair->count; r++) {
+        const MatchRegion *m = &pair->regions[r];
+        p += sprintf(p, "%s{\"a\":[%zu,%zu],\"b\":[%zu,%zu],\"tokens\":%zu}", r ? "," : "",
+                     m->a_first, m->a_last, m->b_first, m->b_last, m->tokens);
+    }
+    *p++ = ']';
+    return p;
+}
+
+// 与 --query --locate 相同：匹配片段单独成行，缩进在结果行下面
+static char *put_text_regions(char *p, const LocatedPair *pair) {
+    for (size_t r = 0; r < pair->count; r++) {
+        const MatchRegion *m = &pair->regions[r];
+        p += sprintf(p, "        %zu-%zu  <->  %zu-%zu  (%zu 个 token)\n",
+                     m->a_first, m->a_last, m->b_first, m->b_last, m->tokens);
+    }
+    return p;
+}
+
+// 把一条结果格式化进缓冲区；pair 为 NULL 表示没开 --locate
+static void sink_format(ResultSink *sink, SinkBuffer *buf, uint32_t a, uint32_t b, double score,
+                        const LocatedPair *pair) {
+    if (sink->format == SINK_FORMAT_BINARY) {
+        struct { uint32_t a, b; float score; } record = { a, b, (float)score };
+        if (sink_reserve(sink, buf, sizeof(record)) != 0) {
+            sink_mark_failed(sink);
+            return;
+        }
+        memcpy(buf->data + buf->length, &record, sizeof(record));
+        buf->length += sizeof(record);
+        return;
+    }
+
+    const char *path_a = corpus_path(sink->corpus, a);
+    const char *path_b = corpus_path(sink->corpus, b);
+    // 最坏情况：JSON 里每个字节都要写成 \u00XX (6 倍)，再加上得分和分隔符
+    size_t need = JSON_STRING_MAX(strlen(path_a)) + JSON_STRING_MAX(strlen(path_b)) + 64;
+    if (pair) need += 16 + pair->count * 160;    // 每段四个行号、token 数 (都不超过 10 位) 和固定的文字
+    if (sink_reserve(sink, buf, need) != 0) {
+        sink_mark_failed(sink);
+        return;
+    }
+
+    char *p = buf->data + buf->length;
+    switch (sink->format) {
+        case SINK_FORMAT_CSV:
+            p = put_csv_field(p, path_a);
+            *p++ = ',';
+            p = put_csv_field(p, path_b);
+            *p++ = ',';
+            p = put_score(p, score);
+            if (pair) {
+                *p++ = ',';
+                p = put_csv_regions(p, pair);
+            }
+            *p++ = '\n';
+            break;
+        case SINK_FORMAT_JSONL:
+            p = stpcpy(p, "{\"a\":");
+            p = json_put_string(p, path_a);
+            p = stpcpy(p, ",\"b\":");
+            p = json_put_string(p, path_b);
+            p = stpcpy(p, ",\"score\":");
+            p = put_score(p, score);
+            if (pair) {
+                p = stpcpy(p, ",\"regions\":");
+                p = put_json_regions(p, pair);
+            }
+            p = stpcpy(p, "}\n");
+            break;
+        default:
+            p = put_score(p, score);
+            *p++ = '\t';
+            p = stpcpy(p, path_a);
+            *p++ = '\t';
+            p = stpcpy(p, path_b);
+            *p++ = '\n';
+            if (pair) p = put_text_regions(p, pair);
+            break;
+    }
+    buf->length = (size_t)(p - buf->data);
+}
+
+static void locate_range(size_t begin, size_t end, void *ctx) {
+    ResultSink *sink = (ResultSink*)ctx;
+    for (size_t i = begin; i < end; i++) locate_pair(sink, &sink->pending[i]);
+}
+
+// 攒下的一批结果并行定位，再按原来的顺序写进非工作线程的缓冲区
+static void sink_locate_pending(ResultSink *sink) {
+    if (sink->pending_count == 0) return;
+    threadpool_parallel_for(sink->pool, 0, sink->pending_count, 1, locate_range, sink);
+    SinkBuffer *buf = &sink->buffers[sink->workers];
+    for (size_t i = 0; i < sink->pending_count; i++) {
+        LocatedPair *pair = &sink->pending[i];
+        sink_format(sink, buf, pair->a, pair->b, pair->score, pair);
+        free(pair->regions);
+    }
+    sink->pending_count = 0;
+}
+
+void result_sink_emit(ResultSink *sink, int worker, uint32_t a, uint32_t b, double score) {
+    if (score < sink->threshold) return;
+    int in_pool = worker >= 0 && worker < sink->workers;
+    SinkBuffer *buf = &sink->buffers[in_pool ? worker : sink->workers];
+    if (!sink->pool || sink->format == SINK_FORMAT_BINARY) {
+        sink_format(sink, buf, a, b, score, NULL);
+        return;
+    }
+
+    LocatedPair pair = { a, b, score, NULL, 0, 0 };
+    if (in_pool) {
+        locate_pair(sink, &pair);
+        sink_format(sink, buf, a, b, score, &pair);
+        free(pair.regions);
+        return;
+    }
+    sink->pending[sink->pending_count++] = pair;
+    if (sink->pending_count == SINK_LOCATE_BATCH) sink_locate_pending(sink);
+}
+
+int result_sink_close(ResultSink *sink) {
+    if (!sink) return 0;
+    if (sink->pool) sink_locate_pending(sink);
+    for (int w = 0; w <= sink->workers; w++) {
+        sink_flush_buffer(sink, &sink->buffers[w]);
+        free(sink->buffers[w].data);
+    }
+    sink_write_header(sink);
+    if (fflush(sink->file) != 0) sink->failed = 1;
+    if (sink->owns_file && fclose(sink->file) != 0) sink->failed = 1;
+    pthread_mutex_destroy(&sink->lock);
+
+    int rc = sink->failed ? -1 : 0;
+    if (rc != 0) fprintf(stderr, "错误：写出结果失败\n");
+    for (uint64_t i = 0; sink->located && i < sink->corpus->count; i++) {
+        LocatedTokens *loc = atomic_load(&sink->located[i]);
+        if (loc && loc != &locate_failed) {
+            located_tokens_free(loc);
+            free(loc);
+        }
+    }
+    free(sink->located);
+    free(sink->pending);
+    free(sink->buffers);
+    free(sink);
+    return rc;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tfidf.h"
+
+// 语料库里的文档频率段就是 DfTable 原样写出去的
+_Static_assert(sizeof(DfTable) == (VECTOR_DIMENSION + 1) * sizeof(uint64_t),
+               "DfTable must match the corpus TF-IDF section layout");
+
+void df_table_init(DfTable *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+void df_table_add(DfTable *table, const int vector[]) {
+    table->docs++;
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        table->df[i] += vector[i] > 0;
+    }
+}
+
+void df_table_remove(DfTable *table, const int vector[]) {
+    if (table->docs == 0) return;
+    table->docs--;
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        if (vector[i] > 0 && table->df[i] > 0) table->df[i]--;
+    }
+}
+
+// 并行统计：每个工作线程一张表，各加各的
+typedef struct {
+    const int *vectors;
+    DfTable *tables;       // 按 threadpool_worker_id() 下标
+} DfJob;
+
+static void count_df_range(size_t begin, size_t end, void *ctx) {
+    DfJob *job = (DfJob*)ctx;
+    DfTable *table = &job->tables[threadpool_worker_id()];
+    for (size_t i = begin; i < end; i++) {
+        df_table_add(table, job->vectors + i * VECTOR_DIMENSION);
+    }
+}
+
+void df_table_build(ThreadPool *pool, const int *vectors, size_t count, DfTable *table) {
+    df_table_init(table);
+    int workers = threadpool_size(pool);
+    DfJob job = { vectors, (DfTable*)calloc((size_t)workers, sizeof(DfTable)) };
+    if (!job.tables) {
+        // 内存紧张时退回串行统计
+        for (size_t i = 0; i < count; i++) df_table_add(table, vectors + i * VECTOR_DIMENSION);
+        return;
+    }
+
+    threadpool_parallel_for(pool, 0, count, 4096, count_df_range, &job);
+
+    for (int w = 0; w < workers; w++) {
+        table->docs += job.tables[w].docs;
+        for (int i = 0; i < VECTOR_DIMENSION; i++) table->df[i] += job.tables[w].df[i];
+    }
+    free(job.tables);
+}
+
+void tfidf_weights(const DfTable *table, TfIdfWeights *weights) {
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        double idf = log((1.0 + (double)table->docs) / (1.0 + (double)table->df[i])) + 1.0;
+        weights->idf[i] = idf;
+        weights->idf2[i] = idf * idf;
+    }
+}
+
+int tfidf_needs_reweight(const TfIdfWeights *frozen, const DfTable *current, double tolerance) {
+    TfIdfWeights now;
+    tfidf_weights(current, &now);
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        // idf 至少是 1，不会除以 0
+        if (fabs(now.idf[i] - frozen->idf[i]) > tolerance * frozen->idf[i]) return 1;
+    }
+    return 0;
+}
+
+double tfidf_norm(const TfIdfWeights *weights, const int vector[]) {
+    double norm = 0.0;
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        norm += weights->idf2[i] * ((double)vector[i] * vector[i]);
+    }
+    return sqrt(norm);
+}
+
+typedef struct {
+    const TfIdfWeights *weights;
+    const int *vectors;
+    double *norms;
+} NormJob;
+
+static void norm_range(size_t begin, size_t end, void *ctx) {
+    NormJob *job = (NormJob*)ctx;
+    for (size_t i = begin; i < end; i++) {
+        job->norms[i] = tfidf_norm(job->weights, job->vectors + i * VECTOR_DIMENSION);
+    }
+}
+
+void tfidf_norms_build(ThreadPool *pool, const TfIdfWeights *weights, const int *vectors,
+                       size_t count, double *norms) {
+    NormJob job = { weights, vectors, norms };
+    threadpool_parallel_for(pool, 0, count, 4096, norm_range, &job);
+}
+
+int tfidf_model_load(ThreadPool *pool, const Corpus *corpus, TfIdfModel *model) {
+    memset(model, 0, sizeof(*model));
+
+    // 建库时保存过：直接用冻结的文档频率和模长
+    if (corpus->df_table && corpus->tfidf_norms) {
+        memcpy(&model->df, corpus->df_table, sizeof(DfTable));
+        tfidf_weights(&model->df, &model->weights);
+        model->norms = corpus->tfidf_norms;
+        return 0;
+    }
+
+    // 否则扫一遍语料库现算
+    size_t count = (size_t)corpus->count;
+    model->owned_norms = (double*)malloc((count ? count : 1) * sizeof(double));
+    if (!model->owned_norms) {
+        fprintf(stderr, "错误：内存分配失败\n");
+        return -1;
+    }
+    df_table_build(pool, corpus->vectors, count, &model->df);
+    tfidf_weights(&model->df, &model->weights);
+    tfidf_norms_build(pool, &model->weights, corpus->vectors, count, model->owned_norms);
+    model->norms = model->owned_norms;
+    return 0;
+}
+
+void tfidf_model_free(TfIdfModel *model) {
+    free(model->owned_norms);
+    memset(model, 0, sizeof(*model));
+}
@@ -0,0 +1,462 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+typedef struct {
+    TaskFunc func;
+    void *arg;
+} Task;
+
+// 每个工作线程一个双端队列 (环形数组，满了就扩容)
+// 队列只在压入/弹出/偷取的一瞬间加锁，各线程的锁互不相干
+typedef struct {
+    pthread_mutex_t lock;
+    Task *tasks;
+    size_t capacity;   // 始终是 2 的幂
+    size_t top;        // 小偷从这里拿 (最早压入的)
+    size_t bottom;     // 主人从这里压入/弹出 (最新压入的)
+} WorkDeque;
+
+typedef struct {
+    ThreadPool *pool;
+    int id;
+    pthread_t thread;
+    WorkDeque deque;
+    unsigned int seed;   // 挑选偷取对象用的随机数状态
+} Worker;
+
+struct ThreadPool {
+    Worker *workers;
+    int size;                   // 实际在跑的线程数，工作线程开始干活前就已定下，之后不再改
+    int allocated;              // 分配了队列的 Worker 数
+    int running;                // 受 sleep_lock 保护：为 1 之前工作线程不碰任何队列
+
+    atomic_size_t queued;       // 所有队列里等着被执行的任务数
+    atomic_size_t unfinished;   // 已提交但还没执行完的任务数
+    atomic_uint next_queue;     // 外部线程提交时轮流选队列
+    atomic_int shutdown;
+
+    pthread_mutex_t sleep_lock; // 空闲线程在这里睡觉
+    pthread_cond_t work_ready;
+    pthread_cond_t all_done;
+};
+
+static _Thread_local ThreadPool *current_pool = NULL;
+static _Thread_local int current_worker = -1;
+
+// ---------------- 双端队列 ----------------
+
+static int deque_init(WorkDeque *dq) {
+    dq->capacity = 64;
+    dq->top = dq->bottom = 0;
+    dq->tasks = (Task*)malloc(dq->capacity * sizeof(Task));
+    if (!dq->tasks) return -1;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 0;
+}
+
+static void deque_destroy(WorkDeque *dq) {
+    pthread_mutex_destroy(&dq->lock);
+    free(dq->tasks);
+}
+
+static int deque_push(WorkDeque *dq, Task task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom - dq->top == dq->capacity) {
+        // 扩容：按逻辑顺序把旧任务搬到新数组的开头
+        size_t capacity = dq->capacity * 2;
+        Task *tasks = (Task*)malloc(capacity * sizeof(Task));
+        if (!tasks) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        for (size_t i = dq->top; i != dq->bottom; i++) {
+            tasks[i - dq->top] = dq->tasks[i & (dq->capacity - 1)];
+        }
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->bottom -= dq->top;
+        dq->top = 0;
+        dq->capacity = capacity;
+    }
+    dq->tasks[dq->bottom & (dq->capacity - 1)] = task;
+    dq->bottom++;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+// 主人弹出最新的任务
+static int deque_pop(WorkDeque *dq, Task *task) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        dq->bottom--;
+        *task = dq->tasks[dq->bottom & (dq->capacity - 1)];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+// 小偷拿走最早的任务
+static int deque_steal(WorkDeque *dq, Task *task) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        *task = dq->tasks[dq->top & (dq->capacity - 1)];
+        dq->top++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+// ---------------- 工作线程 ----------------
+
+// 先看自己的队列，再从随机位置开始挨个去偷
+static int find_task(Worker *self, Task *task) {
+    ThreadPool *pool = self->pool;
+    if (deque_pop(&self->deque, task)) return 1;
+
+    self->seed = self->seed * 1103515245u + 12345u;
+    int start = (int)((self->seed >> 16) % (unsigned int)pool->size);
+    for (int k = 0; k < pool->size; k++) {
+        int victim = (start + k) % pool->size;
+        if (victim != self->id && deque_steal(&pool->workers[victim].deque, task)) return 1;
+    }
+    return 0;
+}
+
+static void run_task(ThreadPool *pool, Task task) {
+    atomic_fetch_sub(&pool->queued, 1);
+    task.func(task.arg);
+    if (atomic_fetch_sub(&pool->unfinished, 1) == 1) {
+        pthread_mutex_lock(&pool->sleep_lock);
+        pthread_cond_broadcast(&pool->all_done);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *self = (Worker*)arg;
+    ThreadPool *pool = self->pool;
+    current_pool = pool;
+    current_worker = self->id;
+
+    // 等 threadpool_create 定下 size (有的线程可能没启动成功) 再开始偷任务
+    pthread_mutex_lock(&pool->sleep_lock);
+    while (!pool->running) pthread_cond_wait(&pool->work_ready, &pool->sleep_lock);
+    pthread_mutex_unlock(&pool->sleep_lock);
+
+    for (;;) {
+        Task task;
+        if (find_task(self, &task)) {
+            run_task(pool, task);
+            continue;
+        }
+        // 到处都没活：睡到有新任务或者线程池关闭
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->shutdown)) {
+            pthread_cond_wait(&pool->work_ready, &pool->sleep_lock);
+        }
+        int stop = atomic_load(&pool->shutdown) && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->sleep_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+// ---------------- 对外接口 ----------------
+
+static int detect_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+ThreadPool *threadpool_create(int num_threads) {
+    if (num_threads <= 0) num_threads = detect_cpu_count();
+
+    ThreadPool *pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->workers = (Worker*)calloc((size_t)num_threads, sizeof(Worker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    pool->size = num_threads;
+    pool->allocated = num_threads;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->unfinished, 0);
+    atomic_init(&pool->next_queue, 0);
+    atomic_init(&pool->shutdown, 0);
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->all_done, NULL);
+
+    // 先把所有队列准备好，再启动线程，避免线程偷到还没初始化的队列
+    for (int i = 0; i < num_threads; i++) {
+        Worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        w->seed = 2654435761u * (unsigned int)(i + 1);
+        if (deque_init(&w->deque) != 0) {
+            for (int j = 0; j < i; j++) deque_destroy(&pool->workers[j].deque);
+            free(pool->workers);
+            free(pool);
+            return NULL;
+        }
+    }
+    int started = 0;
+    for (; started < num_threads; started++) {
+        Worker *w = &pool->workers[started];
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) break;
+    }
+    // 线程没能全部启动时，就用已经启动的那些。它们还停在启动闸门前，这里改 size 没有竞争
+    pool->size = started;
+    if (started == 0) {
+        threadpool_destroy(pool);
+        return NULL;
+    }
+    pthread_mutex_lock(&pool->sleep_lock);
+    pool->running = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->sleep_lock);
+    return pool;
+}
+
+void threadpool_destroy(ThreadPool *pool) {
+    if (!pool) return;
+    threadpool_wait(pool);
+
+    pthread_mutex_lock(&pool->sleep_lock);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->sleep_lock);
+
+    for (int i = 0; i < pool->size; i++) pthread_join(pool->workers[i].thread, NULL);
+    for (int i = 0; i < pool->allocated; i++) deque_destroy(&pool->workers[i].deque);
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->all_done);
+    free(pool->workers);
+    free(pool);
+}
+
+int threadpool_size(const ThreadPool *pool) {
+    return pool->size;
+}
+
+int threadpool_worker_id(void) {
+    return current_worker;
+}
+
+int threadpool_submit(ThreadPool *pool, TaskFunc func, void *arg) {
+    Task task = { func, arg };
+    int target = current_pool == pool
+                     ? current_worker
+                     : (int)(atomic_fetch_add(&pool->next_queue, 1) % (unsigned int)pool->size);
+
+    atomic_fetch_add(&pool->unfinished, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    if (deque_push(&pool->workers[target].deque, task) != 0) {
+        atomic_fetch_sub(&pool->queued, 1);
+        atomic_fetch_sub(&pool->unfinished, 1);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->sleep_lock);
+    return 0;
+}
+
+void threadpool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->sleep_lock);
+    while (atomic_load(&pool->unfinished) > 0) {
+        pthread_cond_wait(&pool->all_done, &pool->sleep_lock);
+    }
+    pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+// ---------------- 单次调用的完成计数 ----------------
+// parallel_for / parallel_tiles 每次调用有自己的计数：根任务算 1，每交出去一个子任务加 1，
+// 做完一个减 1。等待时只看自己这次调用的计数，不等整个池子，所以任务里可以再嵌套调用：
+// 工作线程在等的时候自己去弹出或偷任务来做 (helping join)，不会把一个线程白白占住。
+
+// 最后一个任务做完：叫醒在等这次调用的线程 (工作线程睡在 work_ready，外部线程睡在 all_done)。
+// 计数减到 0 之后不再碰 pending，调用者此时可能已经返回
+static void join_finish(ThreadPool *pool, atomic_size_t *pending) {
+    if (atomic_fetch_sub(pending, 1) != 1) return;
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_cond_broadcast(&pool->all_done);
+    pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+static void join_wait(ThreadPool *pool, atomic_size_t *pending) {
+    if (current_pool != pool) {
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(pending) > 0) pthread_cond_wait(&pool->all_done, &pool->sleep_lock);
+        pthread_mutex_unlock(&pool->sleep_lock);
+        return;
+    }
+    Worker *self = &pool->workers[current_worker];
+    while (atomic_load(pending) > 0) {
+        Task task;
+        if (find_task(self, &task)) {
+            run_task(pool, task);
+            continue;
+        }
+        // 没活可偷：剩下的任务正在别的线程上跑，睡到有新任务或者这次调用结束
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (atomic_load(pending) > 0 && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->work_ready, &pool->sleep_lock);
+        }
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+}
+
+// 交出一个子任务，先记进计数；交不出去返回 -1，由调用者自己做
+static int join_submit(ThreadPool *pool, atomic_size_t *pending, TaskFunc func, void *arg) {
+    atomic_fetch_add(pending, 1);
+    if (threadpool_submit(pool, func, arg) == 0) return 0;
+    atomic_fetch_sub(pending, 1);
+    return -1;
+}
+
+// 启动根任务。在工作线程里 (嵌套调用) 直接自己做，拆出来的子任务留给别人偷；
+// 在外部线程里交给线程池，func 总在工作线程里执行，threadpool_worker_id() 一定有效。
+// 压入只在队列满了要扩容时才可能失败；失败就等池子里的任务做完，空队列压入不用扩容，一定能成功
+static void join_start(ThreadPool *pool, TaskFunc func, void *root) {
+    if (current_pool == pool) {
+        func(root);
+        return;
+    }
+    while (threadpool_submit(pool, func, root) != 0) threadpool_wait(pool);
+}
+
+// ---------------- 递归拆分的区间任务 ----------------
+
+typedef struct {
+    ThreadPool *pool;
+    atomic_size_t *pending;     // 这次调用的完成计数
+    size_t begin, end, grain;
+    RangeFunc func;
+    void *ctx;
+    int heap;       // 1 = malloc 出来的子任务，做完要 free；根任务在调用者的栈上
+} RangeTask;
+
+static void run_range(void *arg) {
+    RangeTask *t = (RangeTask*)arg;
+    // 区间太大就把右半边交出去，自己接着处理左半边
+    while (t->end - t->begin > t->grain) {
+        size_t mid = t->begin + (t->end - t->begin) / 2;
+        RangeTask *right = (RangeTask*)malloc(sizeof(RangeTask));
+        if (!right) break;   // 内存不够就不拆了，自己全干
+        *right = *t;
+        right->begin = mid;
+        right->heap = 1;
+        if (join_submit(t->pool, t->pending, run_range, right) != 0) {
+            free(right);
+            break;
+        }
+        t->end = mid;
+    }
+    t->func(t->begin, t->end, t->ctx);
+    ThreadPool *pool = t->pool;
+    atomic_size_t *pending = t->pending;
+    if (t->heap) free(t);
+    join_finish(pool, pending);
+}
+
+void threadpool_parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain,
+                             RangeFunc func, void *ctx) {
+    if (begin >= end) return;
+    if (grain == 0) grain = 1;
+
+    atomic_size_t pending;
+    atomic_init(&pending, 1);
+    RangeTask root = { pool, &pending, begin, end, grain, func, ctx, 0 };
+    join_start(pool, run_range, &root);
+    join_wait(pool, &pending);
+}
+
+// ---------------- 递归拆分的二维块任务 ----------------
+
+typedef struct {
+    ThreadPool *pool;
+    atomic_size_t *pending;
+    size_t row_begin, row_end, col_begin, col_end, tile;
+    TileFunc func;
+    void *ctx;
+    int heap;       // 同 RangeTask
+} TileTask;
+
+// 块里是否存在 row < col 的格子
+static int tile_has_work(size_t row_begin, size_t row_end, size_t col_begin, size_t col_end) {
+    return row_begin < row_end && col_begin < col_end && row_begin + 1 < col_end;
+}
+
+// 做完一块：先取出之后要用的字段，再 free 子任务，最后才报告完成
+static void tile_done(TileTask *t) {
+    ThreadPool *pool = t->pool;
+    atomic_size_t *pending = t->pending;
+    if (t->heap) free(t);
+    join_finish(pool, pending);
+}
+
+static void run_tile(void *arg) {
+    TileTask *t = (TileTask*)arg;
+    for (;;) {
+        size_t rows = t->row_end - t->row_begin;
+        size_t cols = t->col_end - t->col_begin;
+        if (rows <= t->tile && cols <= t->tile) break;
+
+        // 沿较长的一边对半切，后一半交出去
+        TileTask *other = (TileTask*)malloc(sizeof(TileTask));
+        if (!other) break;
+        *other = *t;
+        other->heap = 1;
+        if (rows >= cols) {
+            size_t mid = t->row_begin + rows / 2;
+            other->row_begin = mid;
+            t->row_end = mid;
+        } else {
+            size_t mid = t->col_begin + cols / 2;
+            other->col_begin = mid;
+            t->col_end = mid;
+        }
+        // 完全落在对角线下方的一半直接丢掉
+        if (!tile_has_work(other->row_begin, other->row_end, other->col_begin, other->col_end) ||
+            join_submit(t->pool, t->pending, run_tile, other) != 0) {
+            if (tile_has_work(other->row_begin, other->row_end, other->col_begin, other->col_end)) {
+                t->func(other->row_begin, other->row_end, other->col_begin, other->col_end, t->ctx);
+            }
+            free(other);
+        }
+        if (!tile_has_work(t->row_begin, t->row_end, t->col_begin, t->col_end)) {
+            tile_done(t);
+            return;
+        }
+    }
+    t->func(t->row_begin, t->row_end, t->col_begin, t->col_end, t->ctx);
+    tile_done(t);
+}
+
+void threadpool_parallel_tiles(ThreadPool *pool, size_t row_begin, size_t row_end,
+                               size_t col_begin, size_t col_end, size_t tile,
+                               TileFunc func, void *ctx) {
+    if (!tile_has_work(row_begin, row_end, col_begin, col_end)) return;
+    if (tile == 0) tile = 1;
+
+    atomic_size_t pending;
+    atomic_init(&pending, 1);
+    TileTask root = { pool, &pending, row_begin, row_end, col_begin, col_end, tile, func, ctx, 0 };
+    join_start(pool, run_tile, &root);
+    join_wait(pool, &pending);
+}
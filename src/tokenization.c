@@ -7,20 +7,27 @@
 #include "tokenization.h"
 
 
-//辅助函数：判断一个单词是不是C语言的关键字
-int is_keyword(const char *str)
+//列举关键字
+static const char *keyword[] = {"int","float","double","char","void","if","else","while","for","do","return","break","continue","switch","case","default","struct","typedef"};//后续需要补充！！！！
+#define NUM_KEYWORD 18
+
+//辅助函数：返回关键字在表里的下标，不是关键字返回-1
+static int keyword_index(const char *str)
 {
-    //列举关键字
-    const char *keyword[] = {"int","float","double","char","void","if","else","while","for","do","return","break","continue","switch","case","default","struct","typedef"};//后续需要补充！！！！
-    int num_keyword = 18;
-    for(int i=0;i<num_keyword;i++)
+    for(int i=0;i<NUM_KEYWORD;i++)
     {
         if(strcmp(str,keyword[i])==0)
         {
-            return 1;
+            return i;
         }
     }
-    return 0;
+    return -1;
+}
+
+//辅助函数：判断一个单词是不是C语言的关键字
+int is_keyword(const char *str)
+{
+    return keyword_index(str)>=0;
 }
 
 
@@ -61,8 +68,10 @@ void get_next_token(const char *source,int *pos,Token *token)
         int i = 0;
         // 只要后面接着的字符是 字母、数字 或 下划线，就一直读
         while (isalnum(current_char) || current_char == '_') {
-            (*token).value[i] = current_char; // 把字符存入结构体
-            i++;
+            if (i < TOKEN_VALUE_MAX) {
+                (*token).value[i] = current_char; // 把字符存入结构体 (超长的部分只跳过不保存)
+                i++;
+            }
             // 移动源代码的光标
             (*pos) = (*pos) + 1;
             current_char = source[*pos];
@@ -91,8 +100,10 @@ void get_next_token(const char *source,int *pos,Token *token)
             {
                 has_dot = 1;
             }
-            (*token).value[i] = current_char;
-            i++;
+            if (i < TOKEN_VALUE_MAX) {
+                (*token).value[i] = current_char;
+                i++;
+            }
 
             (*pos) = (*pos) + 1;
             current_char = source[*pos];
@@ -114,7 +125,7 @@ void get_next_token(const char *source,int *pos,Token *token)
         //一一直读取到下一个引号
         while(current_char!='"' && current_char!='\0')
         {
-            (*token).value[i++] = current_char;
+            if (i < TOKEN_VALUE_MAX - 1) (*token).value[i++] = current_char;  //给结尾的引号留一个位置
             (*pos)++;
             current_char = source[*pos];
         }
@@ -157,4 +168,71 @@ void get_next_token(const char *source,int *pos,Token *token)
     (*token).value[1] = '\0';
     (*token).type = TOKEN_OPERATOR;
     (*pos)++;
-}
\ No newline at end of file
+}
+
+
+//双字符运算符，顺序决定它们的编号
+static const char *double_ops[] = {"==","!=",">=","<=","&&","||","++","--"};
+#define NUM_DOUBLE_OPS 8
+
+/**
+*:把token映射成一个稳定的小整数编号(规范化编号)
+*变量名、数字、字符串各自只占一个编号，所以改变量名不会改变编号序列
+*编号范围：
+*  0 ~ 17    关键字 (按 keyword 表的顺序)
+*  18/19/20  变量名/数字/字符串
+*  32 ~ 287  单字符符号 (32 + 字符的无符号值)
+*  288 ~ 295 双字符运算符
+*/
+int token_canonical_id(const Token *token)
+{
+    switch((*token).type)
+    {
+        case TOKEN_KEYWORD:
+            return TOKEN_ID_KEYWORD_BASE + keyword_index((*token).value);
+        case TOKEN_IDENTIFIER:
+            return TOKEN_ID_IDENTIFIER;
+        case TOKEN_NUMBER:
+            return TOKEN_ID_NUMBER;
+        case TOKEN_STRING:
+            return TOKEN_ID_STRING;
+        default:
+            break;
+    }
+    if((*token).value[1]!='\0')
+    {
+        for(int i=0;i<NUM_DOUBLE_OPS;i++)
+        {
+            if(strcmp((*token).value,double_ops[i])==0)
+            {
+                return TOKEN_ID_DOUBLE_OP_BASE + i;
+            }
+        }
+    }
+    return TOKEN_ID_CHAR_BASE + (unsigned char)(*token).value[0];
+}
+
+
+/**
+*:token_canonical_id 的反向：由编号还原 token 的文本
+*buf 至少 3 个字节，单字符/双字符符号写在这里
+*变量名/数字/字符串只有编号没有具体内容，返回NULL
+*/
+const char *token_canonical_text(int id,char buf[3])
+{
+    if(id>=TOKEN_ID_KEYWORD_BASE && id<TOKEN_ID_KEYWORD_BASE+NUM_KEYWORD)
+    {
+        return keyword[id-TOKEN_ID_KEYWORD_BASE];
+    }
+    if(id>=TOKEN_ID_DOUBLE_OP_BASE && id<TOKEN_ID_DOUBLE_OP_BASE+NUM_DOUBLE_OPS)
+    {
+        return double_ops[id-TOKEN_ID_DOUBLE_OP_BASE];
+    }
+    if(id>=TOKEN_ID_CHAR_BASE && id<TOKEN_ID_DOUBLE_OP_BASE)
+    {
+        buf[0]=(char)(id-TOKEN_ID_CHAR_BASE);
+        buf[1]='\0';
+        return buf;
+    }
+    return NULL;
+}
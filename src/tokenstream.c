@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tokenstream.h"
+#include "tokenization.h"
+
+// 编号都小于 TOKEN_ID_COUNT，用 uint16_t 存放绰绰有余
+_Static_assert(TOKEN_ID_COUNT <= 65536, "canonical token ids must fit in 16 bits");
+
+// 可以自动扩容的编号数组
+static int push_id(uint16_t **ids, size_t *count, size_t *capacity, uint16_t id) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 256;
+        uint16_t *items = (uint16_t*)realloc(*ids, grown * sizeof(uint16_t));
+        if (!items) return -1;
+        *ids = items;
+        *capacity = grown;
+    }
+    (*ids)[(*count)++] = id;
+    return 0;
+}
+
+int token_stream_collect(const char *code, uint16_t **ids, size_t *count) {
+    *ids = NULL;
+    *count = 0;
+    size_t capacity = 0;
+    int pos = 0;
+    Token token;
+    for (;;) {
+        get_next_token(code, &pos, &token);
+        if (token.type == TOKEN_END) break;
+        if (push_id(ids, count, &capacity, (uint16_t)token_canonical_id(&token)) != 0) {
+            free(*ids);
+            *ids = NULL;
+            *count = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int token_stream_encode(const uint16_t *ids, size_t count, TokenStream *out) {
+    // 每个编号最多 3 字节 (16 位 / 每字节 7 位)
+    out->data = (unsigned char*)malloc(count ? count * 3 : 1);
+    out->size = 0;
+    if (!out->data) return -1;
+
+    unsigned char *p = out->data;
+    for (size_t i = 0; i < count; i++) {
+        unsigned int v = ids[i];
+        while (v >= 0x80) {
+            *p++ = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (unsigned char)v;
+    }
+    out->size = (size_t)(p - out->data);
+
+    // 按实际大小收缩，语料库里可能有上百万个文件
+    unsigned char *shrunk = (unsigned char*)realloc(out->data, out->size ? out->size : 1);
+    if (shrunk) out->data = shrunk;
+    return 0;
+}
+
+int token_stream_decode(const unsigned char *data, size_t size, uint16_t **ids, size_t *count) {
+    *ids = NULL;
+    *count = 0;
+
+    // 每个编号的最后一个字节最高位为 0，数一下就知道有多少个
+    size_t n = 0;
+    for (size_t i = 0; i < size; i++) n += (data[i] & 0x80) == 0;
+    if (size > 0 && (data[size - 1] & 0x80)) return -1;
+
+    uint16_t *out = (uint16_t*)malloc((n ? n : 1) * sizeof(uint16_t));
+    if (!out) return -1;
+
+    size_t k = 0;
+    for (size_t i = 0; i < size;) {
+        unsigned int v = 0;
+        int shift = 0;
+        while (data[i] & 0x80) {
+            v |= (unsigned int)(data[i++] & 0x7F) << shift;
+            shift += 7;
+            if (shift > 14) {
+                free(out);
+                return -1;
+            }
+        }
+        v |= (unsigned int)data[i++] << shift;
+        if (v >= TOKEN_ID_COUNT) {
+            free(out);
+            return -1;
+        }
+        out[k++] = (uint16_t)v;
+    }
+    *ids = out;
+    *count = n;
+    return 0;
+}
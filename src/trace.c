@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "trace.h"
+#include "json.h"
+#include "threadpool.h"
+
+int trace_enabled = 0;
+
+typedef struct {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    char arg[TRACE_ARG_MAX];
+} TraceEvent;
+
+// 每个线程一个环形缓冲区，第一次记事件时分配并挂到全局链表上 (无锁压栈)，程序退出时统一写出
+typedef struct TraceRing {
+    TraceEvent *events;
+    uint64_t written;           // 累计写入的事件数，events[written % TRACE_RING_EVENTS] 是下一个位置
+    int tid;
+    char name[32];
+    struct TraceRing *next;
+} TraceRing;
+
+static _Thread_local TraceRing *local_ring = NULL;
+static _Atomic(TraceRing*) rings = NULL;
+static atomic_int next_tid = 1;
+static char *trace_path = NULL;
+static uint64_t trace_origin = 0;
+
+uint64_t trace_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TraceRing *ring_for_thread(void) {
+    if (local_ring) return local_ring;
+    TraceRing *ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+    if (!ring) return NULL;
+    ring->events = (TraceEvent*)malloc(TRACE_RING_EVENTS * sizeof(TraceEvent));
+    if (!ring->events) {
+        free(ring);
+        return NULL;
+    }
+    ring->tid = atomic_fetch_add(&next_tid, 1);
+    int worker = threadpool_worker_id();
+    if (worker >= 0) snprintf(ring->name, sizeof(ring->name), "worker %d", worker);
+    else snprintf(ring->name, sizeof(ring->name), "thread %d", ring->tid);
+
+    ring->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+    }
+    local_ring = ring;
+    return ring;
+}
+
+void trace_thread_name(const char *name) {
+    if (!trace_enabled) return;
+    TraceRing *ring = ring_for_thread();
+    if (ring) snprintf(ring->name, sizeof(ring->name), "%s", name);
+}
+
+void trace_record(const char *name, const char *arg, uint64_t begin) {
+    uint64_t end = trace_clock();
+    TraceRing *ring = ring_for_thread();
+    if (!ring) return;
+    TraceEvent *e = &ring->events[ring->written % TRACE_RING_EVENTS];
+    e->name = name;
+    e->begin = begin;
+    e->end = end;
+    e->arg[0] = '\0';
+    if (arg) {
+        size_t len = strlen(arg);
+        if (len >= TRACE_ARG_MAX) {
+            // 路径保留末尾最有用；不从 UTF-8 字符中间截断
+            arg += len - (TRACE_ARG_MAX - 1);
+            while (((unsigned char)*arg & 0xC0) == 0x80) arg++;
+        }
+        memcpy(e->arg, arg, strlen(arg) + 1);
+    }
+    ring->written++;
+}
+
+// 线程名和事件参数都不超过 TRACE_ARG_MAX 字节，转义后放得进栈上的缓冲区
+static void put_json_string(FILE *file, const char *s) {
+    char buffer[JSON_STRING_MAX(TRACE_ARG_MAX)];
+    char *end = json_put_string(buffer, s);
+    fwrite(buffer, 1, (size_t)(end - buffer), file);
+}
+
+// 时间戳以微秒为单位，从 trace_start 算起
+static double micros(uint64_t t) {
+    return t > trace_origin ? (double)(t - trace_origin) / 1000.0 : 0.0;
+}
+
+// atexit 时调用：此时工作线程都已经退出，各个缓冲区不会再变
+static void trace_finish(void) {
+    FILE *file = fopen(trace_path, "w");
+    if (!file) {
+        fprintf(stderr, "错误：无法写入追踪文件 %s\n", trace_path);
+        free(trace_path);
+        return;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    int first = 1;
+    uint64_t total = 0;
+    for (TraceRing *ring = atomic_load(&rings); ring; ring = ring->next) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",\n", ring->tid);
+        put_json_string(file, ring->name);
+        fprintf(file, "}}");
+        first = 0;
+
+        uint64_t kept = ring->written < TRACE_RING_EVENTS ? ring->written : TRACE_RING_EVENTS;
+        if (kept < ring->written) {
+            fprintf(stderr, "警告：追踪线程 %s 丢弃了最早的 %llu 个事件\n", ring->name,
+                    (unsigned long long)(ring->written - kept));
+        }
+        for (uint64_t k = ring->written - kept; k < ring->written; k++) {
+            const TraceEvent *e = &ring->events[k % TRACE_RING_EVENTS];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"codesim\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":1,\"tid\":%d", e->name, micros(e->begin), (double)(e->end - e->begin) / 1000.0,
+                    ring->tid);
+            if (e->arg[0]) {
+                fprintf(file, ",\"args\":{\"arg\":");
+                put_json_string(file, e->arg);
+                fputc('}', file);
+            }
+            fputc('}', file);
+        }
+        total += kept;
+    }
+    fprintf(file, "\n]}\n");
+    for (TraceRing *ring = atomic_load(&rings), *next; ring; ring = next) {
+        next = ring->next;
+        free(ring->events);
+        free(ring);
+    }
+    if (fclose(file) != 0) fprintf(stderr, "错误：写入追踪文件 %s 失败\n", trace_path);
+    else fprintf(stderr, "已写入追踪文件 %s：%llu 个事件\n", trace_path, (unsigned long long)total);
+    free(trace_path);
+}
+
+int trace_start(const char *path) {
+    trace_path = (char*)malloc(strlen(path) + 1);
+    if (!trace_path) return -1;
+    strcpy(trace_path, path);
+    if (atexit(trace_finish) != 0) {
+        free(trace_path);
+        trace_path = NULL;
+        return -1;
+    }
+    trace_origin = trace_clock();
+    trace_enabled = 1;
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "tokenization.h" // 【重要】必须引入头文件，才能连接到你的分词器
 #include "vectorization.h"//引入自己的头文件，里面包含全局变量
 
@@ -99,3 +101,150 @@ void generate_vector(const char *code, int vector[]) {
     } while (token.type != TOKEN_END);
 }
 
+
+
+/**
+ * 函数名：build_feature_id_map
+ * 作用：把每个规范化 token 编号对应到特征下标，之后按编号计数就不用再逐个 strcmp。
+ * 做法是把编号还原成 token，再交给 get_feature_index，保证和 generate_vector 的结果完全一样。
+ * 返回值：特征表里无法由 token 编号得到的具体特征个数 (0 表示缓存的 token 流可以完整重算向量)。
+ */
+int build_feature_id_map(int map[TOKEN_ID_COUNT]) {
+    int reachable[VECTOR_DIMENSION] = {0};
+
+    for (int id = 0; id < TOKEN_ID_COUNT; id++) {
+        char buf[3];
+        const char *text = token_canonical_text(id, buf);
+        Token token;
+        if (id == TOKEN_ID_IDENTIFIER)  token.type = TOKEN_IDENTIFIER;
+        else if (id == TOKEN_ID_NUMBER) token.type = TOKEN_NUMBER;
+        else if (id == TOKEN_ID_STRING) token.type = TOKEN_STRING;
+        else if (id < TOKEN_ID_CHAR_BASE) token.type = TOKEN_KEYWORD;
+        else token.type = TOKEN_OPERATOR;
+
+        if (text == NULL) {
+            // 变量名/数字/字符串只看类型；21 ~ 31 是没有用到的编号
+            token.value[0] = '\0';
+            map[id] = token.type == TOKEN_KEYWORD ? -1 : get_feature_index(&token);
+            continue;
+        }
+        strcpy(token.value, text);
+        map[id] = get_feature_index(&token);
+        if (map[id] >= 0) reachable[map[id]] = 1;
+    }
+
+    int missing = 0;
+    for (int i = 0; i < 32; i++) missing += !reachable[i];
+    return missing;
+}
+
+/**
+ * 函数名：generate_vector_from_ids
+ * 作用：和 generate_vector 一样统计特征，只是输入换成了 token 编号序列 (来自 token 流缓存)。
+ */
+void generate_vector_from_ids(const uint16_t *ids, size_t count, const int map[TOKEN_ID_COUNT],
+                              int vector[]) {
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        vector[i] = 0;
+    }
+    for (size_t k = 0; k < count; k++) {
+        int idx = map[ids[k]];
+        if (idx != -1) {
+            vector[idx]++;
+        }
+    }
+}
+
+
+
+typedef struct {
+    const char *code;
+    const size_t *bounds;   // 块数 + 1 个分界，除两端外都落在空格上
+    int *vectors;           // 每块一个向量
+    int *ok;                // 每块一项，复制缓冲区分配失败时为 0
+} VectorChunkJob;
+
+static void vectorize_chunks(size_t begin, size_t end, void *ctx) {
+    VectorChunkJob *job = (VectorChunkJob*)ctx;
+    for (size_t k = begin; k < end; k++) {
+        // 分词器读到 '\0' 才停，所以每块复制出来补上结尾
+        size_t n = job->bounds[k + 1] - job->bounds[k];
+        char *chunk = (char*)malloc(n + 1);
+        job->ok[k] = chunk != NULL;
+        if (!chunk) continue;
+        memcpy(chunk, job->code + job->bounds[k], n);
+        chunk[n] = '\0';
+        generate_vector(chunk, job->vectors + k * VECTOR_DIMENSION);
+        free(chunk);
+    }
+}
+
+/**
+ * 函数名：generate_vector_parallel
+ * 作用：把很长的预处理结果在空格处切块，交给线程池并行统计，再把各块的计数相加。
+ */
+void generate_vector_parallel(ThreadPool *pool, const char *code, size_t length, int vector[]) {
+    if (!pool || threadpool_size(pool) < 2 || length < VECTOR_PARALLEL_MIN) {
+        generate_vector(code, vector);
+        return;
+    }
+
+    size_t max_chunks = length / VECTOR_CHUNK_SIZE + 1;
+    size_t *bounds = (size_t*)malloc((max_chunks + 1) * sizeof(size_t));
+    int *vectors = (int*)malloc(max_chunks * VECTOR_DIMENSION * sizeof(int));
+    int *ok = (int*)malloc(max_chunks * sizeof(int));
+    size_t chunk_count = 0;
+    if (bounds && vectors && ok) {
+        bounds[0] = 0;
+        for (size_t k = 1; k < max_chunks; k++) {
+            size_t b = k * VECTOR_CHUNK_SIZE;
+            if (b <= bounds[chunk_count]) continue;
+            const char *space = (const char*)memchr(code + b, ' ', length - b);
+            if (!space) break;
+            bounds[++chunk_count] = (size_t)(space - code);
+        }
+        bounds[++chunk_count] = length;
+    }
+
+    int done = 0;
+    if (chunk_count >= 2) {
+        VectorChunkJob job = { code, bounds, vectors, ok };
+        threadpool_parallel_for(pool, 0, chunk_count, 1, vectorize_chunks, &job);
+        done = 1;
+        for (size_t k = 0; k < chunk_count; k++) done &= ok[k];
+    }
+    if (done) {
+        for (int i = 0; i < VECTOR_DIMENSION; i++) vector[i] = 0;
+        for (size_t k = 0; k < chunk_count; k++) {
+            for (int i = 0; i < VECTOR_DIMENSION; i++) vector[i] += vectors[k * VECTOR_DIMENSION + i];
+        }
+    } else {
+        // 切不出两块或内存不足：退回串行
+        generate_vector(code, vector);
+    }
+    free(bounds);
+    free(vectors);
+    free(ok);
+}
+
+
+
+/**
+ * 函数名：feature_table_version
+ * 作用：用 FNV-1a 哈希把整张特征表(含维度)压成一个 32 位版本号。
+ */
+unsigned int feature_table_version(void) {
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < VECTOR_DIMENSION; i++) {
+        const char *p = FEATURE_MAP[i];
+        // 连同结尾的 '\0' 一起哈希，避免 "a"+"bc" 和 "ab"+"c" 撞车
+        do {
+            hash ^= (unsigned char)*p;
+            hash *= 16777619u;
+        } while (*p++ != '\0');
+    }
+    hash ^= (unsigned int)VECTOR_DIMENSION;
+    hash *= 16777619u;
+    return hash;
+}
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include "window.h"
+#include "calculate.h"
+
+static size_t window_stride(size_t window) {
+    size_t stride = window / WINDOW_STRIDE_DIVISOR;
+    return stride ? stride : 1;
+}
+
+// 文件里实际的窗口长度：文件比窗口短时整个文件就是一个窗口
+static size_t window_length(size_t count, size_t window) {
+    return window < count ? window : count;
+}
+
+// 起点 0, stride, 2 * stride, ...，最后补一个贴着末尾的起点 last，保证每个 token 都被覆盖。
+// starts 至少要有 last / stride + 2 项，返回起点个数
+static size_t window_starts(size_t last, size_t stride, size_t *starts) {
+    size_t n = 0;
+    for (size_t s = 0; s <= last; s += stride) starts[n++] = s;
+    if (starts[n - 1] != last) starts[n++] = last;
+    return n;
+}
+
+int feature_prefix_build(const uint16_t *ids, size_t count, const int map[TOKEN_ID_COUNT],
+                         size_t window, FeaturePrefix *out) {
+    memset(out, 0, sizeof(*out));
+    if (window == 0) window = WINDOW_DEFAULT_TOKENS;
+    out->count = count;
+    out->window = window;
+
+    // 1. 检查点 = 所有窗口的起点和终点。两列都是升序，归并去重
+    size_t length = window_length(count, window);
+    size_t stride = window_stride(window);
+    size_t last = count - length;
+    size_t *starts = (size_t*)malloc((last / stride + 2) * sizeof(size_t));
+    out->positions = (size_t*)malloc(2 * (last / stride + 2) * sizeof(size_t));
+    if (!starts || !out->positions) {
+        free(starts);
+        feature_prefix_free(out);
+        return -1;
+    }
+    size_t n = window_starts(last, stride, starts);
+    for (size_t i = 0, j = 0; i < n || j < n;) {
+        size_t next = j == n || (i < n && starts[i] <= starts[j] + length) ? starts[i++] : starts[j++] + length;
+        if (out->rows == 0 || out->positions[out->rows - 1] != next) out->positions[out->rows++] = next;
+    }
+    free(starts);
+
+    // 2. 扫一遍 token 累加计数，走到检查点时存一行
+    out->sums = (uint32_t*)malloc(out->rows * VECTOR_DIMENSION * sizeof(uint32_t));
+    if (!out->sums) {
+        feature_prefix_free(out);
+        return -1;
+    }
+    uint32_t running[VECTOR_DIMENSION] = { 0 };
+    for (size_t i = 0, k = 0; k < out->rows; i++) {
+        if (out->positions[k] == i) {
+            memcpy(out->sums + k * VECTOR_DIMENSION, running, sizeof(running));
+            k++;
+        }
+        if (i == count) break;
+        int feature = ids[i] < TOKEN_ID_COUNT ? map[ids[i]] : -1;
+        if (feature >= 0) running[feature]++;
+    }
+    return 0;
+}
+
+// 检查点 position 那一行 (二分查找，调用者保证 position 是检查点)
+static const uint32_t *checkpoint_row(const FeaturePrefix *prefix, size_t position) {
+    size_t lo = 0, hi = prefix->rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (prefix->positions[mid] < position) lo = mid + 1;
+        else hi = mid;
+    }
+    return prefix->sums + lo * VECTOR_DIMENSION;
+}
+
+void feature_prefix_window(const FeaturePrefix *prefix, size_t begin, size_t end, int vector[]) {
+    const uint32_t *lo = checkpoint_row(prefix, begin);
+    const uint32_t *hi = checkpoint_row(prefix, end);
+    for (int f = 0; f < VECTOR_DIMENSION; f++) vector[f] = (int)(hi[f] - lo[f]);
+}
+
+void feature_prefix_free(FeaturePrefix *prefix) {
+    free(prefix->sums);
+    free(prefix->positions);
+    memset(prefix, 0, sizeof(*prefix));
+}
+
+// 一个文件的全部窗口：起点、向量和模长
+typedef struct {
+    size_t length;        // 窗口长度
+    size_t count;         // 窗口个数
+    size_t *starts;
+    int *vectors;         // count * VECTOR_DIMENSION
+    double *norms;
+} WindowSet;
+
+static void window_set_free(WindowSet *set) {
+    free(set->starts);
+    free(set->vectors);
+    free(set->norms);
+}
+
+// 起点与 feature_prefix_build 建检查点时相同
+static int window_set_build(const FeaturePrefix *prefix, size_t stride, WindowSet *set) {
+    memset(set, 0, sizeof(*set));
+    if (prefix->count == 0) return 0;
+    set->length = window_length(prefix->count, prefix->window);
+
+    size_t last = prefix->count - set->length;
+    size_t capacity = last / stride + 2;
+    set->starts = (size_t*)malloc(capacity * sizeof(size_t));
+    set->vectors = (int*)malloc(capacity * VECTOR_DIMENSION * sizeof(int));
+    set->norms = (double*)malloc(capacity * sizeof(double));
+    if (!set->starts || !set->vectors || !set->norms) {
+        window_set_free(set);
+        return -1;
+    }
+
+    set->count = window_starts(last, stride, set->starts);
+
+    for (size_t w = 0; w < set->count; w++) {
+        int *vector = set->vectors + w * VECTOR_DIMENSION;
+        feature_prefix_window(prefix, set->starts[w], set->starts[w] + set->length, vector);
+        set->norms[w] = calculate_vector_norm(vector, VECTOR_DIMENSION);
+    }
+    return 0;
+}
+
+// 得分高的在前，得分相同按 A、B 的位置排，结果与平台无关
+static int compare_window_match(const void *x, const void *y) {
+    const WindowMatch *a = (const WindowMatch*)x;
+    const WindowMatch *b = (const WindowMatch*)y;
+    if (a->score != b->score) return a->score > b->score ? -1 : 1;
+    if (a->a_begin != b->a_begin) return a->a_begin < b->a_begin ? -1 : 1;
+    if (a->b_begin != b->b_begin) return a->b_begin < b->b_begin ? -1 : 1;
+    return 0;
+}
+
+int window_best_matches(const FeaturePrefix *a, const FeaturePrefix *b, size_t top,
+                        WindowMatch *matches, size_t *count) {
+    *count = 0;
+    size_t stride = window_stride(a->window);
+
+    WindowSet set_a, set_b;
+    if (window_set_build(a, stride, &set_a) != 0) return -1;
+    if (window_set_build(b, stride, &set_b) != 0) {
+        window_set_free(&set_a);
+        return -1;
+    }
+
+    int rc = 0;
+    WindowMatch *best = NULL;
+    if (set_a.count > 0 && set_b.count > 0) {
+        best = (WindowMatch*)malloc(set_a.count * sizeof(WindowMatch));
+        if (!best) rc = -1;
+    }
+
+    if (best) {
+        // 每个 A 窗口只留最像的 B 窗口
+        for (size_t i = 0; i < set_a.count; i++) {
+            const int *va = set_a.vectors + i * VECTOR_DIMENSION;
+            size_t best_j = 0;
+            double best_score = -1.0;
+            for (size_t j = 0; j < set_b.count; j++) {
+                double score = calculate_cosine_similarity_normed(va, set_a.norms[i],
+                                                                  set_b.vectors + j * VECTOR_DIMENSION,
+                                                                  set_b.norms[j], VECTOR_DIMENSION);
+                if (score > best_score) {
+                    best_score = score;
+                    best_j = j;
+                }
+            }
+            best[i].a_begin = set_a.starts[i];
+            best[i].a_end = set_a.starts[i] + set_a.length;
+            best[i].b_begin = set_b.starts[best_j];
+            best[i].b_end = set_b.starts[best_j] + set_b.length;
+            best[i].score = best_score;
+        }
+        qsort(best, set_a.count, sizeof(WindowMatch), compare_window_match);
+
+        // 相邻的 A 窗口差一个步长，往往对上同一段 B，只留得分最高的那个
+        for (size_t i = 0; i < set_a.count && *count < top; i++) {
+            int overlaps = 0;
+            for (size_t k = 0; k < *count && !overlaps; k++) {
+                overlaps = best[i].a_begin < matches[k].a_end && matches[k].a_begin < best[i].a_end;
+            }
+            if (!overlaps) matches[(*count)++] = best[i];
+        }
+        free(best);
+    }
+
+    window_set_free(&set_a);
+    window_set_free(&set_b);
+    return rc;
+}
@@ -0,0 +1,133 @@
+// libcodesim 接口测试：bash compile.sh test
+// 只用 codesim.h 里的公开接口，并且链接 libcodesim.so，漏导出的函数在这里就会链接失败。
+// 用法：codesim_test <文件A> <文件B> <命令行工具给出的得分>
+// 得分由 compile.sh 用 --pairs 算好传进来，库算出的结果按同样的 4 位小数格式化后必须完全相同
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codesim.h"
+
+static char *read_whole_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = size > 0 ? (char*)malloc((size_t)size) : NULL;
+    if (data && fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *length = data ? (size_t)size : 0;
+    return data;
+}
+
+static void *failing_alloc(size_t size, void *user) {
+    (void)size;
+    (void)user;
+    return NULL;
+}
+
+static void plain_release(void *ptr, void *user) {
+    (void)user;
+    free(ptr);
+}
+
+// 不合法的参数、空输入、版本和分配失败都要返回对应的错误码
+static int test_error_codes(void) {
+    CodeSimConfig config;
+    CodeSimContext *ctx = NULL;
+    CodeSimVector vector;
+    int failed = 0;
+
+    codesim_config_init(&config);
+    config.version = CODESIM_CONFIG_VERSION + 1;
+    failed |= codesim_context_create(&config, &ctx) != CODESIM_ERR_VERSION || ctx != NULL;
+
+    codesim_config_init(&config);
+    config.allocator.release = plain_release;     // 只给了释放函数
+    failed |= codesim_context_create(&config, &ctx) != CODESIM_ERR_INVALID_ARG;
+
+    config.allocator.alloc = failing_alloc;
+    failed |= codesim_context_create(&config, &ctx) != CODESIM_ERR_NO_MEMORY || ctx != NULL;
+
+    failed |= codesim_context_create(NULL, NULL) != CODESIM_ERR_INVALID_ARG;
+    if (codesim_context_create(NULL, &ctx) != CODESIM_OK) {
+        fprintf(stderr, "libcodesim：默认配置创建上下文失败\n");
+        return 1;
+    }
+    failed |= codesim_vectorize_buffer(ctx, "int x;", 0, &vector) != CODESIM_ERR_EMPTY_INPUT;
+    failed |= codesim_vectorize_buffer(ctx, NULL, 6, &vector) != CODESIM_ERR_INVALID_ARG;
+    failed |= codesim_vectorize_buffer(NULL, "int x;", 6, &vector) != CODESIM_ERR_INVALID_ARG;
+    failed |= codesim_score_pair(ctx, &vector, &vector, NULL) != CODESIM_ERR_INVALID_ARG;
+    failed |= codesim_score_batch(ctx, &vector, NULL, 1, NULL) != CODESIM_ERR_INVALID_ARG;
+    failed |= codesim_strerror(CODESIM_ERR_NO_MEMORY) == NULL;
+    codesim_context_destroy(ctx);
+
+    if (failed) {
+        fprintf(stderr, "libcodesim：错误码与 codesim.h 的约定不符\n");
+        return 1;
+    }
+    printf("libcodesim：各种错误都返回约定的错误码\n");
+    return 0;
+}
+
+// 同一段代码的向量完全相同，批量打分与逐对打分一致，得分与命令行工具相同
+static int test_matches_cli(const char *source_a, size_t length_a, const char *source_b, size_t length_b,
+                            const char *expected) {
+    CodeSimContext *ctx = NULL;
+    if (codesim_context_create(NULL, &ctx) != CODESIM_OK) {
+        fprintf(stderr, "libcodesim：默认配置创建上下文失败\n");
+        return 1;
+    }
+
+    CodeSimVector a, again, b;
+    double pair = 0.0, batch[2] = { 0.0, 0.0 };
+    int failed = codesim_vectorize_buffer(ctx, source_a, length_a, &a) != CODESIM_OK ||
+                 codesim_vectorize_buffer(ctx, source_a, length_a, &again) != CODESIM_OK ||
+                 codesim_vectorize_buffer(ctx, source_b, length_b, &b) != CODESIM_OK;
+    CodeSimVector candidates[2] = { a, b };
+    failed = failed || codesim_score_pair(ctx, &a, &b, &pair) != CODESIM_OK ||
+             codesim_score_batch(ctx, &a, candidates, 2, batch) != CODESIM_OK;
+    codesim_context_destroy(ctx);
+    if (failed) {
+        fprintf(stderr, "libcodesim：向量化或打分失败\n");
+        return 1;
+    }
+    if (memcmp(a.counts, again.counts, sizeof(a.counts)) != 0 || a.norm != again.norm || batch[1] != pair) {
+        fprintf(stderr, "libcodesim：同一输入的结果不一致\n");
+        return 1;
+    }
+
+    char actual[32];
+    snprintf(actual, sizeof(actual), "%.4f", pair);
+    if (strcmp(actual, expected) != 0) {
+        fprintf(stderr, "libcodesim：得分 %s 与命令行工具的 %s 不同\n", actual, expected);
+        return 1;
+    }
+    printf("libcodesim：得分 %s 与命令行工具相同，批量打分与逐对打分一致\n", actual);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "用法: %s <文件A> <文件B> <命令行工具给出的得分>\n", argv[0]);
+        return 1;
+    }
+    size_t length_a, length_b;
+    char *source_a = read_whole_file(argv[1], &length_a);
+    char *source_b = read_whole_file(argv[2], &length_b);
+    if (!source_a || !source_b) {
+        fprintf(stderr, "错误：无法读取 %s 或 %s\n", argv[1], argv[2]);
+        free(source_a);
+        free(source_b);
+        return 1;
+    }
+
+    int failed = test_error_codes();
+    failed |= test_matches_cli(source_a, length_a, source_b, length_b, argv[3]);
+    free(source_a);
+    free(source_b);
+    return failed;
+}
@@ -0,0 +1,207 @@
+// 回归测试：bash compile.sh test
+// 直接包含 preprocess.c，以便调用内部的 preprocess_chunked 并指定很小的块大小，
+// 让分界落在注释、字符串、转义和空白的各种位置上。随机数用固定种子的 xorshift，
+// 在任何平台上都生成同一批用例。compile.sh 会用默认 (SSE2) 和 -mavx2 各编译运行一次。
+#define _POSIX_C_SOURCE 200809L   // mkstemp
+#include "../src/preprocess.c"
+#include "calculate.h"
+#include "vectorization.h"
+#include "pipeline.h"
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define FUZZ_CASES       300000
+#define FUZZ_MAX_LENGTH  300
+#define FUZZ_MAX_CHUNK   64
+
+#ifndef PREPROCESS_SIMD_WIDTH
+#define PREPROCESS_SIMD_WIDTH 1      // 没有向量指令时逐字节扫描
+#endif
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+// 分块预处理与一次处理完的结果必须逐字节相同
+static int test_preprocess_chunked(ThreadPool* pool) {
+    // 只用会改变词法状态的字符和少量普通字符，边界情况出现得最密
+    static const char alphabet[] = "/*\"\\#\n \t aB1xyz;=\r";
+    char source[FUZZ_MAX_LENGTH + 1], expected[FUZZ_MAX_LENGTH + 1], actual[FUZZ_MAX_LENGTH + 1];
+
+    for (int c = 0; c < FUZZ_CASES; c++) {
+        size_t length = next_random() % FUZZ_MAX_LENGTH + 1;
+        for (size_t i = 0; i < length; i++) source[i] = alphabet[next_random() % (sizeof(alphabet) - 1)];
+        if (next_random() % 50 == 0) source[next_random() % length] = '\0';   // 中途的 '\0' 也要一致
+        source[length] = '\0';
+
+        size_t chunk = (size_t)(c % FUZZ_MAX_CHUNK) + 1;
+        size_t n = preprocess_source_into(source, length, expected);
+        size_t m = preprocess_chunked(pool, source, length, actual, chunk);
+        if (n != m || memcmp(expected, actual, n + 1) != 0) {
+            fprintf(stderr, "错误：第 %d 个用例 (块大小 %zu) 分块预处理结果不同\n", c, chunk);
+            fprintf(stderr, "  源代码: [%.*s]\n  串行:   [%s]\n  分块:   [%s]\n", (int)length, source,
+                    expected, actual);
+            return -1;
+        }
+    }
+    printf("分块预处理：%d 个用例 (块大小 1-%d，%d 字节扫描) 全部一致\n", FUZZ_CASES, FUZZ_MAX_CHUNK,
+           PREPROCESS_SIMD_WIDTH);
+    return 0;
+}
+
+// 几十 MB 的文件某一维计数可以超过 46341，两个计数的乘积不能在 int 里溢出
+static int test_cosine_large_counts(void) {
+    int a[VECTOR_DIMENSION] = { 0 }, b[VECTOR_DIMENSION] = { 0 };
+    a[0] = 3000000;
+    b[0] = 1000000;
+    a[1] = 5;
+    double plain = calculate_cosine_similarity(a, b, VECTOR_DIMENSION);
+    double normed = calculate_cosine_similarity_normed(a, calculate_vector_norm(a, VECTOR_DIMENSION),
+                                                       b, calculate_vector_norm(b, VECTOR_DIMENSION),
+                                                       VECTOR_DIMENSION);
+    if (plain < 0.999 || plain > 1.0 || normed != plain) {
+        fprintf(stderr, "错误：大计数向量的余弦得分错误 (%.6f / %.6f)\n", plain, normed);
+        return -1;
+    }
+    printf("大计数余弦：%.6f\n", plain);
+    return 0;
+}
+
+// parallel_for / parallel_tiles 的回调只在工作线程里跑，按 worker_id 下标的数组不会越界
+static atomic_int bad_worker;
+
+static void check_worker_range(size_t begin, size_t end, void *ctx) {
+    (void)begin; (void)end;
+    int id = threadpool_worker_id();
+    if (id < 0 || id >= threadpool_size((ThreadPool*)ctx)) atomic_store(&bad_worker, 1);
+}
+
+static void check_worker_tile(size_t row_begin, size_t row_end, size_t col_begin, size_t col_end, void *ctx) {
+    check_worker_range(row_begin, row_end, ctx);
+    (void)col_begin; (void)col_end;
+}
+
+static int test_worker_id(ThreadPool* pool) {
+    atomic_store(&bad_worker, 0);
+    threadpool_parallel_for(pool, 0, 100000, 7, check_worker_range, pool);
+    threadpool_parallel_tiles(pool, 0, 2000, 0, 2000, 16, check_worker_tile, pool);
+    threadpool_parallel_for(pool, 0, 1, 1, check_worker_range, pool);
+    if (atomic_load(&bad_worker)) {
+        fprintf(stderr, "错误：并行回调在工作线程之外执行\n");
+        return -1;
+    }
+    printf("并行回调：全部在工作线程里执行\n");
+    return 0;
+}
+
+// 在 parallel_for 的任务里再嵌套 parallel_for / parallel_tiles：等待的工作线程要帮着做任务，不能死锁
+typedef struct {
+    ThreadPool *pool;
+    atomic_ullong sum;
+} NestedJob;
+
+static void nested_inner(size_t begin, size_t end, void *ctx) {
+    NestedJob *job = (NestedJob*)ctx;
+    unsigned long long local = 0;
+    for (size_t i = begin; i < end; i++) local += i;
+    atomic_fetch_add(&job->sum, local);
+}
+
+static void nested_tile(size_t row_begin, size_t row_end, size_t col_begin, size_t col_end, void *ctx) {
+    NestedJob *job = (NestedJob*)ctx;
+    unsigned long long cells = 0;
+    for (size_t r = row_begin; r < row_end; r++) {
+        for (size_t c = r + 1 > col_begin ? r + 1 : col_begin; c < col_end; c++) cells++;
+    }
+    atomic_fetch_add(&job->sum, cells);
+}
+
+static void nested_outer(size_t begin, size_t end, void *ctx) {
+    NestedJob *job = (NestedJob*)ctx;
+    for (size_t i = begin; i < end; i++) {
+        threadpool_parallel_for(job->pool, 0, 10000, 16, nested_inner, job);
+        threadpool_parallel_tiles(job->pool, 0, 300, 0, 300, 8, nested_tile, job);
+    }
+}
+
+static int test_nested_parallel(ThreadPool* pool) {
+    NestedJob job = { pool, 0 };
+    const unsigned long long outer = 64;
+    threadpool_parallel_for(pool, 0, outer, 1, nested_outer, &job);
+    unsigned long long expected = outer * (10000ull * 9999 / 2 + 300ull * 299 / 2);
+    if (atomic_load(&job.sum) != expected) {
+        fprintf(stderr, "错误：嵌套并行结果 %llu，应为 %llu\n", (unsigned long long)atomic_load(&job.sum), expected);
+        return -1;
+    }
+    printf("嵌套并行：%llu 个外层任务各自嵌套 parallel_for / parallel_tiles，结果正确\n", outer);
+    return 0;
+}
+
+// 批量建库时超过 PREPROCESS_PARALLEL_MIN 的文件在任务里再分块并行，向量必须与串行的 generate_vector 相同
+static int test_batch_large_file(ThreadPool* pool) {
+    static const char piece[] =
+        "/* block comment with \"quotes\" and // slashes */\n"
+        "#include <stdio.h>\n"
+        "int add(int a, int b) { return a + b; } // tail\n"
+        "static const char *s = \"str /* not a comment */ \\\" end\";\n"
+        "for (int i = 0; i < 10; i++) { if (i % 2) continue; while (x) x--; }\n";
+    char path[] = "/tmp/codesim-test-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file) {
+        fprintf(stderr, "错误：无法创建临时文件\n");
+        return -1;
+    }
+    size_t written = 0;
+    while (written < PREPROCESS_PARALLEL_MIN + PREPROCESS_CHUNK_SIZE) written += fwrite(piece, 1, sizeof(piece) - 1, file);
+    fclose(file);
+
+    int rc = -1;
+    char *clean = preprocess_file(path);
+    int expected[VECTOR_DIMENSION], vectors[2 * VECTOR_DIMENSION], ok[2];
+    TokenStream tokens[2];
+    if (clean) {
+        generate_vector(clean, expected);
+        // 同一个文件放两次：一次只算向量 (分块统计)，一次带 token 流 (从编号序列统计)
+        const char *paths[2] = { path, path };
+        PipelineOutput plain = { vectors, ok, NULL, NULL, NULL };
+        pipeline_vectorize_files(pool, paths, 2, 0, &plain);
+        int same = ok[0] && ok[1] && memcmp(vectors, expected, sizeof(expected)) == 0 &&
+                   memcmp(vectors + VECTOR_DIMENSION, expected, sizeof(expected)) == 0;
+        PipelineOutput with_tokens = { vectors, ok, NULL, tokens, NULL };
+        pipeline_vectorize_files(pool, paths, 2, 0, &with_tokens);
+        same &= ok[0] && ok[1] && memcmp(vectors, expected, sizeof(expected)) == 0 &&
+                memcmp(vectors + VECTOR_DIMENSION, expected, sizeof(expected)) == 0;
+        rc = same ? 0 : -1;
+        for (int i = 0; i < 2; i++) free(tokens[i].data);
+        free(clean);
+    }
+    unlink(path);
+    if (rc != 0) {
+        fprintf(stderr, "错误：批量处理 %zu 字节的大文件得到的向量与串行 generate_vector 不同\n", written);
+        return -1;
+    }
+    printf("批量大文件：%zu 字节的文件分块并行得到的向量与串行相同\n", written);
+    return 0;
+}
+
+int main(void) {
+    ThreadPool* pool = threadpool_create(4);
+    if (!pool) {
+        fprintf(stderr, "错误：无法创建线程池\n");
+        return 1;
+    }
+    int failed = 0;
+    failed |= test_preprocess_chunked(pool) != 0;
+    failed |= test_cosine_large_counts() != 0;
+    failed |= test_worker_id(pool) != 0;
+    failed |= test_nested_parallel(pool) != 0;
+    failed |= test_batch_large_file(pool) != 0;
+    threadpool_destroy(pool);
+    return failed;
+}